@@ -6,17 +6,39 @@
 
 #include "CalqDecoder.h"
 
+#include <stdio.h>
+
 #include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "Common/Exceptions.h"
+#include "Common/helpers.h"
 #include "Common/log.h"
+#include "Common/ThreadPool.h"
 #include "QualCodec/QualDecoder.h"
 
 namespace calq {
 
+// Side information block of a CQ v3 file whose records have not all been
+// output yet, with the decoded quality values of its unmapped records
+struct PendingBlock {
+    SAMBlock samBlock;
+    std::string unmappedQual;
+    size_t unmappedQualIdx;
+};
+
 CalqDecoder::CalqDecoder(const Options &options)
     : cqFile_(options.inputFileName, CQFile::MODE_READ),
+      nrThreads_(options.threads),
       qualFile_(options.outputFileName, File::MODE_WRITE),
+      samOutput_(options.samOutput),
+      regionRname_(""),
+      regionPosMin_(0),
+      regionPosMax_(0),
       sideInformationFile_(options.sideInformationFileName) {
     if (options.inputFileName.empty() == true) {
         throwErrorException("options.inputFileName is empty");
@@ -27,6 +49,23 @@ CalqDecoder::CalqDecoder(const Options &options)
     if (options.sideInformationFileName.empty() == true) {
         throwErrorException("options.sideInformationFileName is empty");
     }
+    if (options.threads < 1) {
+        throwErrorException("threads must be greater than zero");
+    }
+
+    // SAM output needs the complete side information records
+    sideInformationFile_.setCompleteBamRecords(samOutput_);
+
+    // The output is written in large chunks
+    setvbuf((FILE *)qualFile_.handle(), NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    if (options.region.empty() == false) {
+        uint32_t start = 0;
+        uint32_t end = 0;
+        parseRegion(options.region, &regionRname_, &start, &end);
+        regionPosMin_ = start - 1;
+        regionPosMax_ = end - 1;
+    }
 }
 
 CalqDecoder::~CalqDecoder(void) {}
@@ -40,18 +79,38 @@ void CalqDecoder::decode(void) {
     size_t blockSize = 0;
     cqFile_.readHeader(&blockSize);
 
-    while (sideInformationFile_.readBlock(blockSize) != 0) {
-//         CALQ_LOG("Decoding block %zu", sideInformationFile_.nrBlocksRead()-1);
+    if (samOutput_ == true) {
+        qualFile_.write((unsigned char *)sideInformationFile_.header.data(), sideInformationFile_.header.length());
+    }
 
-        // Decode the quality values
-        QualDecoder qualDecoder;
-        qualDecoder.readBlock(&cqFile_);
-        for (auto const &samRecord : sideInformationFile_.currentBlock.records) {
-            if (samRecord.isMapped() == true) {
-                qualDecoder.decodeMappedRecordFromBlock(samRecord, &qualFile_);
-            } else {
-                qualDecoder.decodeUnmappedRecordFromBlock(samRecord, &qualFile_);
+    if (regionRname_.empty() == false && cqFile_.parameters().streaming == false) {
+        decodeRegion();
+    } else {
+        // The side information blocks are checked against the block index,
+        // if the CQ file has one
+        std::vector<CQFile::IndexEntry> index;
+        readIndex(&index);
+
+        if (cqFile_.parameters().streaming == true) {
+            CALQ_LOG("Decoding in streaming mode");
+            decodeStreaming(blockSize, index);
+        } else if (nrThreads_ > 1) {
+            CALQ_LOG("Decoding with %zu threads", nrThreads_);
+            decodeParallel(blockSize, index);
+        } else {
+            QualDecoder qualDecoder;
+            std::string output("");
+            size_t nrBlocks = 0;
+            while (sideInformationFile_.readBlock(blockSize) != 0) {
+//                 CALQ_LOG("Decoding block %zu", sideInformationFile_.nrBlocksRead()-1);
+                checkBlock(index, nrBlocks++, sideInformationFile_.currentBlock);
+
+                // Decode the quality values
+                output.clear();
+                decodeBlock(sideInformationFile_.currentBlock.records, &cqFile_, &qualDecoder, &output);
+                qualFile_.write((unsigned char *)output.data(), output.size());
             }
+            checkNrBlocks(index, nrBlocks);
         }
     }
 
@@ -68,5 +127,330 @@ void CalqDecoder::decode(void) {
     CALQ_LOG("  Decoded %zu block(s)", sideInformationFile_.nrBlocksRead());
 }
 
-}  // namespace calq
+// Reads the block index, if the CQ file has one, and returns to the current
+// position
+void CalqDecoder::readIndex(std::vector<CQFile::IndexEntry> *index) {
+    if (cqFile_.isSeekable() == false) {
+        return;
+    }
+    size_t position = cqFile_.tell();
+    if (cqFile_.readIndex(index) > 0) {
+        CALQ_LOG("Read block index with %zu block(s)", index->size());
+    }
+    cqFile_.seek(position);
+}
+
+// Checks the side information block with the given index against the block
+// index; without a block index nothing is checked
+void CalqDecoder::checkBlock(const std::vector<CQFile::IndexEntry> &index,
+                             const size_t &blockIdx,
+                             const SAMBlock &samBlock) const {
+    if (index.empty() == true) {
+        return;
+    }
+    if (blockIdx >= index.size()) {
+        throwErrorException("Side information does not match the CQ block index (too many blocks)");
+    }
+    checkBlock(index[blockIdx], samBlock);
+}
+
+void CalqDecoder::checkBlock(const CQFile::IndexEntry &entry, const SAMBlock &samBlock) const {
+    if (samBlock.nrRecords() != entry.nrRecords) {
+        throwErrorException("Side information does not match the CQ block index");
+    }
+    if (entry.hasChecksum == true) {
+        // The checksum covers every field the decoder depends on, so a
+        // different or modified side information file is detected before
+        // the block is decoded
+        if (samBlock.checksum() != entry.checksum) {
+            throwErrorException("Side information does not match the CQ block index (checksum mismatch)");
+        }
+    } else {
+        for (auto const &samRecord : samBlock.records) {
+            if (samRecord.isMapped() == true) {
+                if (samRecord.rname != entry.rname.c_str() || samRecord.posMin < entry.posMin) {
+                    throwErrorException("Side information does not match the CQ block index");
+                }
+                break;
+            }
+        }
+    }
+}
+
+// Checks that the side information did not run out before the last block
+void CalqDecoder::checkNrBlocks(const std::vector<CQFile::IndexEntry> &index, const size_t &nrBlocks) const {
+    if (index.empty() == false && nrBlocks != index.size()) {
+        throwErrorException("Side information does not match the CQ block index (too few blocks)");
+    }
+}
+
+// Decodes a block into output, which is written to the output file with a
+// single write
+void CalqDecoder::decodeBlock(const std::deque<SAMRecord> &samRecords,
+                              CQFile *cqFile,
+                              QualDecoder *qualDecoder,
+                              std::string *output) const {
+    qualDecoder->reset();
+    qualDecoder->readBlock(cqFile);
 
+    for (auto const &samRecord : samRecords) {
+        size_t recordOffset = output->size();
+
+        // The fields of a record are views into its (contiguous) SAM line,
+        // so the line can be written around the QUAL field
+        if (samOutput_ == true) {
+            output->append(samRecord.qname.begin(), samRecord.qual.begin());
+        }
+        if (samRecord.isMapped() == true) {
+            qualDecoder->decodeMappedRecordFromBlock(samRecord, output);
+        } else {
+            qualDecoder->decodeUnmappedRecordFromBlock(samRecord, output);
+        }
+        if (samOutput_ == true) {
+            output->append(samRecord.qual.end(), samRecord.opt.end());
+        }
+        *output += '\n';
+
+        // The quality values of all records of a block have to be decoded,
+        // but only those in the region are output
+        if (isInRegion(samRecord) == false) {
+            output->resize(recordOffset);
+        }
+    }
+}
+
+void CalqDecoder::decodeParallel(const size_t &blockSize, const std::vector<CQFile::IndexEntry> &index) {
+    ThreadPool threadPool(nrThreads_);
+
+    // The main thread reads the CQ blocks (without decompressing them) and
+    // the matching side information blocks ahead and hands them to the
+    // worker threads. The decoded quality values are written in block order,
+    // with at most two blocks per thread in flight.
+    std::deque< std::future<std::string> > decodedBlocks;
+    const size_t maxBlocksInFlight = 2 * nrThreads_;
+
+    // As in CalqEncoder::encodeParallel(), block n is decoded with
+    // qualDecoders[n % maxBlocksInFlight]
+    std::vector< std::unique_ptr<QualDecoder> > qualDecoders;
+    for (size_t i = 0; i < maxBlocksInFlight; ++i) {
+        qualDecoders.emplace_back(new QualDecoder(&threadPool));
+    }
+    size_t nrBlocksRead = 0;
+
+    // Let the thread pool also decompress BAM side information
+    sideInformationFile_.setThreadPool(&threadPool);
+
+    auto writeBlock = [&](void) {
+        std::future<std::string> future = std::move(decodedBlocks.front());
+        decodedBlocks.pop_front();
+        std::string qualBuffer = future.get();
+        qualFile_.write((unsigned char *)qualBuffer.data(), qualBuffer.size());
+    };
+
+    try {
+        while (sideInformationFile_.readBlock(blockSize) != 0) {
+            checkBlock(index, nrBlocksRead, sideInformationFile_.currentBlock);
+            std::shared_ptr<std::string> cqBlock = std::make_shared<std::string>();
+            QualDecoder::readRawBlock(&cqFile_, cqBlock.get());
+            std::shared_ptr<SAMBlock> samBlock = std::make_shared<SAMBlock>();
+            samBlock->swap(&sideInformationFile_.currentBlock);
+
+            QualDecoder *qualDecoder = qualDecoders[nrBlocksRead++ % maxBlocksInFlight].get();
+            decodedBlocks.push_back(threadPool.enqueue([this, cqBlock, samBlock, qualDecoder, &threadPool](void) {
+                std::string qualBuffer;
+                CQFile cqBuffer(cqBlock.get(), CQFile::MODE_READ);
+                cqBuffer.setFormat(cqFile_);
+                cqBuffer.setThreadPool(&threadPool);
+                decodeBlock(samBlock->records, &cqBuffer, qualDecoder, &qualBuffer);
+                return qualBuffer;
+            }));
+
+            while (decodedBlocks.size() >= maxBlocksInFlight) {
+                writeBlock();
+            }
+        }
+
+        while (decodedBlocks.empty() == false) {
+            writeBlock();
+        }
+        checkNrBlocks(index, nrBlocksRead);
+    } catch (...) {
+        // Let the workers finish before the thread pool is torn down
+        for (auto &decodedBlock : decodedBlocks) {
+            decodedBlock.wait();
+        }
+        sideInformationFile_.setThreadPool(NULL);
+        throw;
+    }
+
+    sideInformationFile_.setThreadPool(NULL);
+}
+
+// Decodes only the blocks overlapping the region, using the block index to
+// seek to them in the CQ file and, if possible, in the side information
+void CalqDecoder::decodeRegion(void) {
+    std::vector<CQFile::IndexEntry> index;
+    if (cqFile_.readIndex(&index) == 0) {
+        throwErrorException("CQ file has no block index");
+    }
+    CALQ_LOG("Read block index with %zu block(s)", index.size());
+
+    // Seek in the side information if it is the SAM file the CQ file was
+    // encoded from; otherwise skip the blocks before the region by reading
+    // them
+    bool seekSideInformation = sideInformationFile_.canSetPosition();
+    for (auto const &entry : index) {
+        if (entry.samOffset == SAMFile::NO_POSITION) {
+            seekSideInformation = false;
+        }
+    }
+
+    QualDecoder qualDecoder;
+    std::string output("");
+    size_t nrDecodedBlocks = 0;
+
+    for (auto const &entry : index) {
+        bool overlaps = (entry.rname == regionRname_
+                         && entry.posMin <= regionPosMax_
+                         && entry.posMax >= regionPosMin_);
+        if (overlaps == false) {
+            // The blocks of a region are contiguous in a sorted file
+            if (nrDecodedBlocks > 0
+                && entry.rname != "*"
+                && (entry.rname != regionRname_ || entry.posMin > regionPosMax_)) {
+                break;
+            }
+            if (seekSideInformation == false) {
+                if (sideInformationFile_.readBlock(entry.nrRecords) != entry.nrRecords) {
+                    throwErrorException("Side information does not match the CQ block index");
+                }
+            }
+            continue;
+        }
+
+        if (seekSideInformation == true) {
+            sideInformationFile_.setPosition(entry.samOffset);
+        }
+        sideInformationFile_.readBlock(entry.nrRecords);
+        checkBlock(entry, sideInformationFile_.currentBlock);
+
+        cqFile_.seek(entry.cqOffset);
+        output.clear();
+        decodeBlock(sideInformationFile_.currentBlock.records, &cqFile_, &qualDecoder, &output);
+        qualFile_.write((unsigned char *)output.data(), output.size());
+        nrDecodedBlocks++;
+    }
+
+    CALQ_LOG("Decoded %zu block(s) overlapping the region", nrDecodedBlocks);
+}
+
+// Decodes a CQ v3 file: the mapped records whose quality values are in a
+// block may have been read with earlier side information blocks, hence the
+// records are output as soon as all records before them have been decoded.
+// With a region, all blocks are decoded and only the records in the region
+// are output.
+void CalqDecoder::decodeStreaming(const size_t &blockSize, const std::vector<CQFile::IndexEntry> &index) {
+    std::unique_ptr<ThreadPool> threadPool;
+    if (nrThreads_ > 1) {
+        threadPool.reset(new ThreadPool(nrThreads_));
+        sideInformationFile_.setThreadPool(threadPool.get());
+    }
+
+    QualDecoder qualDecoder(threadPool.get());
+    std::deque< std::unique_ptr<PendingBlock> > pendingBlocks;
+    size_t recordIdx = 0;  // next record of pendingBlocks.front() to output
+    std::string output("");
+    size_t nrBlocks = 0;
+
+    // Outputs the records up to the first mapped record which is not in the
+    // current CQ block
+    auto outputRecords = [&](void) {
+        size_t nrFinishedRecords = qualDecoder.nrFinishedRecords();
+        while (pendingBlocks.empty() == false) {
+            PendingBlock &pendingBlock = *pendingBlocks.front();
+            for (; recordIdx < pendingBlock.samBlock.records.size(); recordIdx++) {
+                const SAMRecord &samRecord = pendingBlock.samBlock.records[recordIdx];
+                if (samRecord.isMapped() == true && nrFinishedRecords == 0) {
+                    return;
+                }
+
+                size_t recordOffset = output.size();
+                if (samOutput_ == true) {
+                    output.append(samRecord.qname.begin(), samRecord.qual.begin());
+                }
+                if (samRecord.isMapped() == true) {
+                    qualDecoder.decodeMappedRecordFromBlock(samRecord, &output);
+                    nrFinishedRecords--;
+                } else {
+                    output.append(pendingBlock.unmappedQual, pendingBlock.unmappedQualIdx, samRecord.seq.length());
+                    pendingBlock.unmappedQualIdx += samRecord.seq.length();
+                }
+                if (samOutput_ == true) {
+                    output.append(samRecord.qual.end(), samRecord.opt.end());
+                }
+                output += '\n';
+
+                if (isInRegion(samRecord) == false) {
+                    output.resize(recordOffset);
+                }
+            }
+            pendingBlocks.pop_front();
+            recordIdx = 0;
+        }
+        if (nrFinishedRecords > 0) {
+            throwErrorException("Side information does not match the CQ file");
+        }
+    };
+
+    try {
+        while (sideInformationFile_.readBlock(blockSize) != 0) {
+            checkBlock(index, nrBlocks++, sideInformationFile_.currentBlock);
+            qualDecoder.readBlock(&cqFile_);
+
+            // The unmapped quality values are in the CQ block read together
+            // with the side information block
+            std::unique_ptr<PendingBlock> pendingBlock(new PendingBlock());
+            pendingBlock->samBlock.swap(&sideInformationFile_.currentBlock);
+            pendingBlock->unmappedQualIdx = 0;
+            for (auto const &samRecord : pendingBlock->samBlock.records) {
+                if (samRecord.isMapped() == false) {
+                    qualDecoder.decodeUnmappedRecordFromBlock(samRecord, &pendingBlock->unmappedQual);
+                }
+            }
+            pendingBlocks.push_back(std::move(pendingBlock));
+
+            output.clear();
+            outputRecords();
+            qualFile_.write((unsigned char *)output.data(), output.size());
+        }
+
+        checkNrBlocks(index, nrBlocks);
+
+        // The final block holds the records still pending after the last
+        // side information block
+        qualDecoder.readBlock(&cqFile_);
+        output.clear();
+        outputRecords();
+        qualFile_.write((unsigned char *)output.data(), output.size());
+        if (pendingBlocks.empty() == false) {
+            throwErrorException("Side information does not match the CQ file");
+        }
+    } catch (...) {
+        sideInformationFile_.setThreadPool(NULL);
+        throw;
+    }
+
+    sideInformationFile_.setThreadPool(NULL);
+}
+
+bool CalqDecoder::isInRegion(const SAMRecord &samRecord) const {
+    if (regionRname_.empty() == true) {
+        return true;
+    }
+    return (samRecord.isMapped() == true
+            && samRecord.rname == regionRname_.c_str()
+            && samRecord.posMin <= regionPosMax_
+            && samRecord.posMax >= regionPosMin_);
+}
+
+}  // namespace calq
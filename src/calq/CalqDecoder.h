@@ -7,10 +7,17 @@
 #ifndef CALQ_CALQDECODER_H_
 #define CALQ_CALQDECODER_H_
 
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Common/constants.h"
 #include "Common/Options.h"
+#include "Common/ThreadPool.h"
 #include "IO/CQ/CQFile.h"
 #include "IO/File.h"
 #include "IO/SAM/SAMFile.h"
+#include "QualCodec/QualDecoder.h"
 
 namespace calq {
 
@@ -22,8 +29,34 @@ class CalqDecoder {
     void decode(void);
 
  private:
+    static const size_t OUTPUT_BUFFER_SIZE = 4*MB;
+
+    void readIndex(std::vector<CQFile::IndexEntry> *index);
+    void checkBlock(const std::vector<CQFile::IndexEntry> &index,
+                    const size_t &blockIdx,
+                    const SAMBlock &samBlock) const;
+    void checkBlock(const CQFile::IndexEntry &entry, const SAMBlock &samBlock) const;
+    void checkNrBlocks(const std::vector<CQFile::IndexEntry> &index, const size_t &nrBlocks) const;
+    void decodeBlock(const std::deque<SAMRecord> &samRecords,
+                     CQFile *cqFile,
+                     QualDecoder *qualDecoder,
+                     std::string *output) const;
+    void decodeParallel(const size_t &blockSize, const std::vector<CQFile::IndexEntry> &index);
+    void decodeRegion(void);
+    void decodeStreaming(const size_t &blockSize, const std::vector<CQFile::IndexEntry> &index);
+    bool isInRegion(const SAMRecord &samRecord) const;
+
     CQFile cqFile_;
+    size_t nrThreads_;
     File qualFile_;
+    bool samOutput_;  // write SAM records instead of bare quality values
+
+    // Region to be decoded (0-based, inclusive); empty regionRname_ if the
+    // entire file is decoded
+    std::string regionRname_;
+    uint32_t regionPosMin_;
+    uint32_t regionPosMax_;
+
     SAMFile sideInformationFile_;
 };
 
@@ -7,27 +7,90 @@
 #include "CalqEncoder.h"
 
 #include <chrono>
+#include <future>
 #include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "Common/constants.h"
 #include "Common/Exceptions.h"
 #include "Common/log.h"
+#include "Common/ThreadPool.h"
 #include "config.h"
 #include "IO/FASTA/FASTAFile.h"
-#include "QualCodec/QualEncoder.h"
 
 namespace calq {
 
+// Result of a block encoded by one of the worker threads: the CQ bitstream
+// of the block, ready to be appended to the CQ file, and its statistics
+struct EncodedBlock {
+    std::string cqBuffer;
+    size_t compressedMappedQualSize;
+    size_t compressedUnmappedQualSize;
+    size_t uncompressedMappedQualSize;
+    size_t uncompressedUnmappedQualSize;
+};
+
+// Describes a block for the block index; the CQ offset is filled in when the
+// block is written
+static CQFile::IndexEntry indexEntry(const SAMBlock &samBlock, const size_t &samOffset) {
+    CQFile::IndexEntry entry;
+    entry.rname = "*";
+    entry.posMin = 0;
+    entry.posMax = 0;
+    entry.cqOffset = 0;
+    entry.samOffset = samOffset;
+    entry.nrRecords = samBlock.records.size();
+    entry.hasChecksum = true;
+    entry.checksum = samBlock.checksum();
+
+    // All mapped records of a block share the same RNAME and are sorted by
+    // their position
+    bool first = true;
+    for (auto const &samRecord : samBlock.records) {
+        if (samRecord.isMapped() == true) {
+            if (first == true) {
+                entry.rname = samRecord.rname.str();
+                entry.posMin = samRecord.posMin;
+                first = false;
+            }
+            if (samRecord.posMax > entry.posMax) {
+                entry.posMax = samRecord.posMax;
+            }
+        }
+    }
+
+    return entry;
+}
+
+// Maps the codec names accepted by Options to CQFile codecs
+static uint8_t codecFromName(const std::string &name) {
+    if (name == "range") {
+        return CQFile::CODEC_RANGE_O1;
+    } else if (name == "rans0") {
+        return CQFile::CODEC_RANS_O0;
+    } else if (name == "rans1") {
+        return CQFile::CODEC_RANS_O1;
+    }
+    throwErrorException("codec is not supported");
+    return 0;
+}
+
 CalqEncoder::CalqEncoder(const Options &options)
     : blockSize_(options.blockSize),
+      codec_(codecFromName(options.codec)),
       cqFile_(options.outputFileName, CQFile::MODE_WRITE),
+      fixedPointGenotyper_(options.genotyper == "fixed"),
       inputFileName_(options.inputFileName),
+      nrThreads_(options.threads),
       polyploidy_(options.polyploidy),
       qualityValueMin_(options.qualityValueMin),
       qualityValueMax_(options.qualityValueMax),
       qualityValueOffset_(options.qualityValueOffset),
       referenceFileNames_(options.referenceFileNames),
-      samFile_(options.inputFileName) {
+      samFile_(options.inputFileName),
+      streaming_(options.streaming) {
     if (options.blockSize < 1) {
         throwErrorException("blockSize must be greater than zero");
     }
@@ -40,6 +103,9 @@ CalqEncoder::CalqEncoder(const Options &options)
     if (options.polyploidy < 1) {
         throwErrorException("polyploidy must be greater than zero");
     }
+    if (options.threads < 1) {
+        throwErrorException("threads must be greater than zero");
+    }
     if (options.qualityValueMin < 0) {
         throwErrorException("qualityValueMin must be zero or greater");
     }
@@ -82,44 +148,48 @@ void CalqEncoder::encode(void) {
 
     // Write CQ file header
     CALQ_LOG("Writing CQ file header");
-    cqFile_.writeHeader(blockSize_);
-
-    while (samFile_.readBlock(blockSize_) != 0) {
-//         CALQ_LOG("Processing block %zu", samFile_.nrBlocksRead()-1);
-
-        // Check quality value range
-        for (auto const &samRecord : samFile_.currentBlock.records) {
-            if (samRecord.isMapped() == true) {
-                for (auto const &q : samRecord.qual) {
-                    if (((int)q-qualityValueOffset_) < qualityValueMin_) {
-                        throwErrorException("Quality value too small");
-                    }
-                    if (((int)q-qualityValueOffset_) > qualityValueMax_) {
-                        throwErrorException("Quality value too large");
-                    }
-                }
-            }
-        }
+    cqFile_.writeHeader(blockSize_, QualEncoder(polyploidy_, qualityValueMax_, qualityValueMin_, qualityValueOffset_, codec_, fixedPointGenotyper_, streaming_).parameters());
 
-        // Encode the quality values
-        QualEncoder qualEncoder(polyploidy_, qualityValueMax_, qualityValueMin_, qualityValueOffset_);
-        for (auto const &samRecord : samFile_.currentBlock.records) {
-            if (samRecord.isMapped() == true) {
-                qualEncoder.addMappedRecordToBlock(samRecord);
-            } else {
-                qualEncoder.addUnmappedRecordToBlock(samRecord);
-            }
-        }
-        qualEncoder.finishBlock();
-        qualEncoder.writeBlock(&cqFile_);
+    std::vector<CQFile::IndexEntry> index;
+
+    if (streaming_ == true) {
+        CALQ_LOG("Encoding in streaming mode");
+        encodeStreaming(&compressedMappedQualSize,
+                        &compressedUnmappedQualSize,
+                        &uncompressedMappedQualSize,
+                        &uncompressedUnmappedQualSize,
+                        &index);
+    } else if (nrThreads_ > 1) {
+        CALQ_LOG("Encoding with %zu threads", nrThreads_);
+        encodeParallel(&compressedMappedQualSize,
+                       &compressedUnmappedQualSize,
+                       &uncompressedMappedQualSize,
+                       &uncompressedUnmappedQualSize,
+                       &index);
+    } else {
+        QualEncoder qualEncoder(polyploidy_, qualityValueMax_, qualityValueMin_, qualityValueOffset_, codec_, fixedPointGenotyper_);
+        while (samFile_.readBlock(blockSize_) != 0) {
+//             CALQ_LOG("Processing block %zu", samFile_.nrBlocksRead()-1);
 
-        // Update statistics
-        compressedMappedQualSize += qualEncoder.compressedMappedQualSize();
-        compressedUnmappedQualSize += qualEncoder.compressedUnmappedQualSize();
-        uncompressedMappedQualSize += qualEncoder.uncompressedMappedQualSize();
-        uncompressedUnmappedQualSize += qualEncoder.uncompressedUnmappedQualSize();
+            index.push_back(indexEntry(samFile_.currentBlock, samFile_.blockPosition()));
+            index.back().cqOffset = cqFile_.nrWrittenBytes();
+
+            // Encode the quality values
+            qualEncoder.reset();
+            encodeBlock(&samFile_.currentBlock.records, &qualEncoder, &cqFile_);
+
+            // Update statistics
+            compressedMappedQualSize += qualEncoder.compressedMappedQualSize();
+            compressedUnmappedQualSize += qualEncoder.compressedUnmappedQualSize();
+            uncompressedMappedQualSize += qualEncoder.uncompressedMappedQualSize();
+            uncompressedUnmappedQualSize += qualEncoder.uncompressedUnmappedQualSize();
+        }
     }
 
+    // Append the block index
+    CALQ_LOG("Writing block index");
+    cqFile_.writeIndex(index);
+
     auto stopTime = std::chrono::steady_clock::now();
     auto diffTime = stopTime - startTime;
     auto diffTimeMs = std::chrono::duration_cast<std::chrono::milliseconds>(diffTime).count();
@@ -152,5 +222,156 @@ void CalqEncoder::encode(void) {
     CALQ_LOG("    Unmapped:             %2.4f", ((double)compressedUnmappedQualSize * 8)/(double)(uncompressedUnmappedQualSize));
 }
 
-}  // namespace calq
+void CalqEncoder::encodeBlock(std::deque<SAMRecord> *samRecords, QualEncoder *qualEncoder, CQFile *cqFile) const {
+    // Check quality value range
+    for (auto const &samRecord : *samRecords) {
+        if (samRecord.isMapped() == true) {
+            for (auto const &q : samRecord.qual) {
+                if (((int)q-qualityValueOffset_) < qualityValueMin_) {
+                    throwErrorException("Quality value too small");
+                }
+                if (((int)q-qualityValueOffset_) > qualityValueMax_) {
+                    throwErrorException("Quality value too large");
+                }
+            }
+        }
+    }
 
+    // Encode the quality values; the parsed CIGARs are moved to the
+    // QualEncoder
+    for (auto &samRecord : *samRecords) {
+        if (samRecord.isMapped() == true) {
+            qualEncoder->addMappedRecordToBlock(&samRecord);
+        } else {
+            qualEncoder->addUnmappedRecordToBlock(samRecord);
+        }
+    }
+    qualEncoder->finishBlock();
+    qualEncoder->writeBlock(cqFile);
+}
+
+void CalqEncoder::encodeParallel(size_t *compressedMappedQualSize,
+                                 size_t *compressedUnmappedQualSize,
+                                 size_t *uncompressedMappedQualSize,
+                                 size_t *uncompressedUnmappedQualSize,
+                                 std::vector<CQFile::IndexEntry> *index) {
+    ThreadPool threadPool(nrThreads_);
+
+    // Blocks are read and handed to the worker threads in input order; the
+    // futures are kept in the same order so that the encoded blocks can be
+    // appended to the CQ file exactly as in the single-threaded case. At most
+    // two blocks per thread are in flight to bound the memory consumption.
+    std::deque< std::future<EncodedBlock> > encodedBlocks;
+    const size_t maxBlocksInFlight = 2 * nrThreads_;
+
+    // Block n is encoded with qualEncoders[n % maxBlocksInFlight]: when it is
+    // handed to a worker, block n - maxBlocksInFlight has been written, so
+    // that its encoder can be reused
+    std::vector< std::unique_ptr<QualEncoder> > qualEncoders;
+    for (size_t i = 0; i < maxBlocksInFlight; ++i) {
+        qualEncoders.emplace_back(new QualEncoder(polyploidy_, qualityValueMax_, qualityValueMin_, qualityValueOffset_, codec_, fixedPointGenotyper_, false, &threadPool));
+    }
+    size_t nrBlocksRead = 0;
+
+    // Let the thread pool also decompress BAM input ahead of the parser
+    samFile_.setThreadPool(&threadPool);
+
+    size_t nrBlocksWritten = 0;
+    auto writeBlock = [&](void) {
+        std::future<EncodedBlock> future = std::move(encodedBlocks.front());
+        encodedBlocks.pop_front();
+        EncodedBlock encodedBlock = future.get();
+        (*index)[nrBlocksWritten++].cqOffset = cqFile_.nrWrittenBytes();
+        cqFile_.write((unsigned char *)encodedBlock.cqBuffer.data(), encodedBlock.cqBuffer.size());
+        *compressedMappedQualSize += encodedBlock.compressedMappedQualSize;
+        *compressedUnmappedQualSize += encodedBlock.compressedUnmappedQualSize;
+        *uncompressedMappedQualSize += encodedBlock.uncompressedMappedQualSize;
+        *uncompressedUnmappedQualSize += encodedBlock.uncompressedUnmappedQualSize;
+    };
+
+    try {
+        while (samFile_.readBlock(blockSize_) != 0) {
+            index->push_back(indexEntry(samFile_.currentBlock, samFile_.blockPosition()));
+
+            // The records may point into memory owned by the block, hence
+            // the worker takes over the entire block
+            std::shared_ptr<SAMBlock> samBlock = std::make_shared<SAMBlock>();
+            samBlock->swap(&samFile_.currentBlock);
+
+            QualEncoder *qualEncoder = qualEncoders[nrBlocksRead++ % maxBlocksInFlight].get();
+            encodedBlocks.push_back(threadPool.enqueue([this, samBlock, qualEncoder](void) {
+                EncodedBlock encodedBlock;
+                CQFile cqBuffer(&encodedBlock.cqBuffer, CQFile::MODE_WRITE);
+                qualEncoder->reset();
+                encodeBlock(&samBlock->records, qualEncoder, &cqBuffer);
+                encodedBlock.compressedMappedQualSize = qualEncoder->compressedMappedQualSize();
+                encodedBlock.compressedUnmappedQualSize = qualEncoder->compressedUnmappedQualSize();
+                encodedBlock.uncompressedMappedQualSize = qualEncoder->uncompressedMappedQualSize();
+                encodedBlock.uncompressedUnmappedQualSize = qualEncoder->uncompressedUnmappedQualSize();
+                return encodedBlock;
+            }));
+
+            while (encodedBlocks.size() >= maxBlocksInFlight) {
+                writeBlock();
+            }
+        }
+
+        while (encodedBlocks.empty() == false) {
+            writeBlock();
+        }
+    } catch (...) {
+        // Let the workers finish before the thread pool is torn down
+        for (auto &encodedBlock : encodedBlocks) {
+            encodedBlock.wait();
+        }
+        samFile_.setThreadPool(NULL);
+        throw;
+    }
+
+    samFile_.setThreadPool(NULL);
+}
+
+void CalqEncoder::encodeStreaming(size_t *compressedMappedQualSize,
+                                  size_t *compressedUnmappedQualSize,
+                                  size_t *uncompressedMappedQualSize,
+                                  size_t *uncompressedUnmappedQualSize,
+                                  std::vector<CQFile::IndexEntry> *index) {
+    // A single encoder carries the pileup and the pending records from one
+    // block to the next, hence the blocks are encoded one after another;
+    // additional threads entropy-code the streams of a block and decompress
+    // BAM input
+    std::unique_ptr<ThreadPool> threadPool;
+    if (nrThreads_ > 1) {
+        threadPool.reset(new ThreadPool(nrThreads_));
+        samFile_.setThreadPool(threadPool.get());
+    }
+
+    try {
+        QualEncoder qualEncoder(polyploidy_, qualityValueMax_, qualityValueMin_, qualityValueOffset_, codec_, fixedPointGenotyper_, true, threadPool.get());
+
+        while (samFile_.readBlock(blockSize_) != 0) {
+            index->push_back(indexEntry(samFile_.currentBlock, samFile_.blockPosition()));
+            index->back().cqOffset = cqFile_.nrWrittenBytes();
+
+            encodeBlock(&samFile_.currentBlock.records, &qualEncoder, &cqFile_);
+            *compressedMappedQualSize += qualEncoder.compressedMappedQualSize();
+            *compressedUnmappedQualSize += qualEncoder.compressedUnmappedQualSize();
+        }
+
+        // The records still pending after the last block go to a final
+        // block, which is not in the block index
+        qualEncoder.finishStream();
+        qualEncoder.writeBlock(&cqFile_);
+        *compressedMappedQualSize += qualEncoder.compressedMappedQualSize();
+        *compressedUnmappedQualSize += qualEncoder.compressedUnmappedQualSize();
+        *uncompressedMappedQualSize += qualEncoder.uncompressedMappedQualSize();
+        *uncompressedUnmappedQualSize += qualEncoder.uncompressedUnmappedQualSize();
+    } catch (...) {
+        samFile_.setThreadPool(NULL);
+        throw;
+    }
+
+    samFile_.setThreadPool(NULL);
+}
+
+}  // namespace calq
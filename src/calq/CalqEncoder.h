@@ -7,6 +7,7 @@
 #ifndef CALQ_CALQENCODER_H_
 #define CALQ_CALQENCODER_H_
 
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -14,6 +15,7 @@
 #include "config.h"
 #include "IO/CQ/CQFile.h"
 #include "IO/SAM/SAMFile.h"
+#include "QualCodec/QualEncoder.h"
 
 namespace calq {
 
@@ -25,15 +27,31 @@ class CalqEncoder {
     void encode(void);
 
  private:
+    void encodeBlock(std::deque<SAMRecord> *samRecords, QualEncoder *qualEncoder, CQFile *cqFile) const;
+    void encodeParallel(size_t *compressedMappedQualSize,
+                        size_t *compressedUnmappedQualSize,
+                        size_t *uncompressedMappedQualSize,
+                        size_t *uncompressedUnmappedQualSize,
+                        std::vector<CQFile::IndexEntry> *index);
+    void encodeStreaming(size_t *compressedMappedQualSize,
+                         size_t *compressedUnmappedQualSize,
+                         size_t *uncompressedMappedQualSize,
+                         size_t *uncompressedUnmappedQualSize,
+                         std::vector<CQFile::IndexEntry> *index);
+
     size_t blockSize_;
+    uint8_t codec_;
     CQFile cqFile_;
+    bool fixedPointGenotyper_;
     std::string inputFileName_;
+    size_t nrThreads_;
     int polyploidy_;
     int qualityValueMin_;
     int qualityValueMax_;
     int qualityValueOffset_;
     std::vector<std::string> referenceFileNames_;
     SAMFile samFile_;
+    bool streaming_;
 };
 
 }  // namespace calq
@@ -15,16 +15,22 @@ Options::Options(void)
     : force(false),
       inputFileName(""),
       outputFileName(""),
+      threads(0),
       // Options for only compression
       blockSize(0),
+      codec(""),
+      genotyper(""),
       polyploidy(0),
       qualityValueMax(0),
       qualityValueMin(0),
       qualityValueOffset(0),
       qualityValueType(""),
       referenceFileNames(),
+      streaming(false),
       // Options for only decompression
       decompress(false),
+      samOutput(false),
+      region(""),
       sideInformationFileName("") {}
 
 Options::~Options(void) {}
@@ -40,9 +46,16 @@ void Options::validate(void) {
     if (inputFileName.empty() == true) {
         throwErrorException("No input file name provided");
     }
-    if (decompress == false) {
-        if (fileNameExtension(inputFileName) != std::string("sam")) {
-            throwErrorException("Input file name extension must be 'sam'");
+    if (inputFileName == "-") {
+        // Streaming from the standard input, e.g. directly behind an aligner
+        CALQ_LOG("Reading input from stdin");
+        if (outputFileName.empty() == true) {
+            throwErrorException("An output file name must be provided when reading from stdin");
+        }
+    } else if (decompress == false) {
+        if (fileNameExtension(inputFileName) != std::string("sam")
+            && fileNameExtension(inputFileName) != std::string("bam")) {
+            throwErrorException("Input file name extension must be 'sam' or 'bam'");
         }
     } else {
         if (fileNameExtension(inputFileName) != std::string("cq")) {
@@ -50,7 +63,7 @@ void Options::validate(void) {
 //             throwErrorException("Input file name extension must be 'cq'");
         }
     }
-    if (fileExists(inputFileName) == false) {
+    if (inputFileName != "-" && fileExists(inputFileName) == false) {
         throwErrorException("Cannot access input file");
     }
 
@@ -67,12 +80,22 @@ void Options::validate(void) {
         }
     }
     CALQ_LOG("Output file name: %s", outputFileName.c_str());
+    if (decompress == true && fileNameExtension(outputFileName) == std::string("sam")) {
+        CALQ_LOG("Output file name extension is 'sam' - writing SAM records with the decoded quality values");
+        samOutput = true;
+    }
     if (fileExists(outputFileName) == true) {
         if (force == false) {
             throwErrorException("Not overwriting output file (use option 'f' to force overwriting)");
         }
     }
 
+    // threads
+    CALQ_LOG("Threads: %d", threads);
+    if (threads < 1) {
+        throwErrorException("Number of threads must be greater than 0");
+    }
+
     // blockSize
     if (decompress == false) {
         CALQ_LOG("Block size: %d", blockSize);
@@ -81,6 +104,22 @@ void Options::validate(void) {
         }
     }
 
+    // codec
+    if (decompress == false) {
+        CALQ_LOG("Codec: %s", codec.c_str());
+        if (codec != "range" && codec != "rans0" && codec != "rans1") {
+            throwErrorException("Codec not supported");
+        }
+    }
+
+    // genotyper
+    if (decompress == false) {
+        CALQ_LOG("Genotyper: %s", genotyper.c_str());
+        if (genotyper != "float" && genotyper != "fixed") {
+            throwErrorException("Genotyper not supported");
+        }
+    }
+
     // polyploidy
     if (decompress == false) {
         CALQ_LOG("Polyploidy: %d", polyploidy);
@@ -152,6 +191,11 @@ void Options::validate(void) {
         }
     }
 
+    // streaming
+    if (decompress == false) {
+        CALQ_LOG("Streaming: %s", (streaming == true) ? "yes" : "no");
+    }
+
     // decompress
     if (decompress == false) {
         CALQ_LOG("Compressing");
@@ -165,11 +209,31 @@ void Options::validate(void) {
         if (sideInformationFileName.empty() == true) {
             throwErrorException("No side information file name provided");
         }
-        if (fileNameExtension(sideInformationFileName) != std::string("sam")) {
-            throwErrorException("Side information file name extension must be 'sam'");
+        if (sideInformationFileName == "-") {
+            CALQ_LOG("Reading side information from stdin");
+            if (inputFileName == "-") {
+                throwErrorException("Input and side information cannot both be read from stdin");
+            }
+        } else {
+            if (fileNameExtension(sideInformationFileName) != std::string("sam")
+                && fileNameExtension(sideInformationFileName) != std::string("bam")) {
+                throwErrorException("Side information file name extension must be 'sam' or 'bam'");
+            }
+            if (fileExists(sideInformationFileName) == false) {
+                throwErrorException("Cannot access side information file");
+            }
         }
-        if (fileExists(sideInformationFileName) == false) {
-            throwErrorException("Cannot access side information file");
+
+        // region
+        if (region.empty() == false) {
+            std::string rname("");
+            uint32_t start = 0;
+            uint32_t end = 0;
+            parseRegion(region, &rname, &start, &end);
+            CALQ_LOG("Region: %s:%u-%u", rname.c_str(), start, end);
+            if (inputFileName == "-") {
+                throwErrorException("Region decoding requires a seekable input file");
+            }
         }
     }
 }
@@ -22,16 +22,22 @@ struct Options {
     bool force;
     std::string inputFileName;
     std::string outputFileName;
+    int threads;
     // Options for only compression
     int blockSize;
+    std::string codec;  // entropy codec of the CQ streams
+    std::string genotyper;  // arithmetic of the genotyper
     int polyploidy;
     int qualityValueMax;
     int qualityValueMin;
     int qualityValueOffset;
     std::string qualityValueType;
     std::vector<std::string> referenceFileNames;
+    bool streaming;  // carry the pileup over block boundaries
     // Options for only decompression
     bool decompress;
+    bool samOutput;  // write the side information with the decoded QUAL
+    std::string region;  // decode only the records overlapping this region
     std::string sideInformationFileName;
 };
 
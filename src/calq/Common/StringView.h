@@ -0,0 +1,48 @@
+/** @file StringView.h
+ *  @brief This file contains the definition of the StringView class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_COMMON_STRINGVIEW_H_
+#define CALQ_COMMON_STRINGVIEW_H_
+
+#include <string.h>
+
+#include <string>
+
+namespace calq {
+
+// Non-owning view of a character sequence (pointer + length). The viewed
+// characters are not NUL-terminated and must outlive the view.
+class StringView {
+ public:
+    StringView(void) : data_(NULL), length_(0) {}
+    StringView(const char *data, const size_t &length) : data_(data), length_(length) {}
+
+    const char * data(void) const { return data_; }
+    size_t length(void) const { return length_; }
+    size_t size(void) const { return length_; }
+    bool empty(void) const { return (length_ == 0); }
+
+    const char & operator[](const size_t &i) const { return data_[i]; }
+    const char * begin(void) const { return data_; }
+    const char * end(void) const { return (data_ + length_); }
+
+    std::string str(void) const { return std::string(data_, length_); }
+
+    bool operator==(const StringView &other) const {
+        return ((length_ == other.length_) && (length_ == 0 || memcmp(data_, other.data_, length_) == 0));
+    }
+    bool operator!=(const StringView &other) const { return !(*this == other); }
+    bool operator==(const char *s) const { return (*this == StringView(s, strlen(s))); }
+    bool operator!=(const char *s) const { return !(*this == s); }
+
+ private:
+    const char *data_;
+    size_t length_;
+};
+
+}  // namespace calq
+
+#endif  // CALQ_COMMON_STRINGVIEW_H_
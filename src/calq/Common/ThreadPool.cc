@@ -0,0 +1,133 @@
+/** @file ThreadPool.cc
+ *  @brief This file contains the implementation of the ThreadPool class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include "Common/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "Common/Exceptions.h"
+
+namespace calq {
+
+// State shared by all threads working on one parallelFor() call
+struct ParallelForBatch {
+    ParallelForBatch(const size_t &n, const std::function<void(size_t)> &f)
+        : n(n), f(f), next(0), nrFinished(0), mutex(), condition(), exception() {}
+
+    const size_t n;
+    const std::function<void(size_t)> f;
+    std::atomic<size_t> next;
+    size_t nrFinished;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::exception_ptr exception;
+};
+
+static void runParallelForBatch(ParallelForBatch *batch) {
+    for (;;) {
+        size_t i = batch->next++;
+        if (i >= batch->n) {
+            return;
+        }
+
+        std::exception_ptr exception;
+        try {
+            batch->f(i);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        if (exception && !batch->exception) {
+            batch->exception = exception;
+        }
+        if (++batch->nrFinished == batch->n) {
+            batch->condition.notify_all();
+        }
+    }
+}
+
+ThreadPool::ThreadPool(const size_t &nrThreads)
+    : stop_(false),
+      mutex_(),
+      condition_(),
+      tasks_(),
+      threads_() {
+    if (nrThreads < 1) {
+        throwErrorException("nrThreads must be greater than zero");
+    }
+
+    for (size_t i = 0; i < nrThreads; ++i) {
+        threads_.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool(void) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::nrThreads(void) const {
+    return threads_.size();
+}
+
+void ThreadPool::parallelFor(const size_t &n, const std::function<void(size_t)> &f) {
+    if (n == 0) {
+        return;
+    }
+
+    // Helper tasks that start after all indices have been taken return
+    // immediately; the shared pointer keeps the batch alive for them
+    std::shared_ptr<ParallelForBatch> batch = std::make_shared<ParallelForBatch>(n, f);
+    size_t nrHelpers = std::min(n - 1, nrThreads());
+    for (size_t i = 0; i < nrHelpers; ++i) {
+        push([batch](void) { runParallelForBatch(batch.get()); });
+    }
+
+    runParallelForBatch(batch.get());
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->condition.wait(lock, [&batch](void) { return (batch->nrFinished == batch->n); });
+    if (batch->exception) {
+        std::rethrow_exception(batch->exception);
+    }
+}
+
+void ThreadPool::push(const std::function<void(void)> &task) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stop_ == true) {
+            throwErrorException("Thread pool is stopped");
+        }
+        tasks_.push(task);
+    }
+    condition_.notify_one();
+}
+
+void ThreadPool::work(void) {
+    for (;;) {
+        std::function<void(void)> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this](void) { return (stop_ == true || tasks_.empty() == false); });
+            if (stop_ == true && tasks_.empty() == true) {
+                return;
+            }
+            task = tasks_.front();
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+}  // namespace calq
@@ -0,0 +1,59 @@
+/** @file ThreadPool.h
+ *  @brief This file contains the definition of the ThreadPool class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_COMMON_THREADPOOL_H_
+#define CALQ_COMMON_THREADPOOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace calq {
+
+class ThreadPool {
+ public:
+    explicit ThreadPool(const size_t &nrThreads);
+    ~ThreadPool(void);
+
+    size_t nrThreads(void) const;
+
+    // Calls f(0), ..., f(n-1) concurrently and returns when all calls have
+    // finished. The calling thread takes part in the work, hence parallelFor()
+    // may also be called from within a task running on this pool. The first
+    // exception thrown by f is rethrown.
+    void parallelFor(const size_t &n, const std::function<void(size_t)> &f);
+
+    // Schedules f for execution on one of the worker threads; exceptions
+    // thrown by f are rethrown by the get() of the returned future
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> enqueue(F f) {
+        typedef typename std::result_of<F()>::type R;
+        std::shared_ptr< std::packaged_task<R()> > task = std::make_shared< std::packaged_task<R()> >(f);
+        std::future<R> result = task->get_future();
+        push([task](void) { (*task)(); });
+        return result;
+    }
+
+ private:
+    void push(const std::function<void(void)> &task);
+    void work(void);
+
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::queue< std::function<void(void)> > tasks_;
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace calq
+
+#endif  // CALQ_COMMON_THREADPOOL_H_
@@ -7,9 +7,11 @@
 
 #include "Common/helpers.h"
 
+#include <stdlib.h>
 #include <time.h>
 
 #include <fstream>
+#include <limits>
 
 #include "Common/Exceptions.h"
 #include "Common/os.h"
@@ -81,5 +83,56 @@ std::string removeFileNameExtension(const std::string &path) {
     return p > 0 && p != std::string::npos ? path.substr(0, p) : path;
 }
 
-}  // namespace calq
+// Parses a position of a region
+static uint32_t parseRegionPosition(const std::string &str) {
+    std::string digits("");
+    for (auto const &c : str) {
+        if (c != ',') {
+            digits += c;
+        }
+    }
+    if (digits.empty() == true || digits.find_first_not_of("0123456789") != std::string::npos) {
+        throwErrorException("Malformed region");
+    }
+    unsigned long long position = strtoull(digits.c_str(), NULL, 10);
+    if (position < 1 || position > std::numeric_limits<uint32_t>::max()) {
+        throwErrorException("Region position out of range");
+    }
+    return (uint32_t)position;
+}
+
+void parseRegion(const std::string &region, std::string *rname, uint32_t *start, uint32_t *end) {
+    if (region.empty() == true) {
+        throwErrorException("region is empty");
+    }
+    if (rname == NULL || start == NULL || end == NULL) {
+        throwErrorException("Received NULL as argument");
+    }
 
+    *start = 1;
+    *end = std::numeric_limits<uint32_t>::max();
+
+    std::string::size_type colon = region.find_last_of(':');
+    if (colon == std::string::npos) {
+        *rname = region;
+    } else {
+        *rname = region.substr(0, colon);
+        std::string range = region.substr(colon + 1);
+        std::string::size_type dash = range.find('-');
+        if (dash == std::string::npos) {
+            *start = parseRegionPosition(range);
+        } else {
+            *start = parseRegionPosition(range.substr(0, dash));
+            *end = parseRegionPosition(range.substr(dash + 1));
+        }
+    }
+
+    if (rname->empty() == true) {
+        throwErrorException("Malformed region");
+    }
+    if (*start > *end) {
+        throwErrorException("Region start is greater than region end");
+    }
+}
+
+}  // namespace calq
@@ -7,6 +7,8 @@
 #ifndef CALQ_COMMON_HELPERS_H_
 #define CALQ_COMMON_HELPERS_H_
 
+#include <inttypes.h>
+
 #include <string>
 
 namespace calq {
@@ -17,6 +19,10 @@ std::string fileBaseName(const std::string &path);
 std::string fileNameExtension(const std::string &path);
 std::string removeFileNameExtension(const std::string &path);
 
+// Parses a region given as 'rname', 'rname:start', or 'rname:start-end'
+// (1-based, inclusive; commas in the numbers are ignored)
+void parseRegion(const std::string &region, std::string *rname, uint32_t *start, uint32_t *end);
+
 }  // namespace calq
 
 #endif  // CALQ_COMMON_HELPERS_H_
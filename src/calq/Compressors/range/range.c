@@ -55,6 +55,7 @@
 #include "Common/os.h"
 #include <assert.h>
 #include <float.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -79,53 +80,6 @@ typedef struct {
     uc *out_buf;
 } rangecoder_t;
 
-double rangecoder_recip[65536];
-/* uint32_t rangecoder_recip2b[65536][2]; */
-uint32_t rangecoder_recip3[1<<(32-TF_SHIFT)];
-
-#ifdef OS_WINDOWS
-inline uint32_t i_log2(const uint32_t x)
-{
-    uint32_t log2Val = 0;
-    uint32_t y = x;
-    while (y >>= 1) log2Val++;
-    return log2Val;
-}
-#else
-static inline uint32_t i_log2(const uint32_t x) {
-    uint32_t y;
-    asm( "\tbsr %1, %0\n"
-       : "=r"(y)
-       : "r" (x)
-    );
-
-    /*or 31-__builtin_clz(x);*/
-
-    return y;
-}
-#endif
-
-void rangecoder_init(void)
-{
-    int i;
-    for (i = 0; i < 65536; i++)
-        rangecoder_recip[i] = (1.0+DBL_EPSILON)/i;
-}
-
-void rangecoder_init2(void)
-{
-    int i;
-    for (i = 1; i < (1<<(32-TF_SHIFT)); i++) {
-        /*double d = 1.0/i;
-        d *= ((uint64_t)1)<<32;
-        d *= ((uint64_t)1)<<32;
-        d += 255;
-        rangecoder_recip2b[i][0] = ((uint64_t)d)>>32;
-        rangecoder_recip2b[i][1] = (uint64_t)d;*/
-        rangecoder_recip3[i] = 1+((1LL<<31) * ((1LL<<(i_log2(i)+1)) - i)) / i;
-    }
-}
-
 static inline void rangecoder_input(rangecoder_t* rc, char* in)
 {
     rc->out_buf = rc->in_buf = (uc*)in;
@@ -198,31 +152,7 @@ static inline uint32_t rangecoder_getfreq(rangecoder_t* rc)
     /*fprintf(stderr, "%d / %d = %d\n", rc->code, (rc->range >> TF_SHIFT),
              rc->code / (rc->range >> TF_SHIFT));
     */
-    return rc->code / (rc->range >>= TF_SHIFT); /* 10.57 */
-    /*return rc->code * rangecoder_recip[rc->range >>= TF_SHIFT];*/ /* 10.99 */
-
-#if 1
-    /* 9.94 elapsed */
-    rc->range >>= TF_SHIFT;
-    uint32_t t = (rc->code * (uint64_t)rangecoder_recip3[rc->range]) >> 31;
-
-    return (((rc->code - t)>>1) + t) >> i_log2(rc->range);
-    /*return (rc->code + t) >> (1+i_log2(rc->range));*/
-#endif
-
-#if 0
-    /* Multiply 32-bit rc->code by 64-bit rangecoder_recip2[rc->range], which is
-     * split into two 32-bit registers r1, r2.
-     *
-     * Alas it's typically slower than the division, but keeping it here
-     * incase we get old systems that are slower dividing.
-     */
-    rc->range >>= TF_SHIFT;
-    uint64_t a  = rc->code;
-    uint64_t r1 = a * rangecoder_recip2b[rc->range][0];
-    uint64_t r2 = a * rangecoder_recip2b[rc->range][1];
-    return (r1 + (r2>>32)) >> 32;
-#endif
+    return rc->code / (rc->range >>= TF_SHIFT);
 }
 
 static inline void rangecoder_decode(rangecoder_t* rc,
@@ -492,41 +422,117 @@ unsigned char * range_decompress_o0(unsigned char *in,
     return (unsigned char*)out_buf;
 }
 
-unsigned char * range_compress_o1(unsigned char *in,
-                                  unsigned int  in_sz,
-                                  unsigned int  *out_sz)
+/*
+ * Order-1 codec context.
+ *
+ * Holds the frequency tables, the reverse lookup tables and the scratch
+ * buffers of the 8 interleaved encoders, so that they are allocated once and
+ * reused by subsequent calls. A context must only be used by one thread at a
+ * time.
+ */
+typedef struct {
+    int F;
+    int C;
+} range_fc_t;
+
+#define RANGE_SMALL_BUCKET_SHIFT 8
+#define RANGE_SMALL_BUCKETS (TOTFREQ>>RANGE_SMALL_BUCKET_SHIFT)
+
+struct range_ctx {
+    range_fc_t fc[256][256];  /* [context][symbol] */
+    unsigned char dirty[256]; /* rows of fc which are not all zero */
+    unsigned char* R[256];    /* reverse lookup tables, allocated on first use */
+    char* blk;                /* 8 encoder output buffers */
+    size_t blk_sz;            /* size of each of them */
+
+    /* Small alphabet codec, for k symbols */
+    range_fc_t sfc[256*512];  /* [context][symbol], k+1 columns rounded up to a power of 2 */
+    unsigned char sR[256][RANGE_SMALL_BUCKETS]; /* first symbol of each frequency bucket */
+};
+
+range_ctx * range_ctx_create(void)
+{
+    return (range_ctx *)calloc(1, sizeof(range_ctx));
+}
+
+void range_ctx_destroy(range_ctx *ctx)
+{
+    int i;
+
+    if (!ctx)
+        return;
+    for (i = 0; i < 256; i++)
+        free(ctx->R[i]);
+    free(ctx->blk);
+    free(ctx);
+}
+
+/* Makes the encoder output buffers at least blk_sz bytes large. */
+static int range_ctx_reserve(range_ctx *ctx, size_t blk_sz)
+{
+    if (ctx->blk_sz < blk_sz) {
+        free(ctx->blk);
+        ctx->blk = malloc(8 * blk_sz);
+        ctx->blk_sz = ctx->blk ? blk_sz : 0;
+    }
+    return ctx->blk != NULL;
+}
+
+/* Clears the rows of the frequency tables used by the previous call. */
+static void range_ctx_clear(range_ctx *ctx)
+{
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        if (ctx->dirty[i]) {
+            memset(ctx->fc[i], 0, sizeof(ctx->fc[i]));
+            ctx->dirty[i] = 0;
+        }
+    }
+}
+
+unsigned char * range_compress_o1_ctx(range_ctx           *ctx,
+                                      const unsigned char *in,
+                                      unsigned int        in_sz,
+                                      unsigned char       *out,
+                                      unsigned int        out_cap,
+                                      unsigned int        *out_sz)
 {
-    unsigned char* out_buf = malloc((size_t)(1.05*in_sz + 257*257*3 + 37));
+    unsigned char* out_buf = out;
+    unsigned char* out_end = out + out_cap;
     unsigned char* cp = out_buf;
     rangecoder_t rc[8];
     unsigned int last, i, j, i8[8], l8[8], i_end;
-    int F[256][256], C[256][256], T[256];
+    int T[256];
     unsigned char c;
-    char* blk = malloc(BLK_SIZE2*8+8);
+    range_fc_t (*FC)[256] = ctx->fc;
+    /* Every symbol makes an encoder emit at most 3 bytes, and flushing it
+     * emits 8 more; the last encoder also gets the remainder. */
+    size_t blk_sz = 3 * ((size_t)(in_sz>>3) + 8) + 8;
 
-    if (!blk || !out_buf) {
-        if (blk) free(blk);
-        if (out_buf) free(out_buf);
+    if (in_sz == 0 || out_cap < 4)
         return NULL;
-    }
+
+    if (!range_ctx_reserve(ctx, blk_sz))
+        return NULL;
+    blk_sz = ctx->blk_sz;
 
     cp = out_buf+4;
 
-    memset(F, 0, 256*256*sizeof(int));
-    memset(C, 0, 256*256*sizeof(int));
+    range_ctx_clear(ctx);
     memset(T, 0, 256*sizeof(int));
     for (last = i = 0; i < in_sz; i++) {
-        F[last][c = in[i]]++;
+        FC[last][c = in[i]].F++;
         T[last]++;
         last = c;
     }
-    F[0][in[1*(in_sz>>3)]]++;
-    F[0][in[2*(in_sz>>3)]]++;
-    F[0][in[3*(in_sz>>3)]]++;
-    F[0][in[4*(in_sz>>3)]]++;
-    F[0][in[5*(in_sz>>3)]]++;
-    F[0][in[6*(in_sz>>3)]]++;
-    F[0][in[7*(in_sz>>3)]]++;
+    FC[0][in[1*(in_sz>>3)]].F++;
+    FC[0][in[2*(in_sz>>3)]].F++;
+    FC[0][in[3*(in_sz>>3)]].F++;
+    FC[0][in[4*(in_sz>>3)]].F++;
+    FC[0][in[5*(in_sz>>3)]].F++;
+    FC[0][in[6*(in_sz>>3)]].F++;
+    FC[0][in[7*(in_sz>>3)]].F++;
     T[0]+=7;
 
     /* Normalise, so T[i] == 65536 */
@@ -535,17 +541,18 @@ unsigned char * range_compress_o1(unsigned char *in,
 
         if (t == 0)
             continue;
+        ctx->dirty[i] = 1;
 
         for (n = j = 0; j < 256; j++)
-            if (F[i][j])
+            if (FC[i][j].F)
                 n++;
 
         for (t2 = j = 0; j < 256; j++) {
-            if (!F[i][j])
+            if (!FC[i][j].F)
                 continue;
-            if ((F[i][j] *= ((double)TOTFREQ-n)/t) == 0)
-                F[i][j] = 1;
-            t2 += F[i][j];
+            if ((FC[i][j].F *= ((double)TOTFREQ-n)/t) == 0)
+                FC[i][j].F = 1;
+            t2 += FC[i][j].F;
         }
 
         /* No need to actually boost frequencies so the real sum is
@@ -557,18 +564,25 @@ unsigned char * range_compress_o1(unsigned char *in,
 
     /*assert(in_size < TOP);*/
     for (i = 0; i < 256; i++) {
-        unsigned int x = 0;
+        unsigned int x = 0, n = 0;
         if (!T[i])
             continue;
 
+        /* Context, its symbols and the terminators */
+        for (j = 0; j < 256; j++)
+            if (FC[i][j].F)
+                n++;
+        if ((size_t)(out_end - cp) < 1 + 3*(size_t)n + 2)
+            return NULL;
+
         *cp++ = i;
         for (j = 0; j < 256; j++) {
-            C[i][j] = x;
-            x += F[i][j];
-            if (F[i][j]) {
+            FC[i][j].C = x;
+            x += FC[i][j].F;
+            if (FC[i][j].F) {
                 *cp++ = j;
-                *cp++ = F[i][j]>>8;
-                *cp++ = F[i][j]&0xff;
+                *cp++ = FC[i][j].F>>8;
+                *cp++ = FC[i][j].F&0xff;
             }
         }
         *cp++ = 0;
@@ -577,14 +591,14 @@ unsigned char * range_compress_o1(unsigned char *in,
     *cp++ = 0;
 
     /* Initialise our 8 range coders with their appropriate buffers */
-    rangecoder_output(&rc[0], blk+0*BLK_SIZE2);
-    rangecoder_output(&rc[1], blk+1*BLK_SIZE2);
-    rangecoder_output(&rc[2], blk+2*BLK_SIZE2);
-    rangecoder_output(&rc[3], blk+3*BLK_SIZE2);
-    rangecoder_output(&rc[4], blk+4*BLK_SIZE2);
-    rangecoder_output(&rc[5], blk+5*BLK_SIZE2);
-    rangecoder_output(&rc[6], blk+6*BLK_SIZE2);
-    rangecoder_output(&rc[7], blk+7*BLK_SIZE2);
+    rangecoder_output(&rc[0], ctx->blk+0*blk_sz);
+    rangecoder_output(&rc[1], ctx->blk+1*blk_sz);
+    rangecoder_output(&rc[2], ctx->blk+2*blk_sz);
+    rangecoder_output(&rc[3], ctx->blk+3*blk_sz);
+    rangecoder_output(&rc[4], ctx->blk+4*blk_sz);
+    rangecoder_output(&rc[5], ctx->blk+5*blk_sz);
+    rangecoder_output(&rc[6], ctx->blk+6*blk_sz);
+    rangecoder_output(&rc[7], ctx->blk+7*blk_sz);
 
     rangecoder_start_encode(&rc[0]);
     rangecoder_start_encode(&rc[1]);
@@ -620,14 +634,14 @@ unsigned char * range_compress_o1(unsigned char *in,
         c[6] = in[i8[6]];
         c[7] = in[i8[7]];
 
-        rangecoder_encode(&rc[0], C[l8[0]][c[0]], F[l8[0]][c[0]]);
-        rangecoder_encode(&rc[1], C[l8[1]][c[1]], F[l8[1]][c[1]]);
-        rangecoder_encode(&rc[2], C[l8[2]][c[2]], F[l8[2]][c[2]]);
-        rangecoder_encode(&rc[3], C[l8[3]][c[3]], F[l8[3]][c[3]]);
-        rangecoder_encode(&rc[4], C[l8[4]][c[4]], F[l8[4]][c[4]]);
-        rangecoder_encode(&rc[5], C[l8[5]][c[5]], F[l8[5]][c[5]]);
-        rangecoder_encode(&rc[6], C[l8[6]][c[6]], F[l8[6]][c[6]]);
-        rangecoder_encode(&rc[7], C[l8[7]][c[7]], F[l8[7]][c[7]]);
+        rangecoder_encode(&rc[0], FC[l8[0]][c[0]].C, FC[l8[0]][c[0]].F);
+        rangecoder_encode(&rc[1], FC[l8[1]][c[1]].C, FC[l8[1]][c[1]].F);
+        rangecoder_encode(&rc[2], FC[l8[2]][c[2]].C, FC[l8[2]][c[2]].F);
+        rangecoder_encode(&rc[3], FC[l8[3]][c[3]].C, FC[l8[3]][c[3]].F);
+        rangecoder_encode(&rc[4], FC[l8[4]][c[4]].C, FC[l8[4]][c[4]].F);
+        rangecoder_encode(&rc[5], FC[l8[5]][c[5]].C, FC[l8[5]][c[5]].F);
+        rangecoder_encode(&rc[6], FC[l8[6]][c[6]].C, FC[l8[6]][c[6]].F);
+        rangecoder_encode(&rc[7], FC[l8[7]][c[7]].C, FC[l8[7]][c[7]].F);
 
         l8[0] = c[0];
         l8[1] = c[1];
@@ -643,7 +657,7 @@ unsigned char * range_compress_o1(unsigned char *in,
     for (; i8[7] < in_sz; i8[7]++) {
         unsigned char c;
         c = in[i8[7]];
-        rangecoder_encode(&rc[7], C[l8[7]][c], F[l8[7]][c]);
+        rangecoder_encode(&rc[7], FC[l8[7]][c].C, FC[l8[7]][c].F);
         l8[7] = c;
     }
 
@@ -657,62 +671,20 @@ unsigned char * range_compress_o1(unsigned char *in,
     rangecoder_finish_encode(&rc[6]);
     rangecoder_finish_encode(&rc[7]);
 
-    /* Move decoder output to the final compressed buffer. */
-    *cp++ = (rangecoder_size_out(&rc[0]) >> 0) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[0]) >> 8) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[0]) >>16) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[0]) >>24) & 0xff;
-    memcpy(cp, blk+0*BLK_SIZE2, rangecoder_size_out(&rc[0]));
-    cp += rangecoder_size_out(&rc[0]);
+    /* Move encoder output to the final compressed buffer. */
+    for (j = 0; j < 8; j++) {
+        unsigned int sz = (unsigned int)rangecoder_size_out(&rc[j]);
 
-    *cp++ = (rangecoder_size_out(&rc[1]) >> 0) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[1]) >> 8) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[1]) >>16) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[1]) >>24) & 0xff;
-    memcpy(cp, blk+1*BLK_SIZE2, rangecoder_size_out(&rc[1]));
-    cp += rangecoder_size_out(&rc[1]);
-
-    *cp++ = (rangecoder_size_out(&rc[2]) >> 0) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[2]) >> 8) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[2]) >>16) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[2]) >>24) & 0xff;
-    memcpy(cp, blk+2*BLK_SIZE2, rangecoder_size_out(&rc[2]));
-    cp += rangecoder_size_out(&rc[2]);
+        if ((size_t)(out_end - cp) < 4 + (size_t)sz)
+            return NULL;
 
-    *cp++ = (rangecoder_size_out(&rc[3]) >> 0) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[3]) >> 8) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[3]) >>16) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[3]) >>24) & 0xff;
-    memcpy(cp, blk+3*BLK_SIZE2, rangecoder_size_out(&rc[3]));
-    cp += rangecoder_size_out(&rc[3]);
-
-    *cp++ = (rangecoder_size_out(&rc[4]) >> 0) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[4]) >> 8) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[4]) >>16) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[4]) >>24) & 0xff;
-    memcpy(cp, blk+4*BLK_SIZE2, rangecoder_size_out(&rc[4]));
-    cp += rangecoder_size_out(&rc[4]);
-
-    *cp++ = (rangecoder_size_out(&rc[5]) >> 0) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[5]) >> 8) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[5]) >>16) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[5]) >>24) & 0xff;
-    memcpy(cp, blk+5*BLK_SIZE2, rangecoder_size_out(&rc[5]));
-    cp += rangecoder_size_out(&rc[5]);
-
-    *cp++ = (rangecoder_size_out(&rc[6]) >> 0) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[6]) >> 8) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[6]) >>16) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[6]) >>24) & 0xff;
-    memcpy(cp, blk+6*BLK_SIZE2, rangecoder_size_out(&rc[6]));
-    cp += rangecoder_size_out(&rc[6]);
-
-    *cp++ = (rangecoder_size_out(&rc[7]) >> 0) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[7]) >> 8) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[7]) >>16) & 0xff;
-    *cp++ = (rangecoder_size_out(&rc[7]) >>24) & 0xff;
-    memcpy(cp, blk+7*BLK_SIZE2, rangecoder_size_out(&rc[7]));
-    cp += rangecoder_size_out(&rc[7]);
+        *cp++ = (sz >> 0) & 0xff;
+        *cp++ = (sz >> 8) & 0xff;
+        *cp++ = (sz >>16) & 0xff;
+        *cp++ = (sz >>24) & 0xff;
+        memcpy(cp, ctx->blk+j*blk_sz, sz);
+        cp += sz;
+    }
 
     *out_sz = (unsigned)(cp - out_buf);
 
@@ -722,42 +694,96 @@ unsigned char * range_compress_o1(unsigned char *in,
     *cp++ = (in_sz>>16) & 0xff;
     *cp++ = (in_sz>>24) & 0xff;
 
-    free(blk);
     return out_buf;
 }
 
+unsigned char * range_compress_o1(unsigned char *in,
+                                  unsigned int  in_sz,
+                                  unsigned int  *out_sz)
+{
+    unsigned int out_cap = (unsigned int)(1.05*in_sz + 257*257*3 + 37);
+    unsigned char* out_buf = malloc(out_cap);
+    range_ctx* ctx = range_ctx_create();
+
+    if (!out_buf || !ctx || !range_compress_o1_ctx(ctx, in, in_sz, out_buf, out_cap, out_sz)) {
+        free(out_buf);
+        range_ctx_destroy(ctx);
+        return NULL;
+    }
+
+    range_ctx_destroy(ctx);
+    return out_buf;
+}
+
+unsigned int range_decompressed_size(const unsigned char *in)
+{
+    return ((unsigned int)in[0]<<0) | ((unsigned int)in[1]<<8) | ((unsigned int)in[2]<<16) | ((unsigned int)in[3]<<24);
+}
+
 unsigned char * range_decompress_o1(unsigned char *in,
                                     //unsigned int  in_sz,
                                     unsigned int  *out_sz)
+{
+    unsigned char* out_buf = malloc(range_decompressed_size(in));
+    if (!out_buf)
+        return NULL;
+
+    if (!range_decompress_o1_to(in, out_buf, out_sz)) {
+        free(out_buf);
+        return NULL;
+    }
+
+    return out_buf;
+}
+
+unsigned char * range_decompress_o1_to(unsigned char *in,
+                                       unsigned char *out,
+                                       unsigned int  *out_sz)
+{
+    range_ctx* ctx = range_ctx_create();
+    unsigned char* ret = NULL;
+
+    if (ctx)
+        ret = range_decompress_o1_ctx(ctx, in, out, out_sz);
+    range_ctx_destroy(ctx);
+
+    return ret;
+}
+
+unsigned char * range_decompress_o1_ctx(range_ctx           *ctx,
+                                        const unsigned char *in,
+                                        unsigned char       *out,
+                                        unsigned int        *out_sz)
 {
     /* Load in the static tables. */
-    unsigned char* cp = in + 4;
+    const unsigned char* cp = in + 4;
     int i, j, i_end, i8[8], l8[8], x, out_size;
     rangecoder_t rc[8];
-    char* out_buf;
-    range_decoder_t D[256];
+    char* out_buf = (char *)out;
+    range_fc_t (*FC)[256] = ctx->fc;
+    unsigned char** R = ctx->R;
     uint32_t sz;
 
-    memset(D, 0, 256*sizeof(*D));
-
     out_size = ((in[0])<<0) | ((in[1])<<8) | ((in[2])<<16) | ((in[3])<<24);
-    out_buf = malloc(out_size);
-    if (!out_buf)
-        return NULL;
+
+    range_ctx_clear(ctx);
 
     i = *cp++;
     do {
+        ctx->dirty[i] = 1;
+        if (!R[i] && !(R[i] = (unsigned char* )malloc(TOTFREQ)))
+            return NULL;
+
         j = *cp++;
         x = 0;
         do {
-            D[i].fc[j].F = (cp[0]<<8) | (cp[1]);
-            D[i].fc[j].C = x;
+            FC[i][j].F = (cp[0]<<8) | (cp[1]);
+            FC[i][j].C = x;
 
             /* Build reverse lookup table. */
-            if (!D[i].R) D[i].R = (unsigned char* )malloc(TOTFREQ);
-            memset(&D[i].R[x], j, D[i].fc[j].F);
+            memset(&R[i][x], j, FC[i][j].F);
 
-            x += D[i].fc[j].F;
+            x += FC[i][j].F;
             cp += 2;
             j = *cp++;
         } while(j);
@@ -834,23 +860,23 @@ unsigned char * range_decompress_o1(unsigned char *in,
         freq[6] = rangecoder_getfreq(&rc[6]);
         freq[7] = rangecoder_getfreq(&rc[7]);
 
-        c[0] = D[l8[0]].R[freq[0]];
-        c[1] = D[l8[1]].R[freq[1]];
-        c[2] = D[l8[2]].R[freq[2]];
-        c[3] = D[l8[3]].R[freq[3]];
-        c[4] = D[l8[4]].R[freq[4]];
-        c[5] = D[l8[5]].R[freq[5]];
-        c[6] = D[l8[6]].R[freq[6]];
-        c[7] = D[l8[7]].R[freq[7]];
-
-        rangecoder_decode(&rc[0], D[l8[0]].fc[c[0]].C, D[l8[0]].fc[c[0]].F);
-        rangecoder_decode(&rc[1], D[l8[1]].fc[c[1]].C, D[l8[1]].fc[c[1]].F);
-        rangecoder_decode(&rc[2], D[l8[2]].fc[c[2]].C, D[l8[2]].fc[c[2]].F);
-        rangecoder_decode(&rc[3], D[l8[3]].fc[c[3]].C, D[l8[3]].fc[c[3]].F);
-        rangecoder_decode(&rc[4], D[l8[4]].fc[c[4]].C, D[l8[4]].fc[c[4]].F);
-        rangecoder_decode(&rc[5], D[l8[5]].fc[c[5]].C, D[l8[5]].fc[c[5]].F);
-        rangecoder_decode(&rc[6], D[l8[6]].fc[c[6]].C, D[l8[6]].fc[c[6]].F);
-        rangecoder_decode(&rc[7], D[l8[7]].fc[c[7]].C, D[l8[7]].fc[c[7]].F);
+        c[0] = R[l8[0]][freq[0]];
+        c[1] = R[l8[1]][freq[1]];
+        c[2] = R[l8[2]][freq[2]];
+        c[3] = R[l8[3]][freq[3]];
+        c[4] = R[l8[4]][freq[4]];
+        c[5] = R[l8[5]][freq[5]];
+        c[6] = R[l8[6]][freq[6]];
+        c[7] = R[l8[7]][freq[7]];
+
+        rangecoder_decode(&rc[0], FC[l8[0]][c[0]].C, FC[l8[0]][c[0]].F);
+        rangecoder_decode(&rc[1], FC[l8[1]][c[1]].C, FC[l8[1]][c[1]].F);
+        rangecoder_decode(&rc[2], FC[l8[2]][c[2]].C, FC[l8[2]][c[2]].F);
+        rangecoder_decode(&rc[3], FC[l8[3]][c[3]].C, FC[l8[3]][c[3]].F);
+        rangecoder_decode(&rc[4], FC[l8[4]][c[4]].C, FC[l8[4]][c[4]].F);
+        rangecoder_decode(&rc[5], FC[l8[5]][c[5]].C, FC[l8[5]][c[5]].F);
+        rangecoder_decode(&rc[6], FC[l8[6]][c[6]].C, FC[l8[6]][c[6]].F);
+        rangecoder_decode(&rc[7], FC[l8[7]][c[7]].C, FC[l8[7]][c[7]].F);
 
         out_buf[i8[0]] = c[0];
         out_buf[i8[1]] = c[1];
@@ -874,9 +900,9 @@ unsigned char * range_decompress_o1(unsigned char *in,
     /* Remainder */
     for (; i8[7] < out_size; i8[7]++) {
         uint32_t freq = rangecoder_getfreq(&rc[7]);
-        unsigned char c = D[l8[7]].R[freq];
+        unsigned char c = R[l8[7]][freq];
 
-        rangecoder_decode(&rc[7], D[l8[7]].fc[c].C, D[l8[7]].fc[c].F);
+        rangecoder_decode(&rc[7], FC[l8[7]][c].C, FC[l8[7]][c].F);
         out_buf[i8[7]] = c;
         l8[7] = c;
     }
@@ -893,12 +919,301 @@ unsigned char * range_decompress_o1(unsigned char *in,
 
     *out_sz = out_size;
 
-    for (i = 0; i < 256; i++)
-        if (D[i].R) free(D[i].R);
-
     return (unsigned char*)out_buf;
 }
 
+/*
+ * Order-1 codec for small alphabets.
+ *
+ * The k distinct symbols of the input are mapped to the dense indices
+ * 0..k-1, so that the model has k x k instead of 256 x 256 frequencies, and
+ * it is serialized densely:
+ *
+ *   u32 in_sz, u8 k-1, the k symbols in increasing order, then for each
+ *   context a u8 flag whether it is used and, if so, the frequencies of its
+ *   k symbols (in 1 to 3 bytes each, see range_put_freq()); then the 8
+ *   streams as in range_compress_o1().
+ *
+ * Instead of a reverse lookup table of TOTFREQ bytes per context, the
+ * decoder looks up the first candidate symbol from the top 8 bits of the
+ * frequency and scans the (few) remaining ones.
+ */
+
+/* Rows of the small alphabet model have k+1 columns (the last one holds a
+ * sentinel), rounded up to a power of 2. */
+static unsigned int range_small_shift(unsigned int k)
+{
+    unsigned int shift = 0;
+    while ((1u<<shift) < k+1)
+        shift++;
+    return shift;
+}
+
+static unsigned char* range_put_freq(unsigned char* cp, unsigned int f)
+{
+    if (f < 0x80) {
+        *cp++ = f;
+    } else if (f < 0x4000) {
+        *cp++ = 0x80 | (f>>8);
+        *cp++ = f&0xff;
+    } else {
+        *cp++ = 0xc0 | (f>>16);
+        *cp++ = (f>>8)&0xff;
+        *cp++ = f&0xff;
+    }
+    return cp;
+}
+
+static const unsigned char* range_get_freq(const unsigned char* cp, int* f)
+{
+    if (cp[0] < 0x80) {
+        *f = cp[0];
+        return cp+1;
+    } else if (cp[0] < 0xc0) {
+        *f = ((cp[0]&0x3f)<<8) | cp[1];
+        return cp+2;
+    }
+    *f = ((cp[0]&0x3f)<<16) | (cp[1]<<8) | cp[2];
+    return cp+3;
+}
+
+unsigned char * range_compress_o1_small_ctx(range_ctx           *ctx,
+                                            const unsigned char *in,
+                                            unsigned int        in_sz,
+                                            unsigned char       *out,
+                                            unsigned int        out_cap,
+                                            unsigned int        *out_sz)
+{
+    unsigned char* out_end = out + out_cap;
+    unsigned char* cp = out;
+    unsigned char map[256], present[256];
+    rangecoder_t rc[8];
+    unsigned int last, i, j, k, n, shift, i8[8], l8[8], i_end;
+    int T[256];
+    range_fc_t* FC = ctx->sfc;
+    size_t blk_sz = 3 * ((size_t)(in_sz>>3) + 8) + 8;
+
+    if (in_sz == 0 || out_cap < 5)
+        return NULL;
+    if (!range_ctx_reserve(ctx, blk_sz))
+        return NULL;
+    blk_sz = ctx->blk_sz;
+
+    /* Dense symbol map */
+    memset(present, 0, sizeof(present));
+    for (i = 0; i < in_sz; i++)
+        present[in[i]] = 1;
+    for (k = j = 0; j < 256; j++)
+        if (present[j])
+            map[j] = k++;
+    if (out_cap < 5 + k)
+        return NULL;
+    cp = out+5;
+    for (j = 0; j < 256; j++)
+        if (present[j])
+            *cp++ = j;
+    out[4] = k-1;
+    shift = range_small_shift(k);
+
+    /* Statistics, with the segment starts in context 0 */
+    memset(FC, 0, (k<<shift)*sizeof(*FC));
+    memset(T, 0, k*sizeof(int));
+    for (last = i = 0; i < in_sz; i++) {
+        unsigned int c = map[in[i]];
+        FC[(last<<shift)+c].F++;
+        T[last]++;
+        last = c;
+    }
+    for (j = 1; j < 8; j++)
+        FC[map[in[j*(in_sz>>3)]]].F++;
+    T[0]+=7;
+
+    /* Normalise and encode the statistics */
+    for (i = 0; i < k; i++) {
+        range_fc_t* row = FC + (i<<shift);
+        int t = T[i];
+        unsigned int x = 0;
+
+        if ((size_t)(out_end - cp) < 1 + 3*(size_t)k)
+            return NULL;
+        *cp++ = (t != 0);
+        if (t == 0)
+            continue;
+
+        for (n = j = 0; j < k; j++)
+            if (row[j].F)
+                n++;
+
+        for (j = 0; j < k; j++) {
+            if (row[j].F && (row[j].F *= ((double)TOTFREQ-n)/t) == 0)
+                row[j].F = 1;
+            row[j].C = x;
+            x += row[j].F;
+            cp = range_put_freq(cp, row[j].F);
+        }
+        assert(x <= TOTFREQ);
+    }
+
+    for (j = 0; j < 8; j++) {
+        rangecoder_output(&rc[j], ctx->blk+j*blk_sz);
+        rangecoder_start_encode(&rc[j]);
+    }
+
+    i_end = (in_sz>>3);
+    for (j = 0; j < 8; j++) {
+        i8[j] = j * i_end;
+        l8[j] = 0;
+    }
+
+    /* Main busy loop, unrolled 8-ways. */
+#define RANGE_SMALL_ENCODE(j) do {                                      \
+        unsigned int c = map[in[i8[j]++]];                              \
+        rangecoder_encode(&rc[j], FC[l8[j]+c].C, FC[l8[j]+c].F);        \
+        l8[j] = c<<shift;                                               \
+    } while (0)
+    for (; i_end--; ) {
+        RANGE_SMALL_ENCODE(0);
+        RANGE_SMALL_ENCODE(1);
+        RANGE_SMALL_ENCODE(2);
+        RANGE_SMALL_ENCODE(3);
+        RANGE_SMALL_ENCODE(4);
+        RANGE_SMALL_ENCODE(5);
+        RANGE_SMALL_ENCODE(6);
+        RANGE_SMALL_ENCODE(7);
+    }
+#undef RANGE_SMALL_ENCODE
+
+    /* Remainder of buffer for when not a multiple of 8. */
+    for (; i8[7] < in_sz; i8[7]++) {
+        unsigned int c = map[in[i8[7]]];
+        rangecoder_encode(&rc[7], FC[l8[7]+c].C, FC[l8[7]+c].F);
+        l8[7] = c<<shift;
+    }
+
+    /* Flush encoders and move their output to the compressed buffer. */
+    for (j = 0; j < 8; j++) {
+        unsigned int sz;
+
+        rangecoder_finish_encode(&rc[j]);
+        sz = (unsigned int)rangecoder_size_out(&rc[j]);
+        if ((size_t)(out_end - cp) < 4 + (size_t)sz)
+            return NULL;
+
+        *cp++ = (sz >> 0) & 0xff;
+        *cp++ = (sz >> 8) & 0xff;
+        *cp++ = (sz >>16) & 0xff;
+        *cp++ = (sz >>24) & 0xff;
+        memcpy(cp, ctx->blk+j*blk_sz, sz);
+        cp += sz;
+    }
+
+    *out_sz = (unsigned)(cp - out);
+
+    out[0] = (in_sz>> 0) & 0xff;
+    out[1] = (in_sz>> 8) & 0xff;
+    out[2] = (in_sz>>16) & 0xff;
+    out[3] = (in_sz>>24) & 0xff;
+
+    return out;
+}
+
+unsigned char * range_decompress_o1_small_ctx(range_ctx           *ctx,
+                                              const unsigned char *in,
+                                              unsigned char       *out,
+                                              unsigned int        *out_sz)
+{
+    const unsigned char* cp = in + 4;
+    const unsigned char* syms;
+    unsigned int i, j, k, shift, i_end, i8[8], l8[8], out_size;
+    rangecoder_t rc[8];
+    range_fc_t* FC = ctx->sfc;
+
+    out_size = range_decompressed_size(in);
+
+    /* Symbols and statistics */
+    k = *cp++ + 1;
+    syms = cp;
+    cp += k;
+    shift = range_small_shift(k);
+    for (i = 0; i < k; i++) {
+        range_fc_t* row = FC + (i<<shift);
+        unsigned int x = 0, b;
+
+        if (*cp++) {
+            for (j = 0; j < k; j++) {
+                cp = range_get_freq(cp, &row[j].F);
+                row[j].C = x;
+                x += row[j].F;
+            }
+        } else {
+            memset(row, 0, k*sizeof(*row));
+        }
+        row[k].C = INT_MAX;
+
+        /* First symbol of each bucket of frequencies */
+        for (j = b = 0; b < RANGE_SMALL_BUCKETS; b++) {
+            while (j < k-1 && row[j+1].C <= (int)(b<<RANGE_SMALL_BUCKET_SHIFT))
+                j++;
+            ctx->sR[i][b] = j;
+        }
+    }
+
+    /* Start up the 8 parallel decoders. */
+    for (j = 0; j < 8; j++) {
+        uint32_t sz = cp[0] + (cp[1]<<8) + (cp[2]<<16) + (cp[3]<<24);
+        rangecoder_input(&rc[j], (char* )cp+4);
+        rangecoder_start_decode(&rc[j]);
+        cp += sz+4;
+    }
+
+    i_end = out_size>>3;
+    for (j = 0; j < 8; j++) {
+        i8[j] = j * i_end;
+        l8[j] = 0;
+    }
+
+    /* The main busy loop. Decode from 8 striped locations. */
+#define RANGE_SMALL_DECODE(j) do {                                      \
+        uint32_t freq = rangecoder_getfreq(&rc[j]);                     \
+        const range_fc_t* row = FC + (l8[j]<<shift);                    \
+        unsigned int c = ctx->sR[l8[j]][freq>>RANGE_SMALL_BUCKET_SHIFT];  \
+        while ((uint32_t)row[c+1].C <= freq)                            \
+            c++;                                                        \
+        rangecoder_decode(&rc[j], row[c].C, row[c].F);                  \
+        out[i8[j]++] = syms[c];                                         \
+        l8[j] = c;                                                      \
+    } while (0)
+    for (; i_end--; ) {
+        RANGE_SMALL_DECODE(0);
+        RANGE_SMALL_DECODE(1);
+        RANGE_SMALL_DECODE(2);
+        RANGE_SMALL_DECODE(3);
+        RANGE_SMALL_DECODE(4);
+        RANGE_SMALL_DECODE(5);
+        RANGE_SMALL_DECODE(6);
+        RANGE_SMALL_DECODE(7);
+    }
+#undef RANGE_SMALL_DECODE
+
+    /* Remainder */
+    for (; i8[7] < out_size; i8[7]++) {
+        uint32_t freq = rangecoder_getfreq(&rc[7]);
+        range_fc_t* row = FC + (l8[7]<<shift);
+        unsigned int c = ctx->sR[l8[7]][freq>>RANGE_SMALL_BUCKET_SHIFT];
+
+        while ((uint32_t)row[c+1].C <= freq)
+            c++;
+        rangecoder_decode(&rc[7], row[c].C, row[c].F);
+        out[i8[7]] = syms[c];
+        l8[7] = c;
+    }
+
+    *out_sz = out_size;
+
+    return out;
+}
+
+
 
 #else /* RANGECODEC_UNROLLED */
 /*
@@ -28,6 +28,53 @@ unsigned char * range_decompress_o1(unsigned char *in,
                                     //unsigned int  in_sz,
                                     unsigned int  *out_sz);
 
+/* Decompresses into the caller-provided buffer out, which must be able to
+ * hold range_decompressed_size(in) bytes. */
+unsigned char * range_decompress_o1_to(unsigned char *in,
+                                       unsigned char *out,
+                                       unsigned int  *out_sz);
+
+/* Size of the data compressed in in (stored in its first 4 bytes). */
+unsigned int range_decompressed_size(const unsigned char *in);
+
+/* Order-1 codec context owning the frequency tables and scratch buffers,
+ * which are reused by subsequent calls. A context may be used by only one
+ * thread at a time; use one context per thread. */
+typedef struct range_ctx range_ctx;
+
+range_ctx * range_ctx_create(void);
+void range_ctx_destroy(range_ctx *ctx);
+
+/* Compresses into the caller-provided buffer out of out_cap bytes. Returns
+ * NULL if the compressed data does not fit (or on allocation failure). */
+unsigned char * range_compress_o1_ctx(range_ctx           *ctx,
+                                      const unsigned char *in,
+                                      unsigned int        in_sz,
+                                      unsigned char       *out,
+                                      unsigned int        out_cap,
+                                      unsigned int        *out_sz);
+
+/* Like range_decompress_o1_to(), but with the tables of ctx. */
+unsigned char * range_decompress_o1_ctx(range_ctx           *ctx,
+                                        const unsigned char *in,
+                                        unsigned char       *out,
+                                        unsigned int        *out_sz);
+
+/* Order-1 codec whose model and its serialization scale with the number of
+ * distinct symbols k instead of the full byte alphabet; meant for small k,
+ * e.g. quantizer indices. Its output is not compatible with
+ * range_compress_o1(). */
+unsigned char * range_compress_o1_small_ctx(range_ctx           *ctx,
+                                            const unsigned char *in,
+                                            unsigned int        in_sz,
+                                            unsigned char       *out,
+                                            unsigned int        out_cap,
+                                            unsigned int        *out_sz);
+unsigned char * range_decompress_o1_small_ctx(range_ctx           *ctx,
+                                              const unsigned char *in,
+                                              unsigned char       *out,
+                                              unsigned int        *out_sz);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,697 @@
+/** @file rans.c
+ *  @brief This file contains the implementation of the static-model rANS
+ *         codec.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+/*
+ * Stream layout (all integers little-endian):
+ *
+ *   u8  order (0 or 1)
+ *   u32 number of symbols n
+ *   frequency table(s), if n > 0:
+ *     order-0: one table
+ *     order-1: u8 number of contexts - 1, then per context (in increasing
+ *              order) u8 context and its table
+ *     table:   u8 number of symbols - 1, then per symbol (in increasing
+ *              order) u8 symbol and u16 frequency; the frequencies add up
+ *              to RANS_TOTFREQ
+ *   u32 x 32 initial decoder states
+ *   u16 renormalization words, in the order in which the decoder reads them
+ *
+ * The decoder states are 32-bit values in [RANS_L, 2^31), renormalized 16
+ * bits at a time, so every decoded symbol reads at most one word.
+ *
+ * Order-0: symbol i is coded with state i % 32.
+ *
+ * Order-1: the symbols are split into 32 contiguous segments of n / 32
+ * symbols (the remaining n % 32 symbols are appended to the last segment),
+ * and segment j is coded with state j. The context of a symbol is the
+ * preceding symbol of its segment, or 0 for the first one. The decoder
+ * advances all 32 segments in lockstep.
+ */
+
+#include "rans.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RANS_X86
+#include <immintrin.h>
+#endif
+
+#define RANS_NR_STATES 32
+#define RANS_TF_SHIFT 12
+#define RANS_TOTFREQ (1u << RANS_TF_SHIFT)
+#define RANS_MASK (RANS_TOTFREQ - 1)
+#define RANS_L (1u << 15)
+#define RANS_HEADER_SIZE 5
+
+/* Largest possible size of the frequency tables */
+#define RANS_TABLE_BOUND (1 + 256 * 3)
+#define RANS_TABLES_BOUND_O1 (1 + 256 * (1 + RANS_TABLE_BOUND))
+
+static void put_u16(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t get_u16(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Encoder                                                                  */
+/* ------------------------------------------------------------------------ */
+
+/* Scales counts (adding up to total > 0) to frequencies adding up to
+ * RANS_TOTFREQ, keeping every present symbol at a frequency of at least 1 */
+static void normalize_freqs(const uint32_t *counts, uint32_t total, uint32_t *freqs)
+{
+    uint32_t sum = 0;
+    int max = -1;
+    int s;
+
+    for (s = 0; s < 256; s++) {
+        freqs[s] = 0;
+        if (counts[s] == 0)
+            continue;
+        freqs[s] = (uint32_t)(((uint64_t)counts[s] * RANS_TOTFREQ) / total);
+        if (freqs[s] == 0)
+            freqs[s] = 1;
+        sum += freqs[s];
+        if (max < 0 || counts[s] > counts[max])
+            max = s;
+    }
+
+    if (sum < RANS_TOTFREQ)
+        freqs[max] += RANS_TOTFREQ - sum;
+
+    /* Too many symbols were rounded up; take the excess from the largest */
+    while (sum > RANS_TOTFREQ) {
+        uint32_t dec;
+        max = 0;
+        for (s = 1; s < 256; s++) {
+            if (freqs[s] > freqs[max])
+                max = s;
+        }
+        dec = sum - RANS_TOTFREQ;
+        if (dec > freqs[max] - 1)
+            dec = freqs[max] - 1;
+        freqs[max] -= dec;
+        sum -= dec;
+    }
+}
+
+static unsigned char *write_table(unsigned char *cp, const uint32_t *freqs)
+{
+    int nr_symbols = 0;
+    int s;
+
+    for (s = 0; s < 256; s++)
+        nr_symbols += (freqs[s] != 0);
+    *cp++ = (unsigned char)(nr_symbols - 1);
+
+    for (s = 0; s < 256; s++) {
+        if (freqs[s] != 0) {
+            *cp++ = (unsigned char)s;
+            put_u16(cp, freqs[s]);
+            cp += 2;
+        }
+    }
+
+    return cp;
+}
+
+static void cumulative_freqs(const uint32_t *freqs, uint32_t *starts)
+{
+    uint32_t start = 0;
+    int s;
+
+    for (s = 0; s < 256; s++) {
+        starts[s] = start;
+        start += freqs[s];
+    }
+}
+
+/* Encodes one symbol into state r; the renormalization words are written
+ * backwards to *ptr */
+static inline void rans_encode(uint32_t *r, uint16_t **ptr, uint32_t freq, uint32_t start)
+{
+    uint32_t x = *r;
+    uint32_t x_max = ((RANS_L >> RANS_TF_SHIFT) << 16) * freq;
+
+    if (x >= x_max) {
+        *--(*ptr) = (uint16_t)x;
+        x >>= 16;
+    }
+    *r = ((x / freq) << RANS_TF_SHIFT) + (x % freq) + start;
+}
+
+/* Appends the final encoder states and the renormalization words */
+static unsigned char *finish(unsigned char *cp, const uint32_t *R, const uint16_t *ptr, const uint16_t *end)
+{
+    int j;
+
+    for (j = 0; j < RANS_NR_STATES; j++) {
+        put_u32(cp, R[j]);
+        cp += 4;
+    }
+    for (; ptr < end; ptr++) {
+        put_u16(cp, *ptr);
+        cp += 2;
+    }
+
+    return cp;
+}
+
+unsigned char * rans_compress_o0(const unsigned char *in,
+                                 unsigned int        in_sz,
+                                 unsigned int        *out_sz)
+{
+    uint32_t counts[256] = {0};
+    uint32_t freqs[256];
+    uint32_t starts[256];
+    uint32_t R[RANS_NR_STATES];
+    size_t bound = RANS_HEADER_SIZE + RANS_TABLE_BOUND + 4 * RANS_NR_STATES + 2 * (size_t)in_sz;
+    unsigned char *out = (unsigned char *)malloc(bound);
+    uint16_t *words = NULL;
+    uint16_t *ptr = NULL;
+    unsigned char *cp = NULL;
+    size_t i;
+    int j;
+
+    if (out == NULL)
+        return NULL;
+    out[0] = 0;
+    put_u32(out + 1, in_sz);
+    if (in_sz == 0) {
+        *out_sz = RANS_HEADER_SIZE;
+        return out;
+    }
+
+    /* Every symbol emits at most one word */
+    words = (uint16_t *)malloc((size_t)in_sz * sizeof(uint16_t));
+    if (words == NULL) {
+        free(out);
+        return NULL;
+    }
+
+    for (i = 0; i < in_sz; i++)
+        counts[in[i]]++;
+    normalize_freqs(counts, in_sz, freqs);
+    cumulative_freqs(freqs, starts);
+    cp = write_table(out + RANS_HEADER_SIZE, freqs);
+
+    for (j = 0; j < RANS_NR_STATES; j++)
+        R[j] = RANS_L;
+    ptr = words + in_sz;
+    for (i = in_sz; i-- > 0;)
+        rans_encode(&R[i % RANS_NR_STATES], &ptr, freqs[in[i]], starts[in[i]]);
+
+    cp = finish(cp, R, ptr, words + in_sz);
+    free(words);
+
+    *out_sz = (unsigned int)(cp - out);
+    return out;
+}
+
+unsigned char * rans_compress_o1(const unsigned char *in,
+                                 unsigned int        in_sz,
+                                 unsigned int        *out_sz)
+{
+    size_t bound = RANS_HEADER_SIZE + RANS_TABLES_BOUND_O1 + 4 * RANS_NR_STATES + 2 * (size_t)in_sz;
+    size_t seg_len = in_sz / RANS_NR_STATES;
+    unsigned char *out = (unsigned char *)malloc(bound);
+    uint32_t *counts = NULL;  /* [context][symbol], reused for the starts */
+    uint32_t *freqs = NULL;   /* [context][symbol] */
+    uint32_t totals[256] = {0};
+    uint32_t R[RANS_NR_STATES];
+    uint16_t *words = NULL;
+    uint16_t *ptr = NULL;
+    unsigned char *cp = NULL;
+    size_t i, k;
+    int c, j, nr_contexts = 0;
+
+    if (out == NULL)
+        return NULL;
+    out[0] = 1;
+    put_u32(out + 1, in_sz);
+    if (in_sz == 0) {
+        *out_sz = RANS_HEADER_SIZE;
+        return out;
+    }
+
+    counts = (uint32_t *)calloc(256 * 256, sizeof(uint32_t));
+    freqs = (uint32_t *)malloc(256 * 256 * sizeof(uint32_t));
+    words = (uint16_t *)malloc((size_t)in_sz * sizeof(uint16_t));
+    if (counts == NULL || freqs == NULL || words == NULL) {
+        free(counts);
+        free(freqs);
+        free(words);
+        free(out);
+        return NULL;
+    }
+
+    /* The first symbol of each segment has the context 0 */
+    for (i = 0; i < in_sz; i++) {
+        c = (i == 0 || (i < RANS_NR_STATES * seg_len && (i % seg_len) == 0)) ? 0 : in[i - 1];
+        counts[(c << 8) | in[i]]++;
+        totals[c]++;
+    }
+
+    for (c = 0; c < 256; c++)
+        nr_contexts += (totals[c] != 0);
+    cp = out + RANS_HEADER_SIZE;
+    *cp++ = (unsigned char)(nr_contexts - 1);
+    for (c = 0; c < 256; c++) {
+        if (totals[c] == 0)
+            continue;
+        normalize_freqs(counts + (c << 8), totals[c], freqs + (c << 8));
+        *cp++ = (unsigned char)c;
+        cp = write_table(cp, freqs + (c << 8));
+        cumulative_freqs(freqs + (c << 8), counts + (c << 8));
+    }
+
+    /* Encode in the reverse of the decoding order: the tail of the last
+     * segment first, then the segments backwards in lockstep */
+    for (j = 0; j < RANS_NR_STATES; j++)
+        R[j] = RANS_L;
+    ptr = words + in_sz;
+    for (i = in_sz; i-- > RANS_NR_STATES * seg_len;) {
+        size_t idx = ((size_t)(i > 0 ? in[i - 1] : 0) << 8) | in[i];
+        rans_encode(&R[RANS_NR_STATES - 1], &ptr, freqs[idx], counts[idx]);
+    }
+    for (k = seg_len; k-- > 0;) {
+        for (j = RANS_NR_STATES; j-- > 0;) {
+            size_t pos = (size_t)j * seg_len + k;
+            size_t idx = ((size_t)(k > 0 ? in[pos - 1] : 0) << 8) | in[pos];
+            rans_encode(&R[j], &ptr, freqs[idx], counts[idx]);
+        }
+    }
+
+    cp = finish(cp, R, ptr, words + in_sz);
+    free(counts);
+    free(freqs);
+    free(words);
+
+    *out_sz = (unsigned int)(cp - out);
+    return out;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Decoder                                                                  */
+/* ------------------------------------------------------------------------ */
+
+/* A decoding table maps each slot x % RANS_TOTFREQ to
+ *   symbol | (slot - start) << 8 | (freq - 1) << 20
+ * so that one lookup gives everything needed to advance the state */
+static const unsigned char *read_table(const unsigned char *cp, const unsigned char *end, uint32_t *D)
+{
+    uint32_t start = 0;
+    int prev = -1;
+    int nr_symbols, i;
+
+    if (cp >= end)
+        return NULL;
+    nr_symbols = *cp++ + 1;
+    if (end - cp < 3 * nr_symbols)
+        return NULL;
+
+    for (i = 0; i < nr_symbols; i++) {
+        uint32_t s = cp[0];
+        uint32_t f = get_u16(cp + 1);
+        uint32_t m;
+        cp += 3;
+        if ((int)s <= prev || f == 0 || start + f > RANS_TOTFREQ)
+            return NULL;
+        for (m = 0; m < f; m++)
+            D[start + m] = s | (m << 8) | ((f - 1) << 20);
+        start += f;
+        prev = (int)s;
+    }
+
+    return (start == RANS_TOTFREQ) ? cp : NULL;
+}
+
+/* Decodes one symbol from state *r with table D; returns -1 if the words
+ * are exhausted */
+static inline int rans_decode(uint32_t *r, const uint32_t *D, const unsigned char **wp, const unsigned char *wend)
+{
+    uint32_t x = *r;
+    uint32_t d = D[x & RANS_MASK];
+
+    x = ((d >> 20) + 1) * (x >> RANS_TF_SHIFT) + ((d >> 8) & RANS_MASK);
+    if (x < RANS_L) {
+        if (wend - *wp < 2)
+            return -1;
+        x = (x << 16) | get_u16(*wp);
+        *wp += 2;
+    }
+    *r = x;
+
+    return (int)(d & 0xff);
+}
+
+static int decode_o0_scalar(const uint32_t *D, uint32_t *R, const unsigned char **wp, const unsigned char *wend,
+                            unsigned char *out, size_t i, size_t n)
+{
+    for (; i < n; i++) {
+        int s = rans_decode(&R[i % RANS_NR_STATES], D, wp, wend);
+        if (s < 0)
+            return -1;
+        out[i] = (unsigned char)s;
+    }
+    return 0;
+}
+
+static int decode_o1_scalar(const uint32_t *D, const uint32_t *rows, uint32_t *R, unsigned char *ctx,
+                            const unsigned char **wp, const unsigned char *wend,
+                            unsigned char *out, size_t k, size_t seg_len, size_t n)
+{
+    size_t pos;
+    int j;
+
+    for (; k < seg_len; k++) {
+        for (j = 0; j < RANS_NR_STATES; j++) {
+            int s = rans_decode(&R[j], D + rows[ctx[j]], wp, wend);
+            if (s < 0)
+                return -1;
+            out[(size_t)j * seg_len + k] = (unsigned char)s;
+            ctx[j] = (unsigned char)s;
+        }
+    }
+
+    for (pos = RANS_NR_STATES * seg_len; pos < n; pos++) {
+        int s = rans_decode(&R[RANS_NR_STATES - 1], D + rows[ctx[RANS_NR_STATES - 1]], wp, wend);
+        if (s < 0)
+            return -1;
+        out[pos] = (unsigned char)s;
+        ctx[RANS_NR_STATES - 1] = (unsigned char)s;
+    }
+
+    return 0;
+}
+
+#ifdef RANS_X86
+
+/* For each mask of renormalizing lanes, the index of the word each lane
+ * takes from the next 8 words */
+static void build_renorm_permutations(uint32_t perm[256][8])
+{
+    int mask, lane;
+
+    for (mask = 0; mask < 256; mask++) {
+        uint32_t next = 0;
+        for (lane = 0; lane < 8; lane++) {
+            perm[mask][lane] = ((mask >> lane) & 1) ? next++ : 0;
+        }
+    }
+}
+
+/* Advances 8 states given their table entries d; returns the number of
+ * consumed words */
+__attribute__((target("avx2")))
+static inline __m256i decode8_avx2(__m256i x, __m256i d, const unsigned char *wp, uint32_t perm[256][8], int *nr_words)
+{
+    const __m256i mask = _mm256_set1_epi32(RANS_MASK);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i lower = _mm256_set1_epi32(RANS_L);
+    __m256i f = _mm256_add_epi32(_mm256_srli_epi32(d, 20), one);
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(d, 8), mask);
+    __m256i renorm, words;
+    int m;
+
+    x = _mm256_add_epi32(_mm256_mullo_epi32(f, _mm256_srli_epi32(x, RANS_TF_SHIFT)), b);
+
+    /* States are below 2^31, so the signed comparison is fine */
+    renorm = _mm256_cmpgt_epi32(lower, x);
+    m = _mm256_movemask_ps(_mm256_castsi256_ps(renorm));
+    words = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)wp));
+    words = _mm256_permutevar8x32_epi32(words, _mm256_loadu_si256((const __m256i *)perm[m]));
+    x = _mm256_blendv_epi8(x, _mm256_or_si256(_mm256_slli_epi32(x, 16), words), renorm);
+    *nr_words = __builtin_popcount((unsigned int)m);
+
+    return x;
+}
+
+/* Packs the low bytes of the 8 lanes of v into 8 bytes */
+__attribute__((target("avx2")))
+static inline __m128i pack_symbols_avx2(__m256i v)
+{
+    const __m256i shuffle = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    v = _mm256_shuffle_epi8(v, shuffle);
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+    return _mm256_castsi256_si128(v);
+}
+
+/* Decodes groups of 32 symbols while the words for a whole group are
+ * available (every symbol reads at most one word, and the 16-byte loads
+ * stay in bounds); returns the number of decoded symbols */
+__attribute__((target("avx2")))
+static size_t decode_o0_avx2(const uint32_t *D, uint32_t *R, const unsigned char **wpp, const unsigned char *wend,
+                             unsigned char *out, size_t n, uint32_t perm[256][8])
+{
+    const __m256i mask = _mm256_set1_epi32(RANS_MASK);
+    const unsigned char *wp = *wpp;
+    __m256i x[4];
+    size_t i = 0;
+    int g;
+
+    for (g = 0; g < 4; g++)
+        x[g] = _mm256_loadu_si256((const __m256i *)(R + 8 * g));
+
+    while (n - i >= RANS_NR_STATES && wend - wp >= 4 * RANS_NR_STATES) {
+        for (g = 0; g < 4; g++) {
+            __m256i d = _mm256_i32gather_epi32((const int *)D, _mm256_and_si256(x[g], mask), 4);
+            int nr_words = 0;
+            x[g] = decode8_avx2(x[g], d, wp, perm, &nr_words);
+            wp += 2 * nr_words;
+            _mm_storel_epi64((__m128i *)(out + i + 8 * g), pack_symbols_avx2(d));
+        }
+        i += RANS_NR_STATES;
+    }
+
+    for (g = 0; g < 4; g++)
+        _mm256_storeu_si256((__m256i *)(R + 8 * g), x[g]);
+    *wpp = wp;
+
+    return i;
+}
+
+/* Order-1 counterpart of decode_o0_avx2(); advances all segments by one
+ * symbol per step and returns the number of completed steps */
+__attribute__((target("avx2")))
+static size_t decode_o1_avx2(const uint32_t *D, const uint32_t *rows, uint32_t *R, unsigned char *ctx,
+                             const unsigned char **wpp, const unsigned char *wend,
+                             unsigned char *out, size_t seg_len, uint32_t perm[256][8])
+{
+    const __m256i mask = _mm256_set1_epi32(RANS_MASK);
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    uint32_t symbols[8];
+    const unsigned char *wp = *wpp;
+    __m256i x[4], c[4];
+    size_t k = 0;
+    int g, lane;
+
+    for (g = 0; g < 4; g++) {
+        x[g] = _mm256_loadu_si256((const __m256i *)(R + 8 * g));
+        c[g] = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(ctx + 8 * g)));
+    }
+
+    while (k < seg_len && wend - wp >= 4 * RANS_NR_STATES) {
+        for (g = 0; g < 4; g++) {
+            __m256i row = _mm256_i32gather_epi32((const int *)rows, c[g], 4);
+            __m256i d = _mm256_i32gather_epi32((const int *)D, _mm256_add_epi32(row, _mm256_and_si256(x[g], mask)), 4);
+            int nr_words = 0;
+            x[g] = decode8_avx2(x[g], d, wp, perm, &nr_words);
+            wp += 2 * nr_words;
+            c[g] = _mm256_and_si256(d, low_byte);
+            _mm256_storeu_si256((__m256i *)symbols, c[g]);
+            for (lane = 0; lane < 8; lane++)
+                out[(size_t)(8 * g + lane) * seg_len + k] = (unsigned char)symbols[lane];
+        }
+        k++;
+    }
+
+    for (g = 0; g < 4; g++) {
+        _mm256_storeu_si256((__m256i *)(R + 8 * g), x[g]);
+        _mm_storel_epi64((__m128i *)(ctx + 8 * g), pack_symbols_avx2(c[g]));
+    }
+    *wpp = wp;
+
+    return k;
+}
+
+#endif  /* RANS_X86 */
+
+unsigned int rans_decompressed_size(const unsigned char *in,
+                                    unsigned int        in_sz)
+{
+    if (in_sz < RANS_HEADER_SIZE)
+        return 0;
+    return get_u32(in + 1);
+}
+
+struct rans_ctx {
+    uint32_t *D;          /* decoding tables, RANS_TOTFREQ entries each */
+    size_t nr_tables;     /* number of tables D can hold */
+#ifdef RANS_X86
+    uint32_t perm[256][8];
+#endif
+};
+
+rans_ctx * rans_ctx_create(void)
+{
+    rans_ctx *ctx = (rans_ctx *)calloc(1, sizeof(rans_ctx));
+
+#ifdef RANS_X86
+    if (ctx)
+        build_renorm_permutations(ctx->perm);
+#endif
+    return ctx;
+}
+
+void rans_ctx_destroy(rans_ctx *ctx)
+{
+    if (!ctx)
+        return;
+    free(ctx->D);
+    free(ctx);
+}
+
+/* Makes the decoding tables of ctx hold at least nr_tables tables. */
+static int rans_ctx_reserve(rans_ctx *ctx, size_t nr_tables)
+{
+    uint32_t *D;
+
+    if (ctx->nr_tables >= nr_tables)
+        return 1;
+    D = (uint32_t *)malloc(nr_tables * RANS_TOTFREQ * sizeof(uint32_t));
+    if (D == NULL)
+        return 0;
+    free(ctx->D);
+    ctx->D = D;
+    ctx->nr_tables = nr_tables;
+    return 1;
+}
+
+unsigned char * rans_decompress_to(const unsigned char *in,
+                                   unsigned int        in_sz,
+                                   unsigned char       *out,
+                                   unsigned int        *out_sz)
+{
+    rans_ctx *ctx = rans_ctx_create();
+    unsigned char *ret = NULL;
+
+    if (ctx)
+        ret = rans_decompress_to_ctx(ctx, in, in_sz, out, out_sz);
+    rans_ctx_destroy(ctx);
+    return ret;
+}
+
+unsigned char * rans_decompress_to_ctx(rans_ctx            *ctx,
+                                       const unsigned char *in,
+                                       unsigned int        in_sz,
+                                       unsigned char       *out,
+                                       unsigned int        *out_sz)
+{
+    const unsigned char *end = in + in_sz;
+    const unsigned char *cp = in + RANS_HEADER_SIZE;
+    const unsigned char *wp = NULL;
+    uint32_t rows[256] = {0};  /* offset of the table of each context in D */
+    uint32_t R[RANS_NR_STATES];
+    unsigned char symbol_ctx[RANS_NR_STATES] = {0};  /* preceding symbols */
+    uint32_t *D = NULL;
+    size_t n, seg_len, done = 0;
+    int order, ret, j;
+
+    if (in_sz < RANS_HEADER_SIZE)
+        return NULL;
+    order = in[0];
+    n = get_u32(in + 1);
+    if (order > 1)
+        return NULL;
+    if (n == 0) {
+        *out_sz = 0;
+        return (in_sz == RANS_HEADER_SIZE) ? out : NULL;
+    }
+
+    if (order == 0) {
+        if (!rans_ctx_reserve(ctx, 1))
+            return NULL;
+        D = ctx->D;
+        cp = read_table(cp, end, D);
+    } else {
+        int nr_contexts, c, prev = -1;
+        if (cp >= end)
+            return NULL;
+        nr_contexts = *cp++ + 1;
+        if (!rans_ctx_reserve(ctx, (size_t)nr_contexts))
+            return NULL;
+        D = ctx->D;
+        for (c = 0; c < nr_contexts && cp != NULL; c++) {
+            if (cp >= end || (int)*cp <= prev) {
+                cp = NULL;
+                break;
+            }
+            prev = *cp++;
+            rows[prev] = (uint32_t)c * RANS_TOTFREQ;
+            cp = read_table(cp, end, D + (size_t)c * RANS_TOTFREQ);
+        }
+    }
+    if (cp == NULL || end - cp < 4 * RANS_NR_STATES)
+        return NULL;
+
+    for (j = 0; j < RANS_NR_STATES; j++) {
+        R[j] = get_u32(cp + 4 * j);
+        if (R[j] < RANS_L || R[j] >= (1u << 31))
+            return NULL;
+    }
+    wp = cp + 4 * RANS_NR_STATES;
+
+    seg_len = n / RANS_NR_STATES;
+    if (order == 0) {
+#ifdef RANS_X86
+        if (n >= RANS_NR_STATES && __builtin_cpu_supports("avx2"))
+            done = decode_o0_avx2(D, R, &wp, end, out, n, ctx->perm);
+#endif
+        ret = decode_o0_scalar(D, R, &wp, end, out, done, n);
+    } else {
+#ifdef RANS_X86
+        if (seg_len > 0 && __builtin_cpu_supports("avx2"))
+            done = decode_o1_avx2(D, rows, R, symbol_ctx, &wp, end, out, seg_len, ctx->perm);
+#endif
+        ret = decode_o1_scalar(D, rows, R, symbol_ctx, &wp, end, out, done, seg_len, n);
+    }
+
+    /* Decoding must end in the initial encoder states with all words read */
+    if (ret != 0 || wp != end)
+        return NULL;
+    for (j = 0; j < RANS_NR_STATES; j++) {
+        if (R[j] != RANS_L)
+            return NULL;
+    }
+
+    *out_sz = (unsigned int)n;
+    return out;
+}
@@ -0,0 +1,63 @@
+/** @file rans.h
+ *  @brief This file contains the interface to the static-model rANS codec.
+ *
+ *  The symbols are coded with 32 interleaved rANS states, which allows the
+ *  decoder to process many symbols per step (with AVX2 where available).
+ *  The order-0 coder uses one frequency table for all symbols; the order-1
+ *  coder uses one table per preceding symbol.
+ *
+ *  Unlike the range codec, the decoder is given the size of its input and
+ *  does not read beyond it.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef RANS_H_
+#define RANS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Compress in_sz bytes from in; the returned buffer (of *out_sz bytes) must
+ * be freed by the caller. Returns NULL on allocation failure. */
+unsigned char * rans_compress_o0(const unsigned char *in,
+                                 unsigned int        in_sz,
+                                 unsigned int        *out_sz);
+unsigned char * rans_compress_o1(const unsigned char *in,
+                                 unsigned int        in_sz,
+                                 unsigned int        *out_sz);
+
+/* Decompresses (either order) into the caller-provided buffer out, which
+ * must be able to hold rans_decompressed_size(in) bytes. Returns NULL if
+ * the input is malformed. */
+unsigned char * rans_decompress_to(const unsigned char *in,
+                                   unsigned int        in_sz,
+                                   unsigned char       *out,
+                                   unsigned int        *out_sz);
+
+/* Decoder context owning the decoding tables, which are reused by
+ * subsequent calls. A context may be used by only one thread at a time; use
+ * one context per thread. */
+typedef struct rans_ctx rans_ctx;
+
+rans_ctx * rans_ctx_create(void);
+void rans_ctx_destroy(rans_ctx *ctx);
+
+/* Like rans_decompress_to(), but with the tables of ctx. */
+unsigned char * rans_decompress_to_ctx(rans_ctx            *ctx,
+                                       const unsigned char *in,
+                                       unsigned int        in_sz,
+                                       unsigned char       *out,
+                                       unsigned int        *out_sz);
+
+/* Size of the data compressed in in (stored in its first 5 bytes), or 0 if
+ * in_sz is too small to hold the header. */
+unsigned int rans_decompressed_size(const unsigned char *in,
+                                    unsigned int        in_sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RANS_H_
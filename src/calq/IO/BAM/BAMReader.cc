@@ -0,0 +1,383 @@
+/** @file BAMReader.cc
+ *  @brief This file contains the implementation of the BAMReader class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include "IO/BAM/BAMReader.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "Common/Exceptions.h"
+
+namespace calq {
+
+static const char *CIGAR_OPS = "MIDNSHP=X";
+static const char *SEQ_NT16 = "=ACMGRSVTWYHKDBN";
+
+static uint32_t littleEndianU32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t littleEndianU16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Size in bytes of a value of the given aux/B-array type
+static size_t auxTypeSize(const char &type) {
+    switch (type) {
+    case 'A': case 'c': case 'C': return 1;
+    case 's': case 'S': return 2;
+    case 'i': case 'I': case 'f': return 4;
+    default: throwErrorException("Corrupted BAM record (unknown aux type)");
+    }
+    return 0;
+}
+
+// Appends the SAM text of the numeric value of the given type at p
+static void appendAuxValue(std::string *line, const char &type, const unsigned char *p) {
+    char tmp[32];
+    switch (type) {
+    case 'c': *line += std::to_string((int8_t)p[0]); break;
+    case 'C': *line += std::to_string((uint8_t)p[0]); break;
+    case 's': *line += std::to_string((int16_t)littleEndianU16(p)); break;
+    case 'S': *line += std::to_string(littleEndianU16(p)); break;
+    case 'i': *line += std::to_string((int32_t)littleEndianU32(p)); break;
+    case 'I': *line += std::to_string(littleEndianU32(p)); break;
+    case 'f': {
+        uint32_t bits = littleEndianU32(p);
+        float f = 0;
+        memcpy(&f, &bits, sizeof(f));
+        snprintf(tmp, sizeof(tmp), "%g", f);
+        *line += tmp;
+        break;
+    }
+    default: throwErrorException("Corrupted BAM record (unknown aux type)");
+    }
+}
+
+BAMReader::BAMReader(FILE *fp)
+    : bgzfReader_(fp),
+      referenceNames_(),
+      record_(""),
+      hasUnreadRecord_(false),
+      refID_(-1),
+      pos_(-1),
+      mapq_(0),
+      flag_(0),
+      nextRefID_(-1),
+      nextPos_(-1),
+      tlen_(0),
+      nrCigarOps_(0),
+      seqLength_(0),
+      readName_(NULL),
+      readNameLength_(0),
+      cigar_(NULL),
+      seq_(NULL),
+      qual_(NULL),
+      aux_(NULL),
+      end_(NULL),
+      cigarOps_() {}
+
+BAMReader::~BAMReader(void) {}
+
+void BAMReader::setThreadPool(ThreadPool *threadPool) {
+    bgzfReader_.setThreadPool(threadPool);
+}
+
+void BAMReader::readHeader(std::string *header) {
+    char magic[4];
+    readExactly(magic, sizeof(magic));
+    if (memcmp(magic, "BAM\1", sizeof(magic)) != 0) {
+        throwErrorException("BAM magic does not match");
+    }
+
+    // SAM header text (possibly NUL-padded)
+    int32_t textLength = readInt32();
+    if (textLength < 0) {
+        throwErrorException("Corrupted BAM header");
+    }
+    std::string text((size_t)textLength, '\0');
+    if (textLength > 0) {
+        readExactly(&text[0], text.size());
+    }
+    text.resize(strnlen(text.data(), text.size()));
+    if (text.empty() == false && text[text.size()-1] != '\n') {
+        text += "\n";
+    }
+    *header = text;
+
+    // Reference sequence names
+    int32_t nrReferences = readInt32();
+    if (nrReferences < 0) {
+        throwErrorException("Corrupted BAM header");
+    }
+    referenceNames_.clear();
+    for (int32_t i = 0; i < nrReferences; i++) {
+        int32_t nameLength = readInt32();
+        if (nameLength < 1) {
+            throwErrorException("Corrupted BAM header");
+        }
+        std::string name((size_t)nameLength, '\0');
+        readExactly(&name[0], name.size());
+        name.resize(strnlen(name.data(), name.size()));
+        referenceNames_.push_back(name);
+        readInt32();  // reference sequence length
+    }
+}
+
+bool BAMReader::readRecord(std::string *line) {
+    if (nextRecord() == false) {
+        return false;
+    }
+
+    line->clear();
+
+    // QNAME, FLAG, RNAME, POS, MAPQ
+    line->append((const char *)readName_, readNameLength_);
+    *line += '\t';
+    *line += std::to_string(flag_);
+    *line += '\t';
+    *line += (refID_ < 0) ? std::string("*") : referenceNames_[refID_];
+    *line += '\t';
+    *line += std::to_string(pos_ + 1);
+    *line += '\t';
+    *line += std::to_string(mapq_);
+    *line += '\t';
+
+    // CIGAR
+    if (nrCigarOps_ == 0) {
+        *line += '*';
+    }
+    for (size_t i = 0; i < nrCigarOps_; i++) {
+        uint32_t op = littleEndianU32(cigar_ + 4 * i);
+        if ((op & 0xf) > 8) {
+            throwErrorException("Corrupted BAM record (bad CIGAR operation)");
+        }
+        *line += std::to_string(op >> 4);
+        *line += CIGAR_OPS[op & 0xf];
+    }
+    *line += '\t';
+
+    // RNEXT, PNEXT, TLEN
+    if (nextRefID_ < 0) {
+        *line += '*';
+    } else if (nextRefID_ == refID_) {
+        *line += '=';
+    } else {
+        *line += referenceNames_[nextRefID_];
+    }
+    *line += '\t';
+    *line += std::to_string(nextPos_ + 1);
+    *line += '\t';
+    *line += std::to_string(tlen_);
+    *line += '\t';
+
+    // SEQ, QUAL
+    if (seqLength_ == 0) {
+        *line += "*\t*";
+    } else {
+        size_t seqOffset = line->size();
+        line->resize(seqOffset + seqLength_);
+        for (size_t i = 0; i < seqLength_; i++) {
+            (*line)[seqOffset + i] = SEQ_NT16[(seq_[i/2] >> ((~i & 1) << 2)) & 0xf];
+        }
+        *line += '\t';
+        if (qual_[0] == 0xff) {
+            *line += '*';
+        } else {
+            size_t qualOffset = line->size();
+            line->resize(qualOffset + seqLength_);
+            for (size_t i = 0; i < seqLength_; i++) {
+                (*line)[qualOffset + i] = (char)(qual_[i] + 33);
+            }
+        }
+    }
+
+    // Optional fields
+    const unsigned char *p = aux_;
+    const unsigned char *end = end_;
+    while (p < end) {
+        if ((p + 3) > end) {
+            throwErrorException("Corrupted BAM record (truncated aux field)");
+        }
+        char type = (char)p[2];
+        *line += '\t';
+        line->append((const char *)p, 2);
+        p += 3;
+
+        if (type == 'Z' || type == 'H') {
+            const unsigned char *nul = (const unsigned char *)memchr(p, '\0', end - p);
+            if (nul == NULL) {
+                throwErrorException("Corrupted BAM record (unterminated aux string)");
+            }
+            *line += ':';
+            *line += type;
+            *line += ':';
+            line->append((const char *)p, nul - p);
+            p = nul + 1;
+        } else if (type == 'B') {
+            if ((p + 5) > end) {
+                throwErrorException("Corrupted BAM record (truncated aux field)");
+            }
+            char subtype = (char)p[0];
+            uint32_t count = littleEndianU32(p + 1);
+            size_t size = auxTypeSize(subtype);
+            p += 5;
+            if ((size_t)(end - p) < (size_t)count * size) {
+                throwErrorException("Corrupted BAM record (truncated aux field)");
+            }
+            *line += ":B:";
+            *line += subtype;
+            for (uint32_t i = 0; i < count; i++) {
+                *line += ',';
+                appendAuxValue(line, subtype, p);
+                p += size;
+            }
+        } else {
+            size_t size = auxTypeSize(type);
+            if ((size_t)(end - p) < size) {
+                throwErrorException("Corrupted BAM record (truncated aux field)");
+            }
+            if (type == 'A') {
+                *line += ":A:";
+                *line += (char)p[0];
+            } else {
+                *line += (type == 'f') ? ":f:" : ":i:";
+                appendAuxValue(line, type, p);
+            }
+            p += size;
+        }
+    }
+
+    return true;
+}
+
+bool BAMReader::readRecord(SAMRecord *samRecord, SAMBlock *samBlock) {
+    if (nextRecord() == false) {
+        return false;
+    }
+
+    cigarOps_.resize(nrCigarOps_);
+    for (size_t i = 0; i < nrCigarOps_; i++) {
+        cigarOps_[i] = littleEndianU32(cigar_ + 4 * i);
+        if ((cigarOps_[i] & 0xf) > 8) {
+            throwErrorException("Corrupted BAM record (bad CIGAR operation)");
+        }
+    }
+
+    // QNAME, SEQ and QUAL in one piece of block memory; a missing SEQ or
+    // QUAL becomes "*"
+    bool hasQual = (seqLength_ > 0 && qual_[0] != 0xff);
+    size_t seqLength = (seqLength_ == 0) ? 1 : seqLength_;
+    size_t qualLength = (hasQual == true) ? seqLength_ : 1;
+    char *qname = samBlock->allocate(readNameLength_ + seqLength + qualLength);
+    char *seq = qname + readNameLength_;
+    char *qual = seq + seqLength;
+    memcpy(qname, readName_, readNameLength_);
+    if (seqLength_ == 0) {
+        seq[0] = '*';
+    } else {
+        for (size_t i = 0; i < seqLength_; i++) {
+            seq[i] = SEQ_NT16[(seq_[i/2] >> ((~i & 1) << 2)) & 0xf];
+        }
+    }
+    if (hasQual == true) {
+        for (size_t i = 0; i < seqLength_; i++) {
+            qual[i] = (char)(qual_[i] + 33);
+        }
+    } else {
+        qual[0] = '*';
+    }
+
+    StringView rname("*", 1);
+    if (refID_ >= 0) {
+        rname = StringView(referenceNames_[refID_].data(), referenceNames_[refID_].length());
+    }
+
+    *samRecord = SAMRecord(StringView(qname, readNameLength_),
+                           flag_,
+                           rname,
+                           (uint32_t)(pos_ + 1),
+                           mapq_,
+                           (cigarOps_.empty() == true) ? NULL : &cigarOps_[0],
+                           cigarOps_.size(),
+                           StringView(seq, seqLength),
+                           StringView(qual, qualLength));
+    return true;
+}
+
+void BAMReader::unreadRecord(void) {
+    if (hasUnreadRecord_ == true) {
+        throwErrorException("Only one record can be pushed back");
+    }
+    hasUnreadRecord_ = true;
+}
+
+// Reads the next record into record_ and parses its fixed-length fields
+bool BAMReader::nextRecord(void) {
+    if (hasUnreadRecord_ == true) {
+        hasUnreadRecord_ = false;
+        return true;
+    }
+
+    uint32_t blockSize = 0;
+    if (bgzfReader_.read(&blockSize, sizeof(blockSize)) == false) {
+        return false;
+    }
+    blockSize = littleEndianU32((const unsigned char *)&blockSize);
+    if (blockSize < 32) {
+        throwErrorException("Corrupted BAM record");
+    }
+    record_.resize(blockSize);
+    readExactly(&record_[0], blockSize);
+
+    const unsigned char *r = (const unsigned char *)record_.data();
+    refID_ = (int32_t)littleEndianU32(r);
+    pos_ = (int32_t)littleEndianU32(r + 4);
+    uint8_t readNameLength = r[8];
+    mapq_ = r[9];
+    nrCigarOps_ = littleEndianU16(r + 12);
+    flag_ = littleEndianU16(r + 14);
+    int32_t seqLength = (int32_t)littleEndianU32(r + 16);
+    nextRefID_ = (int32_t)littleEndianU32(r + 20);
+    nextPos_ = (int32_t)littleEndianU32(r + 24);
+    tlen_ = (int32_t)littleEndianU32(r + 28);
+    if (seqLength < 0 || readNameLength < 1) {
+        throwErrorException("Corrupted BAM record");
+    }
+    seqLength_ = (size_t)seqLength;
+
+    readName_ = r + 32;
+    cigar_ = readName_ + readNameLength;
+    seq_ = cigar_ + 4 * nrCigarOps_;
+    qual_ = seq_ + (seqLength_ + 1) / 2;
+    aux_ = qual_ + seqLength_;
+    end_ = r + blockSize;
+    if (aux_ > end_) {
+        throwErrorException("Corrupted BAM record");
+    }
+    if ((refID_ >= 0 && (size_t)refID_ >= referenceNames_.size())
+        || (nextRefID_ >= 0 && (size_t)nextRefID_ >= referenceNames_.size())) {
+        throwErrorException("Corrupted BAM record (reference ID out of range)");
+    }
+    readNameLength_ = strnlen((const char *)readName_, readNameLength);
+
+    return true;
+}
+
+void BAMReader::readExactly(void *buffer, const size_t &size) {
+    if (bgzfReader_.read(buffer, size) == false) {
+        throwErrorException("Truncated BAM file");
+    }
+}
+
+int32_t BAMReader::readInt32(void) {
+    unsigned char buffer[4];
+    readExactly(buffer, sizeof(buffer));
+    return (int32_t)littleEndianU32(buffer);
+}
+
+}  // namespace calq
@@ -0,0 +1,80 @@
+/** @file BAMReader.h
+ *  @brief This file contains the definition of the BAMReader class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_IO_BAM_BAMREADER_H_
+#define CALQ_IO_BAM_BAMREADER_H_
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "Common/ThreadPool.h"
+#include "IO/BAM/BGZFReader.h"
+#include "IO/SAM/SAMBlock.h"
+#include "IO/SAM/SAMRecord.h"
+
+namespace calq {
+
+// Reads BAM records either directly into SAM records or converted to SAM
+// text lines, which can be parsed exactly like the lines of a SAM file
+class BAMReader {
+ public:
+    explicit BAMReader(FILE *fp);
+    ~BAMReader(void);
+
+    void setThreadPool(ThreadPool *threadPool);
+
+    // Reads the BAM header and returns its SAM text
+    void readHeader(std::string *header);
+
+    // Reads the next record and converts it to a SAM line (without the
+    // trailing newline); returns false at the end of the file
+    bool readRecord(std::string *line);
+
+    // Reads the next record into samRecord without converting it to text;
+    // only QNAME, SEQ and QUAL are copied, to memory owned by samBlock, and
+    // the fields the codec does not need are left empty; returns false at
+    // the end of the file
+    bool readRecord(SAMRecord *samRecord, SAMBlock *samBlock);
+
+    // Makes the next call to readRecord() return the last record again
+    void unreadRecord(void);
+
+ private:
+    bool nextRecord(void);
+    void readExactly(void *buffer, const size_t &size);
+    int32_t readInt32(void);
+
+    BGZFReader bgzfReader_;
+    std::vector<std::string> referenceNames_;
+
+    // Current record and its fields; the pointers point into record_
+    std::string record_;
+    bool hasUnreadRecord_;
+    int32_t refID_;
+    int32_t pos_;
+    uint8_t mapq_;
+    uint16_t flag_;
+    int32_t nextRefID_;
+    int32_t nextPos_;
+    int32_t tlen_;
+    size_t nrCigarOps_;
+    size_t seqLength_;
+    const unsigned char *readName_;
+    size_t readNameLength_;
+    const unsigned char *cigar_;
+    const unsigned char *seq_;
+    const unsigned char *qual_;
+    const unsigned char *aux_;
+    const unsigned char *end_;
+
+    std::vector<uint32_t> cigarOps_;
+};
+
+}  // namespace calq
+
+#endif  // CALQ_IO_BAM_BAMREADER_H_
@@ -0,0 +1,215 @@
+/** @file BGZFReader.cc
+ *  @brief This file contains the implementation of the BGZFReader class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include "IO/BAM/BGZFReader.h"
+
+#include <string.h>
+#include <zlib.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Common/Exceptions.h"
+
+namespace calq {
+
+static const size_t BGZF_HEADER_SIZE = 12;  // fixed part of the gzip header
+static const size_t BGZF_FOOTER_SIZE = 8;   // CRC32 and ISIZE
+
+static uint32_t littleEndian32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t littleEndian16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// Uncompressed size of a BGZF block (ISIZE)
+static size_t uncompressedBlockSize(const std::string &block) {
+    return littleEndian32((const unsigned char *)block.data() + block.size() - 4);
+}
+
+// Inflates a complete BGZF block to out
+static void inflateBlock(const std::string &block, unsigned char *out) {
+    const unsigned char *data = (const unsigned char *)block.data();
+    size_t xlen = littleEndian16(data + 10);
+    size_t cdataOffset = BGZF_HEADER_SIZE + xlen;
+    size_t cdataSize = block.size() - cdataOffset - BGZF_FOOTER_SIZE;
+    uint32_t crc = littleEndian32(data + block.size() - 8);
+    size_t isize = uncompressedBlockSize(block);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -15) != Z_OK) {
+        throwErrorException("inflateInit2 failed");
+    }
+    stream.next_in = (Bytef *)(data + cdataOffset);
+    stream.avail_in = (uInt)cdataSize;
+    stream.next_out = (Bytef *)out;
+    stream.avail_out = (uInt)isize;
+    int ret = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if (ret != Z_STREAM_END || stream.total_out != isize) {
+        throwErrorException("Corrupted BGZF block");
+    }
+
+    if (crc32(crc32(0L, Z_NULL, 0), (const Bytef *)out, (uInt)isize) != crc) {
+        throwErrorException("BGZF block CRC mismatch");
+    }
+}
+
+// Inflates the blocks of a batch into one contiguous buffer
+static std::string inflateBatch(const std::vector<std::string> &blocks) {
+    size_t size = 0;
+    for (auto const &block : blocks) {
+        size += uncompressedBlockSize(block);
+    }
+
+    std::string batch(size, '\0');
+    size_t offset = 0;
+    for (auto const &block : blocks) {
+        inflateBlock(block, (unsigned char *)&batch[offset]);
+        offset += uncompressedBlockSize(block);
+    }
+
+    return batch;
+}
+
+BGZFReader::BGZFReader(FILE *fp)
+    : fp_(fp),
+      threadPool_(NULL),
+      eof_(false),
+      batches_(),
+      buffer_(""),
+      bufferPos_(0) {
+    if (fp == NULL) {
+        throwErrorException("fp is NULL");
+    }
+}
+
+BGZFReader::~BGZFReader(void) {}
+
+void BGZFReader::setThreadPool(ThreadPool *threadPool) {
+    threadPool_ = threadPool;
+}
+
+bool BGZFReader::read(void *buffer, const size_t &size) {
+    size_t nrReadBytes = 0;
+
+    while (nrReadBytes < size) {
+        if (bufferPos_ == buffer_.size()) {
+            if (nextBatch() == false) {
+                if (nrReadBytes == 0) {
+                    return false;
+                }
+                throwErrorException("Truncated BGZF data");
+            }
+            continue;
+        }
+
+        size_t n = buffer_.size() - bufferPos_;
+        if (n > (size - nrReadBytes)) {
+            n = size - nrReadBytes;
+        }
+        memcpy((unsigned char *)buffer + nrReadBytes, &buffer_[bufferPos_], n);
+        bufferPos_ += n;
+        nrReadBytes += n;
+    }
+
+    return true;
+}
+
+bool BGZFReader::isBGZF(FILE *fp) {
+    // Only one character can portably be pushed back, so just peek at the
+    // first gzip magic byte (which can never start a SAM file); the complete
+    // header is validated by readBlock()
+    int c = getc(fp);
+    if (c == EOF) {
+        return false;
+    }
+    ungetc(c, fp);
+    return (c == 0x1f);
+}
+
+bool BGZFReader::readBlock(std::string *block) {
+    unsigned char header[BGZF_HEADER_SIZE];
+    size_t n = fread(header, 1, BGZF_HEADER_SIZE, fp_);
+    if (n == 0) {
+        return false;
+    }
+    if (n != BGZF_HEADER_SIZE || header[0] != 0x1f || header[1] != 0x8b || header[2] != 0x08 || (header[3] & 0x04) == 0) {
+        throwErrorException("Invalid BGZF block header");
+    }
+
+    // Find the BSIZE ('BC') subfield in the extra field
+    size_t xlen = littleEndian16(header + 10);
+    block->assign((const char *)header, BGZF_HEADER_SIZE);
+    block->resize(BGZF_HEADER_SIZE + xlen);
+    if (fread(&(*block)[BGZF_HEADER_SIZE], 1, xlen, fp_) != xlen) {
+        throwErrorException("Truncated BGZF block");
+    }
+    size_t blockSize = 0;
+    const unsigned char *extra = (const unsigned char *)block->data() + BGZF_HEADER_SIZE;
+    for (size_t i = 0; (i + 4) <= xlen; i += 4 + littleEndian16(extra + i + 2)) {
+        if (extra[i] == 'B' && extra[i+1] == 'C' && littleEndian16(extra + i + 2) == 2 && (i + 6) <= xlen) {
+            blockSize = (size_t)littleEndian16(extra + i + 4) + 1;
+        }
+    }
+    if (blockSize < (BGZF_HEADER_SIZE + xlen + BGZF_FOOTER_SIZE)) {
+        throwErrorException("Invalid BGZF block size");
+    }
+
+    // Read the compressed data and the footer
+    size_t remaining = blockSize - block->size();
+    size_t offset = block->size();
+    block->resize(blockSize);
+    if (fread(&(*block)[offset], 1, remaining, fp_) != remaining) {
+        throwErrorException("Truncated BGZF block");
+    }
+
+    return true;
+}
+
+bool BGZFReader::nextBatch(void) {
+    // Read the next batch of blocks from the file; returns an empty batch at EOF
+    auto readBatch = [this](void) {
+        std::shared_ptr< std::vector<std::string> > blocks = std::make_shared< std::vector<std::string> >();
+        for (size_t i = 0; i < BATCH_SIZE && eof_ == false; i++) {
+            std::string block;
+            if (readBlock(&block) == true) {
+                blocks->push_back(std::move(block));
+            } else {
+                eof_ = true;
+            }
+        }
+        return blocks;
+    };
+
+    // Keep up to two batches per thread in flight
+    if (threadPool_ != NULL) {
+        while (batches_.size() < (2 * threadPool_->nrThreads()) && eof_ == false) {
+            std::shared_ptr< std::vector<std::string> > blocks = readBatch();
+            batches_.push_back(threadPool_->enqueue([blocks](void) { return inflateBatch(*blocks); }));
+        }
+    }
+
+    if (batches_.empty() == false) {
+        std::future<std::string> batch = std::move(batches_.front());
+        batches_.pop_front();
+        buffer_ = batch.get();
+    } else if (eof_ == false) {
+        buffer_ = inflateBatch(*readBatch());
+    } else {
+        return false;
+    }
+    bufferPos_ = 0;
+
+    return true;
+}
+
+}  // namespace calq
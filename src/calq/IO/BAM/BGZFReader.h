@@ -0,0 +1,56 @@
+/** @file BGZFReader.h
+ *  @brief This file contains the definition of the BGZFReader class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_IO_BAM_BGZFREADER_H_
+#define CALQ_IO_BAM_BGZFREADER_H_
+
+#include <stdio.h>
+
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "Common/ThreadPool.h"
+
+namespace calq {
+
+// Reads the uncompressed data from a BGZF file (the blocked gzip format
+// used by BAM). The BGZF blocks are read in batches; if a thread pool is
+// set, several batches are inflated concurrently ahead of the reader.
+class BGZFReader {
+ public:
+    explicit BGZFReader(FILE *fp);
+    ~BGZFReader(void);
+
+    void setThreadPool(ThreadPool *threadPool);
+
+    // Reads exactly size bytes; returns false if the end of the data was
+    // reached before the first byte
+    bool read(void *buffer, const size_t &size);
+
+    // Whether the data starting at the current position of fp looks like
+    // BGZF; fp is not seeked, so it may be a pipe
+    static bool isBGZF(FILE *fp);
+
+ private:
+    static const size_t BATCH_SIZE = 16;  // BGZF blocks per batch
+
+    bool readBlock(std::string *block);
+    bool nextBatch(void);
+
+    FILE *fp_;
+    ThreadPool *threadPool_;
+    bool eof_;  // all BGZF blocks have been read from fp_
+
+    std::deque< std::future<std::string> > batches_;
+    std::string buffer_;
+    size_t bufferPos_;
+};
+
+}  // namespace calq
+
+#endif  // CALQ_IO_BAM_BGZFREADER_H_
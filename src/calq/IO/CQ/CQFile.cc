@@ -9,25 +9,78 @@
 #include <math.h>
 #include <string.h>
 
+#include <algorithm>
 #include <utility>
 #include <string>
+#include <vector>
 
 #include "Common/constants.h"
 #include "Common/Exceptions.h"
 #include "Common/log.h"
 #include "Compressors/range/range.h"
+#include "Compressors/rans/rans.h"
 
 namespace calq {
 
+// Big-endian value of the last size bytes of raw
+static uint64_t rawTail(const std::string &raw, const size_t &size) {
+    uint64_t value = 0;
+    for (size_t i = raw.size() - size; i < raw.size(); ++i) {
+        value = (value << 8) | (uint64_t)(unsigned char)raw[i];
+    }
+    return value;
+}
+
+// Range coder context of the calling thread; its tables and scratch buffers
+// are reused by all sub-blocks (de)compressed on the thread
+static range_ctx * threadRangeContext(void) {
+    struct Context {
+        Context(void) : ctx(range_ctx_create()) {}
+        ~Context(void) { range_ctx_destroy(ctx); }
+        range_ctx *ctx;
+    };
+    static thread_local Context context;
+    if (context.ctx == NULL) {
+        throwErrorException("Cannot create range coder context");
+    }
+    return context.ctx;
+}
+
+// rANS decoder context of the calling thread; its decoding tables are reused
+// by all sub-blocks decompressed on the thread
+static rans_ctx * threadRansContext(void) {
+    struct Context {
+        Context(void) : ctx(rans_ctx_create()) {}
+        ~Context(void) { rans_ctx_destroy(ctx); }
+        rans_ctx *ctx;
+    };
+    static thread_local Context context;
+    if (context.ctx == NULL) {
+        throwErrorException("Cannot create rANS decoder context");
+    }
+    return context.ctx;
+}
+
 CQFile::CQFile(const std::string &path, const Mode &mode)
     : File(path, mode),
       nrReadFileFormatBytes_(0),
-      nrWrittenFileFormatBytes_(0) {
+      nrWrittenFileFormatBytes_(0),
+      threadPool_(NULL),
+      version_(VERSION_2),
+      parameters_() {
     if (path.empty() == true) {
         throwErrorException("path is empty");
     }
 }
 
+CQFile::CQFile(std::string *buffer, const Mode &mode)
+    : File(buffer, mode),
+      nrReadFileFormatBytes_(0),
+      nrWrittenFileFormatBytes_(0),
+      threadPool_(NULL),
+      version_(VERSION_2),
+      parameters_() {}
+
 CQFile::~CQFile(void) {}
 
 size_t CQFile::nrReadFileFormatBytes(void) const {
@@ -38,6 +91,55 @@ size_t CQFile::nrWrittenFileFormatBytes(void) const {
     return nrWrittenFileFormatBytes_;
 }
 
+void CQFile::setThreadPool(ThreadPool *threadPool) {
+    threadPool_ = threadPool;
+}
+
+uint8_t CQFile::version(void) const {
+    return version_;
+}
+
+const CQFile::Parameters & CQFile::parameters(void) const {
+    return parameters_;
+}
+
+void CQFile::setFormat(const CQFile &cqFile) {
+    version_ = cqFile.version_;
+    parameters_ = cqFile.parameters_;
+}
+
+void CQFile::parallelFor(const size_t &n, const std::function<void(size_t)> &f) {
+    if (threadPool_ != NULL && n > 1) {
+        threadPool_->parallelFor(n, f);
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            f(i);
+        }
+    }
+}
+
+void CQFile::unpackSymbols(const uint8_t symbolFormat, std::string *symbols) {
+    if (symbols == NULL) {
+        throwErrorException("symbols is NULL");
+    }
+
+    switch (symbolFormat) {
+    case SYMBOLS_ASCII:
+        for (auto &symbol : *symbols) {
+            symbol -= '0';
+        }
+        break;
+    case SYMBOLS_UINT8:
+        break;
+    default:
+        throwErrorException("Unsupported symbol format");
+    }
+}
+
+bool CQFile::isCodecSupported(const uint8_t codec) {
+    return (codec == CODEC_RANGE_O1 || codec == CODEC_RANS_O0 || codec == CODEC_RANS_O1 || codec == CODEC_RANGE_O1_SMALL);
+}
+
 size_t CQFile::readHeader(size_t *blockSize) {
     if (blockSize == nullptr) {
         throwErrorException("Received nullptr as argument");
@@ -47,15 +149,40 @@ size_t CQFile::readHeader(size_t *blockSize) {
 
     size_t ret = 0;
 
+    // The last byte of the magic is 0 in CQ v1 and the version otherwise
     char magic[MAGIC_LEN];
     ret += read(magic, MAGIC_LEN);
-    if (strncmp(magic, MAGIC, MAGIC_LEN) != 0) {
+    if (strncmp(magic, MAGIC, MAGIC_LEN - 1) != 0) {
         throwErrorException("magic does not match");
     }
+    if (magic[MAGIC_LEN - 1] == 0) {
+        version_ = VERSION_1;
+    } else if (magic[MAGIC_LEN - 1] == VERSION_2) {
+        version_ = VERSION_2;
+    } else if (magic[MAGIC_LEN - 1] == VERSION_3) {
+        version_ = VERSION_3;
+    } else {
+        throwErrorException("Unsupported CQ file version");
+    }
 
     ret += readUint64((uint64_t *)blockSize);
 //     CALQ_LOG("Block size: %zu", *blockSize);
 
+    if (version_ != VERSION_1) {
+        parameters_ = Parameters();
+        parameters_.streaming = (version_ == VERSION_3);
+        ret += readUint32(&parameters_.qualityValueOffset);
+        ret += readQuantizers(&parameters_.quantizers);
+        uint8_t nrStreams = 0;
+        ret += readUint8(&nrStreams);
+        for (uint8_t i = 0; i < nrStreams; ++i) {
+            StreamInfo stream;
+            ret += readUint8(&stream.codec);
+            ret += readUint8(&stream.symbolFormat);
+            parameters_.streams.push_back(stream);
+        }
+    }
+
     nrReadFileFormatBytes_ += ret;
 
     return ret;
@@ -95,13 +222,16 @@ size_t CQFile::readQuantizers(std::map<int, Quantizer> *quantizers) {
     return ret;
 }
 
-size_t CQFile::readQualBlock(std::string *block) {
+size_t CQFile::readQualBlock(std::string *block, const uint8_t codec) {
     if (block == NULL) {
         throwErrorException("block is NULL");
     }
     if (block->empty() == false) {
         throwErrorException("block is not empty");
     }
+    if (isCodecSupported(codec) == false) {
+        throwErrorException("Unsupported codec");
+    }
 
 //     CALQ_LOG("Reading block");
 
@@ -111,49 +241,206 @@ size_t CQFile::readQualBlock(std::string *block) {
     ret += readUint64(&nrBlocks);
 //     CALQ_LOG("Reading %zu sub-block(s)", (size_t)nrBlocks);
 
+    // Read all sub-blocks and determine where their uncompressed data goes
+    std::vector<uint8_t> compressed(nrBlocks, 0);
+    std::vector<std::string> subBlocks(nrBlocks);
+    std::vector<size_t> offsets(nrBlocks, 0);
+    size_t uncompressedSize = 0;
     for (uint64_t i = 0; i < nrBlocks; ++i) {
-        uint8_t compressed = 0;
-        ret += readUint8(&compressed);
-        if (compressed == 0) {
-            uint32_t tmpSize = 0;
-            ret += readUint32(&tmpSize);
-            unsigned char *tmp = (unsigned char *)malloc(tmpSize);
-            ret += read(tmp, tmpSize);
-            *block += std::string((const char *)tmp, tmpSize);
-            free(tmp);
+        ret += readUint8(&compressed[i]);
+        uint32_t tmpSize = 0;
+        ret += readUint32(&tmpSize);
+        ret += readRaw(&subBlocks[i], tmpSize);
+
+        offsets[i] = uncompressedSize;
+        if (compressed[i] == 0) {
+            uncompressedSize += tmpSize;
 //             CALQ_LOG("Read uncompressed sub-block (%u byte(s))", tmpSize);
-        } else if (compressed == 1) {
-            uint32_t tmpSize = 0;
-            ret += readUint32(&tmpSize);
-            unsigned char *tmp = (unsigned char *)malloc(tmpSize);
-            ret += read(tmp, tmpSize);
+        } else if (compressed[i] == 1 && (codec == CODEC_RANGE_O1 || codec == CODEC_RANGE_O1_SMALL)) {
+            if (tmpSize < sizeof(uint32_t)) {
+                throwErrorException("Bitstream error");
+            }
+            uncompressedSize += range_decompressed_size((const unsigned char *)subBlocks[i].data());
+//             CALQ_LOG("Read compressed sub-block (%u byte(s))", tmpSize);
+        } else if (compressed[i] == 1) {
+            if (tmpSize < 5) {
+                throwErrorException("Bitstream error");
+            }
+            uncompressedSize += rans_decompressed_size((const unsigned char *)subBlocks[i].data(), tmpSize);
 //             CALQ_LOG("Read compressed sub-block (%u byte(s))", tmpSize);
-            unsigned int uncompressedSize = 0;
-            unsigned char *uncompressed = range_decompress_o1(tmp, &uncompressedSize);
-            free(tmp);
-            *block += std::string((const char *)uncompressed, uncompressedSize);
-            free(uncompressed);
-//             CALQ_LOG("Uncompressed size was: %u", uncompressedSize);
         } else {
             throwErrorException("Bitstream error");
         }
     }
 
+    // Decompress the sub-blocks directly into the output buffer
+    block->resize(uncompressedSize);
+    parallelFor(nrBlocks, [&](size_t i) {
+        unsigned char *out = (unsigned char *)&(*block)[offsets[i]];
+        if (compressed[i] == 0) {
+            memcpy(out, subBlocks[i].data(), subBlocks[i].size());
+        } else if (codec == CODEC_RANGE_O1) {
+            unsigned int subBlockSize = 0;
+            if (range_decompress_o1_ctx(threadRangeContext(), (const unsigned char *)subBlocks[i].data(), out, &subBlockSize) == NULL) {
+                throwErrorException("Decompression failed");
+            }
+        } else if (codec == CODEC_RANGE_O1_SMALL) {
+            unsigned int subBlockSize = 0;
+            if (range_decompress_o1_small_ctx(threadRangeContext(), (const unsigned char *)subBlocks[i].data(), out, &subBlockSize) == NULL) {
+                throwErrorException("Decompression failed");
+            }
+        } else {
+            // Both rANS orders share the decoder; the order is in the sub-block
+            unsigned int subBlockSize = 0;
+            if (rans_decompress_to_ctx(threadRansContext(), (const unsigned char *)subBlocks[i].data(), (unsigned int)subBlocks[i].size(), out, &subBlockSize) == NULL) {
+                throwErrorException("Bitstream error");
+            }
+        }
+    });
+
     return ret;
 }
 
-size_t CQFile::writeHeader(const size_t &blockSize) {
+size_t CQFile::readRaw(std::string *raw, const size_t &size) {
+    if (raw == NULL) {
+        throwErrorException("raw is NULL");
+    }
+
+    size_t offset = raw->size();
+    raw->resize(offset + size);
+    return read(&(*raw)[offset], size);
+}
+
+size_t CQFile::readRawQuantizers(std::string *raw, size_t *nrQuantizers) {
+    if (nrQuantizers == NULL) {
+        throwErrorException("nrQuantizers is NULL");
+    }
+
+    size_t ret = 0;
+
+    ret += readRaw(raw, sizeof(uint64_t));
+    *nrQuantizers = (size_t)rawTail(*raw, sizeof(uint64_t));
+
+    for (size_t i = 0; i < *nrQuantizers; ++i) {
+        ret += readRaw(raw, sizeof(uint64_t));  // quantizer index
+        ret += readRaw(raw, sizeof(uint64_t));
+        uint64_t nrInverseLutEntries = rawTail(*raw, sizeof(uint64_t));
+        ret += readRaw(raw, 2 * nrInverseLutEntries * sizeof(uint8_t));
+    }
+
+    return ret;
+}
+
+size_t CQFile::readRawQualBlock(std::string *raw) {
+    size_t ret = 0;
+
+    ret += readRaw(raw, sizeof(uint64_t));
+    uint64_t nrBlocks = rawTail(*raw, sizeof(uint64_t));
+
+    for (uint64_t i = 0; i < nrBlocks; ++i) {
+        ret += readRaw(raw, sizeof(uint8_t));
+        ret += readRaw(raw, sizeof(uint32_t));
+        uint32_t size = (uint32_t)rawTail(*raw, sizeof(uint32_t));
+        ret += readRaw(raw, size);
+    }
+
+    return ret;
+}
+
+size_t CQFile::readIndex(std::vector<IndexEntry> *index) {
+    if (index == NULL) {
+        throwErrorException("index is NULL");
+    }
+    if (index->empty() == false) {
+        throwErrorException("index is not empty");
+    }
+
+    // The index is followed by its byte offset and the index magic; the last
+    // byte of the index magic is 0 for indexes without checksums and the
+    // index version otherwise
+    const size_t trailerSize = sizeof(uint64_t) + INDEX_MAGIC_LEN;
+    if (isSeekable() == false || size() < trailerSize) {
+        return 0;
+    }
+    seek(size() - trailerSize);
+    uint64_t indexOffset = 0;
+    readUint64(&indexOffset);
+    char magic[INDEX_MAGIC_LEN];
+    read(magic, INDEX_MAGIC_LEN);
+    if (memcmp(magic, INDEX_MAGIC, INDEX_MAGIC_LEN - 1) != 0) {
+        return 0;
+    }
+    const uint8_t indexVersion = (uint8_t)magic[INDEX_MAGIC_LEN - 1];
+    if (indexVersion != 0 && indexVersion != INDEX_VERSION_2) {
+        throwErrorException("Block index version not supported");
+    }
+    if (indexOffset > (size() - trailerSize)) {
+        throwErrorException("Corrupted block index");
+    }
+
+    size_t ret = trailerSize;
+
+    seek(indexOffset);
+    uint64_t nrEntries = 0;
+    ret += readUint64(&nrEntries);
+    for (uint64_t i = 0; i < nrEntries; ++i) {
+        IndexEntry entry;
+        uint64_t rnameLength = 0;
+        ret += readUint64(&rnameLength);
+        if (rnameLength > (size() - indexOffset)) {
+            throwErrorException("Corrupted block index");
+        }
+        entry.rname.resize(rnameLength);
+        if (rnameLength > 0) {
+            ret += read(&entry.rname[0], rnameLength);
+        }
+        ret += readUint32(&entry.posMin);
+        ret += readUint32(&entry.posMax);
+        ret += readUint64(&entry.cqOffset);
+        ret += readUint64(&entry.samOffset);
+        ret += readUint64(&entry.nrRecords);
+        entry.hasChecksum = (indexVersion == INDEX_VERSION_2);
+        entry.checksum = 0;
+        if (entry.hasChecksum == true) {
+            ret += readUint32(&entry.checksum);
+        }
+        index->push_back(entry);
+    }
+
+    nrReadFileFormatBytes_ += ret;
+
+    return ret;
+}
+
+size_t CQFile::writeHeader(const size_t &blockSize, const Parameters &parameters) {
     if (blockSize == 0) {
         throwErrorException("blockSize must be greater than zero");
     }
+    if (parameters.streams.size() > 255) {
+        throwErrorException("Too many streams");
+    }
 
 //     CALQ_LOG("Writing header");
 
     size_t ret = 0;
 
-    ret += write((char *)MAGIC, MAGIC_LEN);
+    const uint8_t version = (parameters.streaming == true) ? VERSION_3 : VERSION_2;
+
+    ret += write((char *)MAGIC, MAGIC_LEN - 1);
+    ret += writeUint8(version);
     ret += writeUint64((uint64_t)blockSize);
 
+    ret += writeUint32(parameters.qualityValueOffset);
+    ret += writeQuantizers(parameters.quantizers);
+    ret += writeUint8((uint8_t)parameters.streams.size());
+    for (auto const &stream : parameters.streams) {
+        ret += writeUint8(stream.codec);
+        ret += writeUint8(stream.symbolFormat);
+    }
+
+    version_ = version;
+    parameters_ = parameters;
+
     nrWrittenFileFormatBytes_ += ret;
 
     return ret;
@@ -183,13 +470,16 @@ size_t CQFile::writeQuantizers(const std::map<int, Quantizer> &quantizers) {
     return ret;
 }
 
-size_t CQFile::writeQualBlock(unsigned char *block, const size_t &blockSize) {
+size_t CQFile::writeQualBlock(unsigned char *block, const size_t &blockSize, const uint8_t codec) {
     if (block == NULL) {
         throwErrorException("block is NULL");
     }
     if (blockSize < 1) {
         throwErrorException("blockSize must be greater than zero");
     }
+    if (isCodecSupported(codec) == false) {
+        throwErrorException("Unsupported codec");
+    }
 
 //     CALQ_LOG("Writing block");
 
@@ -199,34 +489,82 @@ size_t CQFile::writeQualBlock(unsigned char *block, const size_t &blockSize) {
     ret = writeUint64((uint64_t)nrBlocks);
 //     CALQ_LOG("Splitting block containing %zu byte(s) into %zu sub-block(s)", blockSize, nrBlocks);
 
-    size_t encodedBytes = 0;
-    while (encodedBytes < blockSize) {
-        unsigned int bytesToEncode = 0;
-        if ((blockSize - encodedBytes) > (1*MB)) {
-            bytesToEncode = (1*MB);
+    // Compress the sub-blocks; only compressed data smaller than the input is
+    // of use, otherwise the sub-block is stored raw
+    std::vector<std::string> compressed(nrBlocks);
+    std::vector<unsigned int> compressedSizes(nrBlocks, 0);
+    parallelFor(nrBlocks, [&](size_t i) {
+        size_t encodedBytes = i * (1*MB);
+        unsigned int bytesToEncode = (unsigned int)std::min(blockSize - encodedBytes, (size_t)(1*MB));
+        compressedSizes[i] = bytesToEncode;
+        if (codec == CODEC_RANGE_O1) {
+            compressed[i].resize(bytesToEncode);
+            range_compress_o1_ctx(threadRangeContext(), block+encodedBytes, bytesToEncode,
+                                  (unsigned char *)&compressed[i][0], bytesToEncode - 1, &compressedSizes[i]);
+        } else if (codec == CODEC_RANGE_O1_SMALL) {
+            compressed[i].resize(bytesToEncode);
+            range_compress_o1_small_ctx(threadRangeContext(), block+encodedBytes, bytesToEncode,
+                                        (unsigned char *)&compressed[i][0], bytesToEncode - 1, &compressedSizes[i]);
         } else {
-            bytesToEncode = blockSize - encodedBytes;
+            unsigned int compressedSize = 0;
+            unsigned char *tmp = (codec == CODEC_RANS_O0) ? rans_compress_o0(block+encodedBytes, bytesToEncode, &compressedSize)
+                                                          : rans_compress_o1(block+encodedBytes, bytesToEncode, &compressedSize);
+            if (tmp == NULL) {
+                throwErrorException("Compression failed");
+            }
+            if (compressedSize < bytesToEncode) {
+                compressed[i].assign((char *)tmp, compressedSize);
+                compressedSizes[i] = compressedSize;
+            }
+            free(tmp);
         }
+    });
 
-        unsigned int compressedSize = 0;
-        unsigned char *compressed = range_compress_o1(block+encodedBytes, (unsigned int)bytesToEncode, &compressedSize);
+    // Write the sub-blocks in order
+    size_t encodedBytes = 0;
+    for (size_t i = 0; i < nrBlocks; ++i) {
+        unsigned int bytesToEncode = (unsigned int)std::min(blockSize - encodedBytes, (size_t)(1*MB));
 
-        if (compressedSize >= bytesToEncode) {
+        if (compressedSizes[i] >= bytesToEncode) {
             ret += writeUint8(0);
             ret += writeUint32(bytesToEncode);
             ret += write(block+encodedBytes, bytesToEncode);
         } else {
             ret += writeUint8(1);
-            ret += writeUint32(compressedSize);
-            ret += write(compressed, compressedSize);
+            ret += writeUint32(compressedSizes[i]);
+            ret += write((unsigned char *)compressed[i].data(), compressedSizes[i]);
         }
 
         encodedBytes += bytesToEncode;
-        free(compressed);
     }
 
     return ret;
 }
 
-}  // namespace calq
+size_t CQFile::writeIndex(const std::vector<IndexEntry> &index) {
+    size_t ret = 0;
+
+    uint64_t indexOffset = nrWrittenBytes();
+    ret += writeUint64(index.size());
+    for (auto const &entry : index) {
+        ret += writeUint64(entry.rname.length());
+        if (entry.rname.empty() == false) {
+            ret += write((char *)entry.rname.data(), entry.rname.length());
+        }
+        ret += writeUint32(entry.posMin);
+        ret += writeUint32(entry.posMax);
+        ret += writeUint64(entry.cqOffset);
+        ret += writeUint64(entry.samOffset);
+        ret += writeUint64(entry.nrRecords);
+        ret += writeUint32(entry.checksum);
+    }
+    ret += writeUint64(indexOffset);
+    ret += write((char *)INDEX_MAGIC, INDEX_MAGIC_LEN - 1);
+    ret += writeUint8(INDEX_VERSION_2);
 
+    nrWrittenFileFormatBytes_ += ret;
+
+    return ret;
+}
+
+}  // namespace calq
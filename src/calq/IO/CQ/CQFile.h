@@ -9,34 +9,127 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
+#include "Common/ThreadPool.h"
 #include "IO/File.h"
 #include "QualCodec/Quantizers/Quantizer.h"
 
 namespace calq {
 
+// CQ files are written in the format version 2 (CQ v2): the file header holds
+// the parameters shared by all blocks (quality value offset, quantizers, and
+// codec and symbol format of each stream), and each block starts with a
+// directory holding the byte length of each of its streams, so that streams
+// can be skipped or decoded concurrently. CQ v1 files, where the parameters
+// are repeated in every block and the streams have to be parsed in order,
+// are still readable. CQ v3 files are CQ v2 files written in streaming mode,
+// where the pileup and the pending mapped records are carried over from one
+// block to the next; hence their blocks can only be decoded in order.
 class CQFile : public File {
  public:
+    static const uint8_t VERSION_1 = 1;
+    static const uint8_t VERSION_2 = 2;
+    static const uint8_t VERSION_3 = 3;
+
+    // Stream codecs of CQ v2; with every codec, sub-blocks which do not
+    // compress are stored raw
+    static const uint8_t CODEC_RANGE_O1 = 1;  // order-1 range coder
+    static const uint8_t CODEC_RANS_O0 = 2;   // order-0 rANS coder with 32 interleaved states
+    static const uint8_t CODEC_RANS_O1 = 3;   // order-1 rANS coder with 32 interleaved states
+    static const uint8_t CODEC_RANGE_O1_SMALL = 4;  // order-1 range coder with tables sized to the alphabet
+
+    // Symbol formats of CQ v2; the quality values themselves are always
+    // stored as ASCII characters
+    static const uint8_t SYMBOLS_ASCII = 0;  // one ASCII digit per symbol
+    static const uint8_t SYMBOLS_UINT8 = 1;  // one byte per symbol
+
+    struct StreamInfo {
+        uint8_t codec;
+        uint8_t symbolFormat;
+    };
+
+    // Parameters shared by all blocks of a CQ v2 or v3 file; streaming is
+    // not written to the header but selects the version
+    struct Parameters {
+        uint32_t qualityValueOffset;
+        std::map<int, Quantizer> quantizers;
+        std::vector<StreamInfo> streams;
+        bool streaming;
+    };
+
+    // Entry of the block index which is appended to the CQ file after the
+    // last block; it allows to decode only the blocks overlapping a region
+    struct IndexEntry {
+        std::string rname;   // RNAME of the mapped records ("*" if none)
+        uint32_t posMin;     // 0-based leftmost position of the mapped records
+        uint32_t posMax;     // 0-based rightmost position of the mapped records
+        uint64_t cqOffset;   // byte offset of the block in the CQ file
+        uint64_t samOffset;  // byte offset of the first record in the SAM file
+        uint64_t nrRecords;
+        bool hasChecksum;    // false for indexes without side information checksums
+        uint32_t checksum;   // see SAMBlock::checksum()
+    };
+
     CQFile(const std::string &path, const Mode &mode);
+    CQFile(std::string *buffer, const Mode &mode);
     ~CQFile(void);
 
     size_t nrReadFileFormatBytes(void) const;
     size_t nrWrittenFileFormatBytes(void) const;
 
+    // Optional thread pool used to (de)compress the sub-blocks of a quality
+    // value block concurrently
+    void setThreadPool(ThreadPool *threadPool);
+
+    // Format version and (for CQ v2 and v3) parameters read by readHeader() or
+    // written by writeHeader()
+    uint8_t version(void) const;
+    const Parameters & parameters(void) const;
+
+    // Takes over the format from cqFile; used for in-memory files holding
+    // single blocks of cqFile
+    void setFormat(const CQFile &cqFile);
+
+    // Converts (in place) a stream in the given symbol format to uint8
+    // symbols, one per character
+    static void unpackSymbols(const uint8_t symbolFormat, std::string *symbols);
+
+    static bool isCodecSupported(const uint8_t codec);
+
     size_t readHeader(size_t *blockSize);
     size_t readQuantizers(std::map<int, Quantizer> *quantizers);
-    size_t readQualBlock(std::string *block);
+    size_t readQualBlock(std::string *block, const uint8_t codec = CODEC_RANGE_O1);
 
-    size_t writeHeader(const size_t &blockSize);
+    // The raw variants append the bitstream to raw as it is, i.e., without
+    // decompressing it; they are used to hand entire blocks to worker threads
+    size_t readRaw(std::string *raw, const size_t &size);
+    size_t readRawQuantizers(std::string *raw, size_t *nrQuantizers);
+    size_t readRawQualBlock(std::string *raw);
+
+    // Reads the block index; returns 0 and leaves index empty if the file
+    // has none. The file position is undefined afterwards.
+    size_t readIndex(std::vector<IndexEntry> *index);
+
+    size_t writeHeader(const size_t &blockSize, const Parameters &parameters);
     size_t writeQuantizers(const std::map<int, Quantizer> &quantizers);
-    size_t writeQualBlock(unsigned char *block, const size_t &blockSize);
+    size_t writeQualBlock(unsigned char *block, const size_t &blockSize, const uint8_t codec = CODEC_RANGE_O1);
+    size_t writeIndex(const std::vector<IndexEntry> &index);
 
  private:
+    void parallelFor(const size_t &n, const std::function<void(size_t)> &f);
+
     static constexpr const char *MAGIC = "CQ";
     const size_t MAGIC_LEN = 3;
+    static constexpr const char *INDEX_MAGIC = "CQI";
+    const size_t INDEX_MAGIC_LEN = 4;
+    static const uint8_t INDEX_VERSION_2 = 2;
 
     size_t nrReadFileFormatBytes_;
     size_t nrWrittenFileFormatBytes_;
+    ThreadPool *threadPool_;
+    uint8_t version_;
+    Parameters parameters_;
 };
 
 }  // namespace calq
@@ -7,6 +7,7 @@
 #include "IO/File.h"
 
 #include <limits.h>
+#include <string.h>
 
 #include "Common/Exceptions.h"
 #include "Common/os.h"
@@ -15,6 +16,8 @@ namespace calq {
 
 File::File(void)
     : fp_(NULL),
+      buffer_(NULL),
+      bufferPos_(0),
       fsize_(0),
       isOpen_(false),
       mode_(File::MODE_READ),
@@ -23,6 +26,8 @@ File::File(void)
 
 File::File(const std::string &path, const Mode mode)
     : fp_(NULL),
+      buffer_(NULL),
+      bufferPos_(0),
       fsize_(0),
       isOpen_(false),
       mode_(mode),
@@ -35,6 +40,22 @@ File::File(const std::string &path, const Mode mode)
     open(path, mode);
 }
 
+File::File(std::string *buffer, const Mode mode)
+    : fp_(NULL),
+      buffer_(NULL),
+      bufferPos_(0),
+      fsize_(0),
+      isOpen_(false),
+      mode_(mode),
+      nrReadBytes_(0),
+      nrWrittenBytes_(0) {
+    if (buffer == NULL) {
+        throwErrorException("buffer is NULL");
+    }
+
+    open(buffer, mode);
+}
+
 File::~File(void) {
     close();
 }
@@ -43,7 +64,7 @@ void File::open(const std::string &path, const Mode mode) {
     if (path.empty() == true) {
         throwErrorException("path is empty");
     }
-    if (fp_ != NULL) {
+    if (fp_ != NULL || buffer_ != NULL) {
         throwErrorException("File pointer already in use");
     }
 
@@ -58,6 +79,15 @@ void File::open(const std::string &path, const Mode mode) {
         throwErrorException("Unkown mode");
     }
 
+    // "-" denotes the standard input, which may be a pipe; its size is
+    // unknown and it cannot be seeked
+    if (path == "-" && mode == MODE_READ) {
+        fp_ = stdin;
+        fsize_ = 0;
+        isOpen_ = true;
+        return;
+    }
+
 #ifdef CQ_OS_WINDOWS
     int err = fopen_s(&fp_, path.c_str(), m);
     if (err != 0) {
@@ -78,10 +108,37 @@ void File::open(const std::string &path, const Mode mode) {
     isOpen_ = true;
 }
 
+void File::open(std::string *buffer, const Mode mode) {
+    if (buffer == NULL) {
+        throwErrorException("buffer is NULL");
+    }
+    if (fp_ != NULL || buffer_ != NULL) {
+        throwErrorException("File pointer already in use");
+    }
+    if (mode != MODE_READ && mode != MODE_WRITE) {
+        throwErrorException("Unkown mode");
+    }
+
+    // In read mode the buffer is consumed from its beginning, in write mode
+    // data is appended to it
+    buffer_ = buffer;
+    bufferPos_ = (mode == MODE_READ) ? 0 : buffer_->size();
+    fsize_ = buffer_->size();
+    mode_ = mode;
+
+    isOpen_ = true;
+}
+
 void File::close(void) {
     if (isOpen_ == true) {
-        if (fp_ != NULL) {
-            fclose(fp_);
+        if (buffer_ != NULL) {
+            buffer_ = NULL;
+            bufferPos_ = 0;
+            isOpen_ = false;
+        } else if (fp_ != NULL) {
+            if (fp_ != stdin) {
+                fclose(fp_);
+            }
             fp_ = NULL;
         } else {
             throwErrorException("Failed to close file");
@@ -90,6 +147,13 @@ void File::close(void) {
 }
 
 void File::advance(const size_t offset) {
+    if (buffer_ != NULL) {
+        if (offset > (buffer_->size() - bufferPos_)) {
+            throwErrorException("offset out of range");
+        }
+        bufferPos_ += offset;
+        return;
+    }
     int ret = fseek(fp_, (long int)offset, SEEK_CUR);
     if (ret != 0) {
         throwErrorException("fseek failed");
@@ -97,6 +161,9 @@ void File::advance(const size_t offset) {
 }
 
 bool File::eof(void) const {
+    if (buffer_ != NULL) {
+        return bufferPos_ >= buffer_->size();
+    }
     int eof = feof(fp_);
     return eof != 0 ? true : false;
 }
@@ -109,6 +176,13 @@ void File::seek(const size_t pos) {
     if (pos > LONG_MAX) {
         throwErrorException("pos out of range");
     }
+    if (buffer_ != NULL) {
+        if (pos > buffer_->size()) {
+            throwErrorException("pos out of range");
+        }
+        bufferPos_ = pos;
+        return;
+    }
     int ret = fseek(fp_, (long)pos, SEEK_SET);
     if (ret != 0) {
         throwErrorException("fseek failed");
@@ -116,10 +190,16 @@ void File::seek(const size_t pos) {
 }
 
 size_t File::size(void) const {
+    if (buffer_ != NULL) {
+        return buffer_->size();
+    }
     return fsize_;
 }
 
 size_t File::tell(void) const {
+    if (buffer_ != NULL) {
+        return bufferPos_;
+    }
     long int offset = ftell(fp_);
     if (offset == -1) {
         throwErrorException("ftell failed");
@@ -147,6 +227,12 @@ bool File::isReadable(void) const {
     return false;
 }
 
+bool File::isSeekable(void) const {
+    if (isOpen_ == true && fp_ != stdin)
+        return true;
+    return false;
+}
+
 bool File::isWritable(void) const {
     if (isOpen_ == true && mode_ == MODE_WRITE)
         return true;
@@ -160,9 +246,19 @@ size_t File::read(void *buffer, const size_t size) {
     if (size == 0) {
         return 0;
     }
-    size_t ret = fread(buffer, 1, size, fp_);
-    if (ret != size) {
-        throwErrorException("fread failed");
+    size_t ret = 0;
+    if (buffer_ != NULL) {
+        if (size > (buffer_->size() - bufferPos_)) {
+            throwErrorException("read beyond end of buffer");
+        }
+        memcpy(buffer, buffer_->data() + bufferPos_, size);
+        bufferPos_ += size;
+        ret = size;
+    } else {
+        ret = fread(buffer, 1, size, fp_);
+        if (ret != size) {
+            throwErrorException("fread failed");
+        }
     }
     nrReadBytes_ += ret;
     return ret;
@@ -175,15 +271,30 @@ size_t File::write(void *buffer, const size_t size) {
     if (size == 0) {
         return 0;
     }
-    size_t ret = fwrite(buffer, 1, size, fp_);
-    if (ret != size) {
-        throwErrorException("fwrite failed");
+    size_t ret = 0;
+    if (buffer_ != NULL) {
+        buffer_->append((const char *)buffer, size);
+        bufferPos_ = buffer_->size();
+        ret = size;
+    } else {
+        ret = fwrite(buffer, 1, size, fp_);
+        if (ret != size) {
+            throwErrorException("fwrite failed");
+        }
     }
     nrWrittenBytes_ += ret;
     return ret;
 }
 
 size_t File::readByte(unsigned char *byte) {
+    if (buffer_ != NULL) {
+        if (bufferPos_ >= buffer_->size()) {
+            throwErrorException("read beyond end of buffer");
+        }
+        *byte = (unsigned char)(*buffer_)[bufferPos_++];
+        nrReadBytes_++;
+        return sizeof(unsigned char);
+    }
     size_t ret = fread(byte, 1, 1, fp_);
     if (ret != sizeof(unsigned char)) {
         throwErrorException("fread failed");
@@ -264,6 +375,12 @@ size_t File::readUint64(uint64_t *qword) {
 }
 
 size_t File::writeByte(const unsigned char byte) {
+    if (buffer_ != NULL) {
+        buffer_->push_back((char)byte);
+        bufferPos_ = buffer_->size();
+        nrWrittenBytes_++;
+        return sizeof(unsigned char);
+    }
     size_t ret = fwrite(&byte, 1, 1, fp_);
     if (ret != sizeof(unsigned char)) {
         throwErrorException("fwrite failed");
@@ -17,9 +17,11 @@ class File {
 
     File(void);
     File(const std::string &path, const Mode mode);
+    File(std::string *buffer, const Mode mode);
     virtual ~File(void);
 
     void open(const std::string &path, const Mode mode);
+    void open(std::string *buffer, const Mode mode);
     void close(void);
 
     void advance(const size_t offset);
@@ -33,6 +35,7 @@ class File {
     size_t nrWrittenBytes(void) const;
 
     bool isReadable(void) const;
+    bool isSeekable(void) const;
     bool isWritable(void) const;
 
     size_t read(void *buffer, const size_t size);
@@ -52,6 +55,8 @@ class File {
 
  protected:
     FILE *fp_;
+    std::string *buffer_;  // backing store of an in-memory file
+    size_t bufferPos_;
     size_t fsize_;
     bool isOpen_;
     Mode mode_;
@@ -6,12 +6,19 @@
 
 #include "IO/SAM/SAMBlock.h"
 
+#include <string.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <string>
+
 namespace calq {
 
 SAMBlock::SAMBlock(void)
     : records(),
       nrMappedRecords_(0),
-      nrUnmappedRecords_(0) {}
+      nrUnmappedRecords_(0),
+      arena_() {}
 
 SAMBlock::~SAMBlock(void) {}
 
@@ -31,6 +38,48 @@ void SAMBlock::reset(void) {
     records.clear();
     nrMappedRecords_ = 0;
     nrUnmappedRecords_ = 0;
+    arena_.clear();
+}
+
+void SAMBlock::swap(SAMBlock *samBlock) {
+    records.swap(samBlock->records);
+    std::swap(nrMappedRecords_, samBlock->nrMappedRecords_);
+    std::swap(nrUnmappedRecords_, samBlock->nrUnmappedRecords_);
+    arena_.swap(samBlock->arena_);
+}
+
+uint32_t SAMBlock::checksum(void) const {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (auto const &record : records) {
+        unsigned char mapped = (record.isMapped() == true) ? 1 : 0;
+        crc = crc32(crc, &mapped, 1);
+        if (record.isMapped() == true) {
+            crc = crc32(crc, (const Bytef *)record.rname.data(), (uInt)record.rname.length());
+            crc = crc32(crc, (const Bytef *)&record.posMin, sizeof(record.posMin));
+            crc = crc32(crc, (const Bytef *)record.cigarOps.ops(), (uInt)(record.cigarOps.size() * sizeof(uint32_t)));
+        }
+        uint32_t seqLength = record.seq.length();
+        crc = crc32(crc, (const Bytef *)&seqLength, sizeof(seqLength));
+    }
+    return (uint32_t)crc;
+}
+
+char * SAMBlock::allocate(const size_t &length) {
+    if (arena_.empty() == true || (arena_.back().capacity() - arena_.back().size()) < length) {
+        arena_.push_back(std::string());
+        arena_.back().reserve((length > ARENA_CHUNK_SIZE) ? length : ARENA_CHUNK_SIZE);
+    }
+
+    std::string &chunk = arena_.back();
+    size_t offset = chunk.size();
+    chunk.resize(offset + length);
+    return (&chunk[0] + offset);
+}
+
+const char * SAMBlock::store(const char *data, const size_t &length) {
+    char *copy = allocate(length);
+    memcpy(copy, data, length);
+    return copy;
 }
 
 }  // namespace calq
@@ -8,7 +8,9 @@
 #define CALQ_IO_SAM_SAMBLOCK_H_
 
 #include <deque>
+#include <string>
 
+#include "Common/constants.h"
 #include "IO/SAM/SAMRecord.h"
 
 namespace calq {
@@ -24,12 +26,32 @@ class SAMBlock {
     size_t nrUnmappedRecords(void) const;
     size_t nrRecords(void) const;
     void reset(void);
+    void swap(SAMBlock *samBlock);
+
+    // CRC-32 of the record fields the quality value decoder depends on, i.e.,
+    // the RNAME, POS and CIGAR operations of the mapped records and the SEQ
+    // lengths; SAM and BAM side information yield the same checksum
+    uint32_t checksum(void) const;
+
+    // Returns length bytes of memory owned by this block, which stay valid
+    // until the block is reset
+    char * allocate(const size_t &length);
+
+    // Copies length bytes from data to memory owned by this block
+    const char * store(const char *data, const size_t &length);
 
     std::deque<SAMRecord> records;
 
  private:
+    static const size_t ARENA_CHUNK_SIZE = sizeof(char) * (1*MB);
+
     size_t nrMappedRecords_;
     size_t nrUnmappedRecords_;
+
+    // Storage for the fields of records which are not backed by a memory-
+    // mapped file; chunks are never reallocated, so pointers into them stay
+    // valid
+    std::deque<std::string> arena_;
 };
 
 }  // namespace calq
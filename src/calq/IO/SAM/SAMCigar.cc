@@ -0,0 +1,84 @@
+/** @file SAMCigar.cc
+ *  @brief This file contains the implementation of the SAMCigar class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include "IO/SAM/SAMCigar.h"
+
+#include <string.h>
+
+#include "Common/Exceptions.h"
+
+namespace calq {
+
+SAMCigar::SAMCigar(void) : opsInline_(), opsOverflow_(), size_(0) {}
+
+SAMCigar::~SAMCigar(void) {}
+
+void SAMCigar::parse(const StringView &cigar) {
+    size_ = 0;
+    opsOverflow_.clear();
+
+    uint32_t opLen = 0;  // length of current CIGAR operation
+    for (size_t cigarIdx = 0; cigarIdx < cigar.length(); cigarIdx++) {
+        const char c = cigar[cigarIdx];
+        if (c >= '0' && c <= '9') {
+            const uint32_t digit = (uint32_t)(c - '0');
+            if (opLen > ((UINT32_MAX >> LENGTH_SHIFT) - digit) / 10) {
+                throwErrorException("Bad CIGAR string");
+            }
+            opLen = opLen * 10 + digit;
+            continue;
+        }
+
+        uint32_t op = 0;
+        switch (c) {
+        case 'M': op = M; break;
+        case 'I': op = I; break;
+        case 'D': op = D; break;
+        case 'N': op = N; break;
+        case 'S': op = S; break;
+        case 'H': op = H; break;
+        case 'P': op = P; break;
+        case '=': op = EQ; break;
+        case 'X': op = X; break;
+        default:
+            throwErrorException("Bad CIGAR string");
+        }
+        const uint32_t cigarOp = (opLen << LENGTH_SHIFT) | op;
+        if (size_ < NR_OPS_INLINE) {
+            opsInline_[size_] = cigarOp;
+        } else {
+            if (size_ == NR_OPS_INLINE) {
+                opsOverflow_.assign(opsInline_, opsInline_ + NR_OPS_INLINE);
+            }
+            opsOverflow_.push_back(cigarOp);
+        }
+        size_++;
+        opLen = 0;
+    }
+}
+
+void SAMCigar::assign(const uint32_t *cigarOps, const size_t &size) {
+    opsOverflow_.clear();
+    if (size > NR_OPS_INLINE) {
+        opsOverflow_.assign(cigarOps, cigarOps + size);
+    } else if (size > 0) {
+        memcpy(opsInline_, cigarOps, size * sizeof(uint32_t));
+    }
+    size_ = size;
+}
+
+const uint32_t * SAMCigar::ops(void) const {
+    if (size_ > NR_OPS_INLINE) {
+        return &opsOverflow_[0];
+    }
+    return opsInline_;
+}
+
+size_t SAMCigar::size(void) const {
+    return size_;
+}
+
+}  // namespace calq
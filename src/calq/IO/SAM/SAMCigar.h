@@ -0,0 +1,91 @@
+/** @file SAMCigar.h
+ *  @brief This file contains the definition of the SAMCigar class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_IO_SAM_SAMCIGAR_H_
+#define CALQ_IO_SAM_SAMCIGAR_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "Common/StringView.h"
+
+namespace calq {
+
+// Parsed CIGAR string: the operations are packed as in BAM, with the length
+// in the upper 28 bits and the operation (M, I, ...) in the lower 4 bits.
+// They are stored in the object itself unless there are more than
+// NR_OPS_INLINE of them, which saves a heap allocation per record (and per
+// copy) in the common case.
+class SAMCigar {
+ public:
+    SAMCigar(void);
+    SAMCigar(const SAMCigar &other) = default;
+    SAMCigar(SAMCigar &&other) = default;
+    SAMCigar & operator=(const SAMCigar &other) = default;
+    SAMCigar & operator=(SAMCigar &&other) = default;
+    ~SAMCigar(void);
+
+    void parse(const StringView &cigar);
+
+    // Sets the packed operations directly, e.g., from a BAM record
+    void assign(const uint32_t *cigarOps, const size_t &size);
+
+    const uint32_t * ops(void) const;
+    size_t size(void) const;
+
+    // Walks the operations and calls visitor->match(length) for M, = and X,
+    // visitor->insertion(length) for I and S, and visitor->deletion(length)
+    // for D and N; H and P are skipped
+    template<typename Visitor> void visit(Visitor *visitor) const;
+
+    static const uint32_t M = 0;
+    static const uint32_t I = 1;
+    static const uint32_t D = 2;
+    static const uint32_t N = 3;
+    static const uint32_t S = 4;
+    static const uint32_t H = 5;
+    static const uint32_t P = 6;
+    static const uint32_t EQ = 7;
+    static const uint32_t X = 8;
+    static const uint32_t OP_MASK = 0xf;
+    static const int LENGTH_SHIFT = 4;
+
+ private:
+    static const size_t NR_OPS_INLINE = 6;
+    uint32_t opsInline_[NR_OPS_INLINE];
+    std::vector<uint32_t> opsOverflow_;
+    size_t size_;
+};
+
+template<typename Visitor>
+inline void SAMCigar::visit(Visitor *visitor) const {
+    const uint32_t *cigarOps = ops();
+    for (size_t i = 0; i < size_; i++) {
+        const uint32_t length = cigarOps[i] >> LENGTH_SHIFT;
+        switch (cigarOps[i] & OP_MASK) {
+        case M:
+        case EQ:
+        case X:
+            visitor->match(length);
+            break;
+        case I:
+        case S:
+            visitor->insertion(length);
+            break;
+        case D:
+        case N:
+            visitor->deletion(length);
+            break;
+        default:
+            break;  // H and P have been clipped
+        }
+    }
+}
+
+}  // namespace calq
+
+#endif  // CALQ_IO_SAM_SAMCIGAR_H_
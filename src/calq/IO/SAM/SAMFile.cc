@@ -9,47 +9,41 @@
 #include <string.h>
 
 #include <string>
+#include <utility>
 
 #include "Common/Exceptions.h"
 #include "Common/log.h"
+#include "Common/os.h"
+#include "IO/SAM/SAMTokenizer.h"
 
-namespace calq {
+#ifndef OS_WINDOWS
+#include <sys/mman.h>
+#endif
 
-static void parseLine(char *fields[SAMRecord::NUM_FIELDS], char *line) {
-    char *c = line;
-    char *pc = c;
-    int f = 0;
-
-    while (true) {
-        if (*c == '\t' || *c == '\0') {
-            *c = '\0';
-            if (f ==  0) fields[f] = pc;
-            if (f ==  1) fields[f] = pc;
-            if (f ==  2) fields[f] = pc;
-            if (f ==  3) fields[f] = pc;
-            if (f ==  4) fields[f] = pc;
-            if (f ==  5) fields[f] = pc;
-            if (f ==  6) fields[f] = pc;
-            if (f ==  7) fields[f] = pc;
-            if (f ==  8) fields[f] = pc;
-            if (f ==  9) fields[f] = pc;
-            if (f == 10) fields[f] = pc;
-            if (f == 11) fields[f] = pc;
-            f++;
-            if (f == 12) { break; }
-            pc = c + 1;
-        }
-        c++;
-    }
-
-    if (f == 11) { fields[f] = pc; }
-}
+namespace calq {
 
 SAMFile::SAMFile(const std::string &path, const Mode &mode)
     : File(path, mode),
       currentBlock(),
       header(""),
       line_(NULL),
+      tabs_(),
+      nrTabs_(0),
+      map_(NULL),
+      mapSize_(0),
+      mapPos_(0),
+      bamReader_(),
+      bamLine_(""),
+      completeBamRecords_(false),
+      hasUnreadLine_(false),
+      unreadLine_(),
+      unreadLineBuffer_(""),
+      unreadLinePosition_(0),
+      rnames_(),
+      rnameIds_(),
+      rnameIdPrev_(0),
+      rawLineLength_(0),
+      blockPosition_(NO_POSITION),
       nrBlocksRead_(0),
       nrMappedRecordsRead_(0),
       nrUnmappedRecordsRead_(0),
@@ -67,34 +61,55 @@ SAMFile::SAMFile(const std::string &path, const Mode &mode)
         throwErrorException("malloc failed");
     }
 
+    // BAM input is detected by its BGZF magic
+    if (BGZFReader::isBGZF(fp_) == true) {
+        CALQ_LOG("Reading BAM input");
+        bamReader_.reset(new BAMReader(fp_));
+        bamReader_->readHeader(&header);
+        if (header.empty() == true) {
+            CALQ_LOG("No SAM header found");
+        }
+        return;
+    }
+
+#ifndef OS_WINDOWS
+    // Try to map the file into memory; fall back to fgets() otherwise
+    if (size() > 0) {
+        void *map = mmap(NULL, size(), PROT_READ, MAP_PRIVATE, fileno(fp_), 0);
+        if (map != MAP_FAILED) {
+            madvise(map, size(), MADV_SEQUENTIAL);
+            map_ = (const char *)map;
+            mapSize_ = size();
+        }
+    }
+#endif
+
     // Read SAM header
-    size_t fpos = tell();
     for (;;) {
-        fpos = tell();
-        if (fgets(line_, LINE_SIZE, fp_) != NULL) {
-            // Trim line
-            size_t l = strlen(line_) - 1;
-            while (l && (line_[l] == '\r' || line_[l] == '\n')) {
-                line_[l--] = '\0';
-            }
-
-            if (line_[0] == '@') {
-                header += line_;
+        StringView line;
+        if (readLine(&line) == true) {
+            if (line.empty() == false && line[0] == '@') {
+                header.append(line.data(), line.length());
                 header += "\n";
             } else {
+                unreadLine(line);  // first line of the alignment section
                 break;
             }
         } else {
             throwErrorException("Could not read SAM header");
         }
     }
-    seek(fpos);  // rewind to the begin of the alignment section
     if (header.empty() == true) {
         CALQ_LOG("No SAM header found");
     }
 }
 
 SAMFile::~SAMFile(void) {
+#ifndef OS_WINDOWS
+    if (map_ != NULL) {
+        munmap((void *)map_, mapSize_);
+    }
+#endif
     free(line_);
 }
 
@@ -121,34 +136,33 @@ size_t SAMFile::readBlock(const size_t &blockSize) {
 
     currentBlock.reset();
 
-    std::string rnamePrev("");
+    if (canSetPosition() == false) {
+        blockPosition_ = NO_POSITION;
+    } else {
+        blockPosition_ = (hasUnreadLine_ == true) ? unreadLinePosition_ : position();
+    }
+
+    bool mappedRecordRead = false;
+    uint32_t rnameIdPrev = SAMRecord::NO_RNAME_ID;
     uint32_t posPrev = 0;
 
     for (size_t i = 0; i < blockSize; i++) {
-        size_t fpos = tell();
-        if (fgets(line_, LINE_SIZE, fp_) != NULL) {
-            // Trim line
-            size_t l = strlen(line_) - 1;
-            while (l && (line_[l] == '\r' || line_[l] == '\n')) {
-                line_[l--] = '\0';
-            }
-
-            // Parse line and construct samRecord
-            char *fields[SAMRecord::NUM_FIELDS];
-            parseLine(fields, line_);
-            SAMRecord samRecord(fields);
-
+        StringView line;
+        SAMRecord samRecord;
+        if (readRecord(&samRecord, &line) == true) {
             if (samRecord.isMapped() == true) {
-                if (rnamePrev.empty() == true) {
+                samRecord.rnameId = internRname(samRecord.rname);
+                if (mappedRecordRead == false) {
                     // This is the first mapped record in this block; just store
                     // its RNAME and POS and add it to the current block
-                    rnamePrev = samRecord.rname;
+                    mappedRecordRead = true;
+                    rnameIdPrev = samRecord.rnameId;
                     posPrev = samRecord.pos;
                     currentBlock.records.push_back(samRecord);
                     currentBlock.nrMappedRecords_++;
                 } else {
                     // We already have a mapped record in this block
-                    if (rnamePrev == samRecord.rname) {
+                    if (rnameIdPrev == samRecord.rnameId) {
                         // RNAME didn't change, check POS
                         if (samRecord.pos >= posPrev) {
                             // Everything fits, just update posPrev and push
@@ -160,8 +174,8 @@ size_t SAMFile::readBlock(const size_t &blockSize) {
                             throwErrorException("SAM file is not sorted");
                         }
                     } else {
-                        // RNAME changed, seek back and break
-                        seek(fpos);
+                        // RNAME changed, push the record back and break
+                        unreadRecord(line);
                         CALQ_LOG("RNAME changed - read only %zu record(s) (%zu requested)", currentBlock.nrRecords(), blockSize);
                         break;
                     }
@@ -185,16 +199,193 @@ size_t SAMFile::readBlock(const size_t &blockSize) {
     auto elapsedTime = std::chrono::steady_clock::now() - startTime_;
     auto elapsedTimeS = std::chrono::duration_cast<std::chrono::seconds>(elapsedTime).count();
     double elapsedTimeM = (double)elapsedTimeS / (double)60;
-    double processedPercentage = ((double)tell() / (double)size()) * 100;
-    auto remainingPercentage = 100 - processedPercentage;
-    CALQ_LOG("Processed: %.2f%% (elapsed: %.2f m), remaining: %.2f%% (~%.2f m)",
-             processedPercentage,
-             elapsedTimeM,
-             remainingPercentage,
-             elapsedTimeM * (remainingPercentage/processedPercentage));
+    if (size() > 0) {
+        double processedPercentage = ((double)position() / (double)size()) * 100;
+        auto remainingPercentage = 100 - processedPercentage;
+        CALQ_LOG("Processed: %.2f%% (elapsed: %.2f m), remaining: %.2f%% (~%.2f m)",
+                 processedPercentage,
+                 elapsedTimeM,
+                 remainingPercentage,
+                 elapsedTimeM * (remainingPercentage/processedPercentage));
+    } else {
+        // Streaming input, the total size is unknown
+        CALQ_LOG("Processed: %zu record(s) (elapsed: %.2f m)", nrRecordsRead(), elapsedTimeM);
+    }
 
     return currentBlock.nrRecords();
 }
 
+size_t SAMFile::blockPosition(void) const {
+    return blockPosition_;
+}
+
+bool SAMFile::canSetPosition(void) const {
+    return (!bamReader_ && isSeekable() == true);
+}
+
+void SAMFile::setPosition(const size_t &position) {
+    if (canSetPosition() == false || position == NO_POSITION) {
+        throwErrorException("Cannot set position in this file");
+    }
+
+    hasUnreadLine_ = false;
+    if (map_ != NULL) {
+        if (position > mapSize_) {
+            throwErrorException("position out of range");
+        }
+        mapPos_ = position;
+    } else {
+        seek(position);
+    }
+}
+
+void SAMFile::setThreadPool(ThreadPool *threadPool) {
+    if (bamReader_) {
+        bamReader_->setThreadPool(threadPool);
+    }
+}
+
+void SAMFile::setCompleteBamRecords(const bool &completeBamRecords) {
+    completeBamRecords_ = completeBamRecords;
+}
+
+uint32_t SAMFile::internRname(const StringView &rname) {
+    if (rnames_.empty() == false) {
+        const std::string &rnamePrev = rnames_[rnameIdPrev_];
+        if (StringView(rnamePrev.data(), rnamePrev.length()) == rname) {
+            return rnameIdPrev_;
+        }
+    }
+
+    std::string name = rname.str();
+    auto it = rnameIds_.find(name);
+    if (it == rnameIds_.end()) {
+        it = rnameIds_.insert(std::make_pair(name, (uint32_t)rnames_.size())).first;
+        rnames_.push_back(name);
+    }
+    rnameIdPrev_ = it->second;
+    return rnameIdPrev_;
+}
+
+// Reads the next record; line is set to the SAM line of the record, or left
+// empty if the record was read directly from BAM input
+bool SAMFile::readRecord(SAMRecord *samRecord, StringView *line) {
+    if (bamReader_ && completeBamRecords_ == false) {
+        return bamReader_->readRecord(samRecord, &currentBlock);
+    }
+
+    if (readLine(line) == false) {
+        return false;
+    }
+
+    // Lines which are not backed by the mapping live in line_ or bamLine_,
+    // which are overwritten by the next line; hence keep a copy
+    if (map_ == NULL) {
+        const char *copy = currentBlock.store(line->data(), line->length());
+        for (size_t t = 0; t < nrTabs_; t++) {
+            tabs_[t] = copy + (tabs_[t] - line->data());
+        }
+        *line = StringView(copy, line->length());
+    }
+
+    // Parse line and construct samRecord
+    StringView fields[SAMRecord::NUM_FIELDS];
+    parseLine(fields, *line);
+    *samRecord = SAMRecord(fields);
+    return true;
+}
+
+void SAMFile::unreadRecord(const StringView &line) {
+    if (bamReader_ && completeBamRecords_ == false) {
+        bamReader_->unreadRecord();
+    } else {
+        unreadLine(line);
+    }
+}
+
+bool SAMFile::readLine(StringView *line) {
+    size_t length = 0;
+    const char *data = NULL;
+
+    if (hasUnreadLine_ == true) {
+        hasUnreadLine_ = false;
+        *line = unreadLine_;
+        scanLine(line->begin(), line->end(), tabs_, SAMRecord::NUM_FIELDS-1, &nrTabs_);
+        return true;
+    }
+
+    // Find the end of the line and the field separators in one pass
+    if (bamReader_) {
+        if (bamReader_->readRecord(&bamLine_) == false) {
+            return false;
+        }
+        data = bamLine_.data();
+        length = bamLine_.length();
+        scanLine(data, data + length, tabs_, SAMRecord::NUM_FIELDS-1, &nrTabs_);
+    } else if (map_ != NULL) {
+        if (mapPos_ >= mapSize_) {
+            return false;
+        }
+        data = map_ + mapPos_;
+        const char *newline = scanLine(data, map_ + mapSize_, tabs_, SAMRecord::NUM_FIELDS-1, &nrTabs_);
+        length = (size_t)(newline - data);
+        rawLineLength_ = (newline == (map_ + mapSize_)) ? length : (length + 1);
+        mapPos_ += rawLineLength_;
+    } else {
+        if (fgets(line_, LINE_SIZE, fp_) == NULL) {
+            return false;
+        }
+        data = line_;
+        length = strlen(line_);
+        rawLineLength_ = length;
+        scanLine(data, data + length, tabs_, SAMRecord::NUM_FIELDS-1, &nrTabs_);
+    }
+
+    // Trim line
+    while (length > 0 && (data[length-1] == '\r' || data[length-1] == '\n')) {
+        length--;
+    }
+
+    *line = StringView(data, length);
+    return true;
+}
+
+// Splits line into the SAM fields without modifying it, using the tabs found
+// by readLine(); the last field holds all optional fields. Missing fields are
+// left empty.
+void SAMFile::parseLine(StringView fields[SAMRecord::NUM_FIELDS], const StringView &line) const {
+    const char *c = line.begin();
+    for (int f = 0; f < SAMRecord::NUM_FIELDS; f++) {
+        if ((size_t)f < nrTabs_) {
+            fields[f] = StringView(c, tabs_[f] - c);
+            c = tabs_[f] + 1;
+        } else {
+            fields[f] = StringView(c, line.end() - c);
+            c = line.end();
+        }
+    }
+}
+
+size_t SAMFile::position(void) const {
+    return (map_ != NULL) ? mapPos_ : tell();
+}
+
+void SAMFile::unreadLine(const StringView &line) {
+    if (hasUnreadLine_ == true) {
+        throwErrorException("Only one line can be pushed back");
+    }
+    if (canSetPosition() == true) {
+        unreadLinePosition_ = position() - rawLineLength_;
+    }
+
+    if (map_ != NULL) {
+        unreadLine_ = line;
+    } else {
+        unreadLineBuffer_.assign(line.data(), line.length());
+        unreadLine_ = StringView(unreadLineBuffer_.data(), unreadLineBuffer_.length());
+    }
+    hasUnreadLine_ = true;
+}
+
 }  // namespace calq
 
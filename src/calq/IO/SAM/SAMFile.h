@@ -8,14 +8,23 @@
 #define CALQ_IO_SAM_SAMFILE_H_
 
 #include <chrono>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "Common/constants.h"
+#include "Common/StringView.h"
+#include "Common/ThreadPool.h"
+#include "IO/BAM/BAMReader.h"
 #include "IO/File.h"
 #include "IO/SAM/SAMBlock.h"
 
 namespace calq {
 
+// Reads SAM files and BAM files (which are detected by their BGZF magic);
+// BAM records are read directly into SAMRecord objects, or converted to SAM
+// lines if complete records are needed
 class SAMFile : public File {
  public:
     explicit SAMFile(const std::string &path, const Mode &mode = MODE_READ);
@@ -27,13 +36,71 @@ class SAMFile : public File {
     size_t nrRecordsRead(void) const;
     size_t readBlock(const size_t &blockSize);
 
+    // Byte offset of the first line of the current block, or NO_POSITION if
+    // the input cannot be seeked (BAM input or stdin); a position returned
+    // here can later be passed to setPosition()
+    static const size_t NO_POSITION = (size_t)-1;
+    size_t blockPosition(void) const;
+    bool canSetPosition(void) const;
+    void setPosition(const size_t &position);
+
+    // Optional thread pool used to decompress BAM input ahead of the parser
+    void setThreadPool(ThreadPool *threadPool);
+
+    // Records read from BAM input lack the CIGAR string, RNEXT, PNEXT, TLEN
+    // and the optional fields unless complete records are requested, e.g.,
+    // to write them as SAM lines
+    void setCompleteBamRecords(const bool &completeBamRecords);
+
     SAMBlock currentBlock;
     std::string header;
 
  private:
     static const size_t LINE_SIZE = sizeof(char) * (1*MB);
 
+    uint32_t internRname(const StringView &rname);
+    bool readRecord(SAMRecord *samRecord, StringView *line);
+    void unreadRecord(const StringView &line);
+    bool readLine(StringView *line);
+    void unreadLine(const StringView &line);
+    void parseLine(StringView fields[SAMRecord::NUM_FIELDS], const StringView &line) const;
+    size_t position(void) const;
+
     char *line_;
+
+    // Tabs in the line returned by the last call to readLine()
+    const char *tabs_[SAMRecord::NUM_FIELDS-1];
+    size_t nrTabs_;
+
+    // If the file could be memory-mapped the records are views into the
+    // mapping; otherwise the lines are read with fgets() and copied to the
+    // current block
+    const char *map_;
+    size_t mapSize_;
+    size_t mapPos_;
+
+    // BAM input
+    std::unique_ptr<BAMReader> bamReader_;
+    std::string bamLine_;
+    bool completeBamRecords_;
+
+    // Line pushed back by unreadLine(); it is copied unless it is a view
+    // into the mapping
+    bool hasUnreadLine_;
+    StringView unreadLine_;
+    std::string unreadLineBuffer_;
+    size_t unreadLinePosition_;
+
+    // Interned RNAMEs of the mapped records: the names in order of their
+    // first appearance, the id of each name, and the id of the last name
+    // looked up (as consecutive records mostly share the RNAME)
+    std::vector<std::string> rnames_;
+    std::map<std::string, uint32_t> rnameIds_;
+    uint32_t rnameIdPrev_;
+
+    size_t rawLineLength_;  // bytes consumed by the last call to readLine()
+    size_t blockPosition_;
+
     size_t nrBlocksRead_;
     size_t nrMappedRecordsRead_;
     size_t nrUnmappedRecordsRead_;
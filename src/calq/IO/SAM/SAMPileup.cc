@@ -10,10 +10,45 @@
 
 namespace calq {
 
-SAMPileup::SAMPileup(void) : pos(0), qual(""), seq("") {}
+static const size_t NR_BASE_CLASSES = 5;  // A, C, G, T and everything else
+
+static size_t baseClass(const char &base) {
+    switch (base) {
+    case 'A': return 0;
+    case 'C': return 1;
+    case 'G': return 2;
+    case 'T': return 3;
+    default: return 4;
+    }
+}
+
+SAMPileup::SAMPileup(void) : SAMPileup(true) {}
+
+SAMPileup::SAMPileup(const bool &histogram)
+    : pos(0),
+      qual(""),
+      seq(""),
+      counts(),
+      pairIndices_(),
+      depth_(0),
+      histogram_(histogram) {}
 
 SAMPileup::~SAMPileup(void) {}
 
+void SAMPileup::add(const char &base, const char &qualityValue) {
+    depth_++;
+    if (counts.empty() == false) {
+        addToHistogram(base, qualityValue);
+        return;
+    }
+
+    seq += base;
+    qual += qualityValue;
+    if (histogram_ == true && depth_ > HISTOGRAM_DEPTH) {
+        convertToHistogram();
+    }
+}
+
 bool SAMPileup::empty(void) const {
     if (seq.empty() == true)
         return true;
@@ -24,6 +59,19 @@ void SAMPileup::clear(void) {
     pos = 0;
     qual = "";
     seq = "";
+    counts.clear();
+    pairIndices_.clear();
+    depth_ = 0;
+}
+
+size_t SAMPileup::depth(void) const {
+    return depth_;
+}
+
+bool SAMPileup::isHistogram(void) const {
+    if (counts.empty() == true)
+        return false;
+    return true;
 }
 
 void SAMPileup::print(void) const {
@@ -38,5 +86,27 @@ void SAMPileup::printSeq(void) const {
     printf("%6d: %s\n", pos, seq.c_str());
 }
 
-}  // namespace calq
+void SAMPileup::addToHistogram(const char &base, const char &qualityValue) {
+    uint16_t &pairIndex = pairIndices_[(baseClass(base) << 8) | (unsigned char)qualityValue];
+    if (pairIndex == 0) {
+        seq += base;
+        qual += qualityValue;
+        counts.push_back(0);
+        pairIndex = (uint16_t)counts.size();
+    }
+    counts[pairIndex-1]++;
+}
 
+void SAMPileup::convertToHistogram(void) {
+    std::string bases;
+    std::string qualityValues;
+    bases.swap(seq);
+    qualityValues.swap(qual);
+
+    pairIndices_.assign(NR_BASE_CLASSES << 8, 0);
+    for (size_t i = 0; i < bases.length(); i++) {
+        addToHistogram(bases[i], qualityValues[i]);
+    }
+}
+
+}  // namespace calq
@@ -7,27 +7,54 @@
 #ifndef CALQ_IO_SAM_SAMPILEUP_H_
 #define CALQ_IO_SAM_SAMPILEUP_H_
 
+#include <stdint.h>
+
 #include <string>
+#include <vector>
 
 namespace calq {
 
+// A pileup column stores its bases and quality values in seq and qual, in
+// the order in which they were added. Once the depth exceeds
+// HISTOGRAM_DEPTH (and unless this is disabled on construction), the column
+// is turned into a histogram: seq and qual then
+// hold each distinct (base, quality value) pair once, and counts holds the
+// number of its occurrences. Bases other than A, C, G and T are not
+// distinguished in the histogram (the genotyper treats them alike), so its
+// size is bounded regardless of the depth.
 class SAMPileup {
  public:
     SAMPileup(void);
+    explicit SAMPileup(const bool &histogram);
     ~SAMPileup(void);
 
+    void add(const char &base, const char &qualityValue);
     bool empty(void) const;
     void clear(void);
+    size_t depth(void) const;
+    bool isHistogram(void) const;
     void print(void) const;
     void printQual(void) const;
     void printSeq(void) const;
 
+    static const size_t HISTOGRAM_DEPTH = 1024;
+
     uint32_t pos;  // 0-based position of this pileup
     std::string qual;
     std::string seq;
+    std::vector<uint32_t> counts;  // empty unless isHistogram()
+
+ private:
+    void addToHistogram(const char &base, const char &qualityValue);
+    void convertToHistogram(void);
+
+    // For each base class (A, C, G, T, other) and quality value character,
+    // 1 + the index of the pair in seq/qual, or 0 if it does not occur
+    std::vector<uint16_t> pairIndices_;
+    size_t depth_;
+    bool histogram_;  // whether to turn into a histogram beyond HISTOGRAM_DEPTH
 };
 
 }  // namespace calq
 
 #endif  // CALQ_IO_SAM_SAMPILEUP_H_
-
@@ -0,0 +1,294 @@
+/** @file SAMPileupRing.cc
+ *  @brief This file contains the implementation of the SAMPileupRing class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include "IO/SAM/SAMPileupRing.h"
+
+#include <string>
+#include <utility>
+
+#include "Common/Exceptions.h"
+
+namespace calq {
+
+static const uint8_t OTHER_BASE_FLAG = 0x80;  // in the quality value bytes
+
+static const char BASES[4] = {'A', 'C', 'G', 'T'};
+
+SAMPileupRing::SAMPileupRing(void) : SAMPileupRing(true) {}
+
+SAMPileupRing::SAMPileupRing(const bool &histograms)
+    : columns_(NR_SLOTS_MIN, Column()),
+      bases_(),
+      qualityValues_(),
+      deepColumns_(),
+      freeSlabs_(),
+      histograms_(histograms),
+      head_(0),
+      size_(0),
+      posMax_(0),
+      posMin_(0) {}
+
+SAMPileupRing::~SAMPileupRing(void) {}
+
+void SAMPileupRing::add(const uint32_t &pos, const char *seq, const char *qual, const size_t &length) {
+    if (length == 0) {
+        return;
+    }
+    if ((pos < posMin_) || ((pos - posMin_ + length) > size_)) {
+        throwErrorException("Position out of pileup range");
+    }
+
+    size_t n = pos - posMin_;
+    for (size_t i = 0; i < length; i++, n++) {
+        Column &column = columns_[slot(n)];
+        const uint32_t depth = column.depth;
+        const char base = seq[i];
+        const uint8_t q = (uint8_t)qual[i];
+
+        if ((q & OTHER_BASE_FLAG) != 0) {
+            throwErrorException("Quality value out of range");
+        }
+
+        uint8_t code = 0;
+        uint8_t flag = 0;
+        switch (base) {
+        case 'A': code = 0; break;
+        case 'C': code = 1; break;
+        case 'G': code = 2; break;
+        case 'T': code = 3; break;
+        default: flag = OTHER_BASE_FLAG; break;
+        }
+
+        if (column.slab == 0) {
+            column.slab = allocateSlab() + 1;
+        }
+        const size_t slab = column.slab - 1;
+
+        if (depth >= SLAB_DEPTH) {
+            if (depth == SLAB_DEPTH) {
+                moveToDeepColumn(slab);
+            }
+            deepColumns_[slab]->add((flag == 0) ? base : 'N', (char)q);
+            column.depth = depth + 1;
+            continue;
+        }
+
+        qualityValues_[(slab * SLAB_DEPTH) + depth] = q | flag;
+        uint8_t &packed = bases_[(slab * (SLAB_DEPTH / 4)) + (depth / 4)];
+        if ((depth & 3) == 0) {
+            packed = code;
+        } else {
+            packed |= (uint8_t)(code << (2 * (depth & 3)));
+        }
+        column.depth = depth + 1;
+    }
+}
+
+void SAMPileupRing::clear(void) {
+    for (size_t n = 0; n < size_; n++) {
+        releaseColumn(slot(n));
+    }
+    head_ = 0;
+    size_ = 0;
+    posMax_ = 0;
+    posMin_ = 0;
+
+    if (columns_.size() > NR_SLOTS_MIN) {
+        std::vector<Column>(NR_SLOTS_MIN, Column()).swap(columns_);
+    }
+    std::vector<uint8_t>().swap(bases_);
+    std::vector<uint8_t>().swap(qualityValues_);
+    std::vector< std::unique_ptr<SAMPileup> >().swap(deepColumns_);
+    std::vector<uint32_t>().swap(freeSlabs_);
+}
+
+bool SAMPileupRing::empty(void) const {
+    if (size_ == 0)
+        return true;
+    return false;
+}
+
+size_t SAMPileupRing::length(void) const {
+    return posMax_ - posMin_ + 1;
+}
+
+void SAMPileupRing::pop_front(void) {
+    if (empty() == true) {
+        throwErrorException("Ring is empty");
+    }
+    releaseColumn(head_);
+    head_ = slot(1);
+    size_--;
+    posMin_++;
+}
+
+size_t SAMPileupRing::frontDepth(void) const {
+    if (empty() == true) {
+        throwErrorException("Ring is empty");
+    }
+    return columns_[head_].depth;
+}
+
+bool SAMPileupRing::frontIsHistogram(void) const {
+    if (frontDepth() > SLAB_DEPTH && deepColumns_[columns_[head_].slab - 1]->isHistogram() == true)
+        return true;
+    return false;
+}
+
+const SAMPileup & SAMPileupRing::frontHistogram(void) const {
+    if (frontIsHistogram() == false) {
+        throwErrorException("Front column is not a histogram");
+    }
+    return *deepColumns_[columns_[head_].slab - 1];
+}
+
+void SAMPileupRing::unpackFront(std::string *seq, std::string *qual) const {
+    if (frontIsHistogram() == true) {
+        throwErrorException("Front column is a histogram");
+    }
+    unpack(head_, seq, qual);
+}
+
+uint32_t SAMPileupRing::posMax(void) const {
+    return posMax_;
+}
+
+uint32_t SAMPileupRing::posMin(void) const {
+    return posMin_;
+}
+
+void SAMPileupRing::setPosMax(const uint32_t &posMax) {
+    if (posMax < posMax_) {
+        throwErrorException("posMax range");
+    }
+    posMax_ = posMax;
+
+    // The slots are not given back while the window is drained by
+    // pop_front(), as it is usually extended again right after
+    size_t size = (posMax_ >= posMin_) ? (posMax_ - posMin_ + 1) : 0;
+    size_t nrSlots = columns_.size();
+    while (nrSlots < size) {
+        nrSlots *= 2;
+    }
+    while (nrSlots > NR_SLOTS_MIN && size < (nrSlots / 4)) {
+        nrSlots /= 2;
+    }
+    if (nrSlots != columns_.size()) {
+        resize(nrSlots);
+    }
+    size_ = size;
+}
+
+void SAMPileupRing::setPosMin(const uint32_t &posMin) {
+    if (posMin < posMin_) {
+        throwErrorException("posMin range");
+    }
+
+    if (empty() == true) {
+        posMin_ = posMin;
+    } else {
+        for (uint32_t i = posMin_; i < posMin ; i++) { pop_front(); }
+    }
+}
+
+size_t SAMPileupRing::nrSlots(void) const {
+    return columns_.size();
+}
+
+size_t SAMPileupRing::nrSlabs(void) const {
+    return deepColumns_.size();
+}
+
+uint32_t SAMPileupRing::allocateSlab(void) {
+    if (freeSlabs_.empty() == false) {
+        uint32_t slab = freeSlabs_.back();
+        freeSlabs_.pop_back();
+        return slab;
+    }
+
+    uint32_t slab = (uint32_t)deepColumns_.size();
+    bases_.resize(bases_.size() + (SLAB_DEPTH / 4));
+    qualityValues_.resize(qualityValues_.size() + SLAB_DEPTH);
+    deepColumns_.push_back(std::unique_ptr<SAMPileup>());
+    return slab;
+}
+
+void SAMPileupRing::moveToDeepColumn(const size_t &slab) {
+    std::unique_ptr<SAMPileup> &deepColumn = deepColumns_[slab];
+    if (deepColumn == NULL) {
+        deepColumn.reset(new SAMPileup(histograms_));
+    }
+
+    const uint8_t *bases = &bases_[slab * (SLAB_DEPTH / 4)];
+    const uint8_t *qualityValues = &qualityValues_[slab * SLAB_DEPTH];
+    for (size_t d = 0; d < SLAB_DEPTH; d++) {
+        uint8_t q = qualityValues[d];
+        char base = 'N';
+        if ((q & OTHER_BASE_FLAG) == 0) {
+            base = BASES[(bases[d / 4] >> (2 * (d & 3))) & 3];
+        }
+        deepColumn->add(base, (char)(q & ~OTHER_BASE_FLAG));
+    }
+}
+
+void SAMPileupRing::releaseColumn(const size_t &s) {
+    Column &column = columns_[s];
+    if (column.slab != 0) {
+        const uint32_t slab = column.slab - 1;
+        if (column.depth > SLAB_DEPTH) {
+            deepColumns_[slab]->clear();
+        }
+        freeSlabs_.push_back(slab);
+    }
+    column.depth = 0;
+    column.slab = 0;
+}
+
+void SAMPileupRing::resize(const size_t &nrSlots) {
+    std::vector<Column> columns(nrSlots, Column());
+
+    // The columns are moved to the slots [0, size_)
+    for (size_t n = 0; n < size_; n++) {
+        columns[n] = columns_[slot(n)];
+    }
+
+    columns_.swap(columns);
+    head_ = 0;
+}
+
+size_t SAMPileupRing::slot(const size_t &n) const {
+    return (head_ + n) & (columns_.size() - 1);
+}
+
+void SAMPileupRing::unpack(const size_t &s, std::string *seq, std::string *qual) const {
+    const Column &column = columns_[s];
+    const size_t depth = column.depth;
+    if (depth > SLAB_DEPTH) {
+        seq->assign(deepColumns_[column.slab - 1]->seq);
+        qual->assign(deepColumns_[column.slab - 1]->qual);
+        return;
+    }
+
+    seq->resize(depth);
+    qual->resize(depth);
+    if (depth == 0) {
+        return;
+    }
+
+    const uint8_t *bases = &bases_[(column.slab - 1) * (SLAB_DEPTH / 4)];
+    const uint8_t *qualityValues = &qualityValues_[(column.slab - 1) * SLAB_DEPTH];
+    for (size_t d = 0; d < depth; d++) {
+        uint8_t q = qualityValues[d];
+        if ((q & OTHER_BASE_FLAG) != 0) {
+            (*seq)[d] = 'N';
+        } else {
+            (*seq)[d] = BASES[(bases[d / 4] >> (2 * (d & 3))) & 3];
+        }
+        (*qual)[d] = (char)(q & ~OTHER_BASE_FLAG);
+    }
+}
+
+}  // namespace calq
@@ -0,0 +1,105 @@
+/** @file SAMPileupRing.h
+ *  @brief This file contains the definition of the SAMPileupRing class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_IO_SAM_SAMPILEUPRING_H_
+#define CALQ_IO_SAM_SAMPILEUPRING_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "IO/SAM/SAMPileup.h"
+
+namespace calq {
+
+// Circular window of the pileup columns [posMin, posMax]. Every column
+// occupies a slot which holds its depth and, once the column has a base, the
+// index of a slab of SLAB_DEPTH bases in a pool of slabs: the bases are
+// packed with 2 bits each (A, C, G, T), and the quality values are stored as
+// bytes, where bit 7 marks a base other than A, C, G and T (which the
+// genotyper does not distinguish). A column which gets deeper than its slab
+// is moved into a SAMPileup attached to the slab (which, if histograms are
+// enabled, turns into a histogram beyond SAMPileup::HISTOGRAM_DEPTH).
+// Columns without bases, e.g. in the skipped region of a spliced read, thus
+// only cost their slot, and deep columns only cost memory where they occur.
+//
+// The slots and slabs are reused when the window slides. The number of slots
+// doubles if the window gets longer than it, and is reduced again when the
+// window is extended after having contracted to less than a quarter of it.
+//
+// The quality value characters must be less than 128, which holds for all
+// valid SAM quality values.
+class SAMPileupRing {
+ public:
+    SAMPileupRing(void);
+    explicit SAMPileupRing(const bool &histograms);
+    ~SAMPileupRing(void);
+
+    // Adds seq[i] and qual[i] to the column pos+i for all i < length
+    void add(const uint32_t &pos, const char *seq, const char *qual, const size_t &length);
+
+    // Removes all columns and releases the memory the ring has grown by
+    void clear(void);
+
+    bool empty(void) const;
+    size_t length(void) const;
+    void pop_front(void);
+
+    // Accessors of the column posMin
+    size_t frontDepth(void) const;
+    bool frontIsHistogram(void) const;
+    const SAMPileup & frontHistogram(void) const;
+    void unpackFront(std::string *seq, std::string *qual) const;
+
+    uint32_t posMax(void) const;
+    uint32_t posMin(void) const;
+
+    void setPosMax(const uint32_t &posMax);
+    void setPosMin(const uint32_t &posMin);
+
+    // Number of slots and of slabs currently allocated
+    size_t nrSlots(void) const;
+    size_t nrSlabs(void) const;
+
+ private:
+    struct Column {
+        uint32_t depth;
+        uint32_t slab;  // 1 + index of the slab, or 0 if the column has none
+    };
+
+    uint32_t allocateSlab(void);
+    void moveToDeepColumn(const size_t &slab);
+    void releaseColumn(const size_t &slot);
+    void resize(const size_t &nrSlots);
+    size_t slot(const size_t &n) const;
+    void unpack(const size_t &slot, std::string *seq, std::string *qual) const;
+
+    static const size_t NR_SLOTS_MIN = 512;
+    static const size_t SLAB_DEPTH = 32;
+
+    // Slots (a power of 2)
+    std::vector<Column> columns_;
+
+    // Slabs: SLAB_DEPTH/4 bytes of packed bases and SLAB_DEPTH quality
+    // values each, and the columns deeper than SLAB_DEPTH (NULL for slabs
+    // which have not been used by such a column yet)
+    std::vector<uint8_t> bases_;
+    std::vector<uint8_t> qualityValues_;
+    std::vector< std::unique_ptr<SAMPileup> > deepColumns_;
+    std::vector<uint32_t> freeSlabs_;
+
+    bool histograms_;
+    size_t head_;  // slot of posMin_
+    size_t size_;  // number of columns
+    uint32_t posMax_;
+    uint32_t posMin_;
+};
+
+}  // namespace calq
+
+#endif  // CALQ_IO_SAM_SAMPILEUPRING_H_
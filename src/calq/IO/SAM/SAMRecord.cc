@@ -10,118 +10,140 @@
 
 #include "Common/Exceptions.h"
 #include "Common/log.h"
+#include "IO/SAM/SAMTokenizer.h"
 
 namespace calq {
 
-SAMRecord::SAMRecord(char *fields[NUM_FIELDS])
+static int64_t parseInt(const StringView &field) {
+    return parseInt(field.begin(), field.end());
+}
+
+// Number of reference positions covered by a CIGAR string
+struct ReferenceSpanVisitor {
+    ReferenceSpanVisitor(void) : length(0) {}
+    void match(const uint32_t &opLength) { length += opLength; }
+    void insertion(const uint32_t &) {}
+    void deletion(const uint32_t &opLength) { length += opLength; }
+    uint32_t length;
+};
+
+// Adds the aligned bases of a record to a pileup
+struct PileupVisitor {
+    PileupVisitor(const SAMRecord &samRecord, SAMPileupRing *samPileupRing)
+        : samRecord(samRecord), samPileupRing(samPileupRing), idx(0), pileupPos(samRecord.posMin) {}
+    void match(const uint32_t &opLength) {
+        if ((idx + opLength) > samRecord.seq.length() || (idx + opLength) > samRecord.qual.length()) {
+            throwErrorException("CIGAR string does not match sequence length");
+        }
+        samPileupRing->add(pileupPos, samRecord.seq.data() + idx, samRecord.qual.data() + idx, opLength);
+        idx += opLength; pileupPos += opLength;
+    }
+    void insertion(const uint32_t &opLength) { idx += opLength; }
+    void deletion(const uint32_t &opLength) { pileupPos += opLength; }
+    const SAMRecord &samRecord;
+    SAMPileupRing *samPileupRing;
+    size_t idx;
+    uint32_t pileupPos;
+};
+
+SAMRecord::SAMRecord(const StringView fields[NUM_FIELDS])
     : qname(fields[0]),
-      flag((uint16_t)atoi(fields[1])),
+      flag((uint16_t)parseInt(fields[1])),
       rname(fields[2]),
-      pos((uint32_t)atoi(fields[3])),
-      mapq((uint8_t)atoi(fields[4])),
+      pos((uint32_t)parseInt(fields[3])),
+      mapq((uint8_t)parseInt(fields[4])),
       cigar(fields[5]),
       rnext(fields[6]),
-      pnext((uint32_t)atoi(fields[7])),
-      tlen((int64_t)atoi(fields[8])),
+      pnext((uint32_t)parseInt(fields[7])),
+      tlen(parseInt(fields[8])),
       seq(fields[9]),
       qual(fields[10]),
       opt(fields[11]),
       posMin(0),
       posMax(0),
+      cigarOps(),
+      rnameId(NO_RNAME_ID),
       mapped_(false) {
     check();
 
     if (mapped_ == true) {
-        // Compute 0-based first position and 0-based last position this record
-        // is mapped to on the reference used for alignment
-        posMin = pos - 1;
-        posMax = pos - 1;
-
-        size_t cigarIdx = 0;
-        size_t cigarLen = cigar.length();
-        uint32_t opLen = 0;  // length of current CIGAR operation
-
-        for (cigarIdx = 0; cigarIdx < cigarLen; cigarIdx++) {
-            if (isdigit(cigar[cigarIdx])) {
-                opLen = opLen * 10 + (uint32_t)cigar[cigarIdx] - (uint32_t)'0';
-                continue;
-            }
-            switch (cigar[cigarIdx]) {
-            case 'M':
-            case '=':
-            case 'X':
-                posMax += opLen;
-                break;
-            case 'I':
-            case 'S':
-                break;
-            case 'D':
-            case 'N':
-                posMax += opLen;
-                break;
-            case 'H':
-            case 'P':
-                break;  // these have been clipped
-            default:
-                throwErrorException("Bad CIGAR string");
-            }
-            opLen = 0;
-        }
+        cigarOps.parse(cigar);
+        computeSpan();
+    }
+}
+
+SAMRecord::SAMRecord(const StringView &qname,
+                     const uint16_t &flag,
+                     const StringView &rname,
+                     const uint32_t &pos,
+                     const uint8_t &mapq,
+                     const uint32_t *ops,
+                     const size_t &nrOps,
+                     const StringView &seq,
+                     const StringView &qual)
+    : qname(qname),
+      flag(flag),
+      rname(rname),
+      pos(pos),
+      mapq(mapq),
+      cigar(),
+      rnext(),
+      pnext(0),
+      tlen(0),
+      seq(seq),
+      qual(qual),
+      opt(),
+      posMin(0),
+      posMax(0),
+      cigarOps(),
+      rnameId(NO_RNAME_ID),
+      mapped_(false) {
+    if (qname.empty() == true) { throwErrorException("qname is empty"); }
+    if (rname.empty() == true) { throwErrorException("rname is empty"); }
+    if (seq.empty() == true) { throwErrorException("seq is empty"); }
+    if (qual.empty() == true) { throwErrorException("qual is empty"); }
 
-        posMax -= 1;
+    if ((flag & 0x4) == 0) {
+        mapped_ = true;
+        if (rname == "*" || pos == 0 || nrOps == 0 || seq == "*" || qual == "*") {
+            throwErrorException("Corrupted record");
+        }
+        cigarOps.assign(ops, nrOps);
+        computeSpan();
     }
 }
 
+SAMRecord::SAMRecord(void)
+    : qname(),
+      flag(0),
+      rname(),
+      pos(0),
+      mapq(0),
+      cigar(),
+      rnext(),
+      pnext(0),
+      tlen(0),
+      seq(),
+      qual(),
+      opt(),
+      posMin(0),
+      posMax(0),
+      cigarOps(),
+      rnameId(NO_RNAME_ID),
+      mapped_(false) {}
+
 SAMRecord::~SAMRecord(void) {}
 
-void SAMRecord::addToPileupQueue(SAMPileupDeque *samPileupDeque_) const {
-    if (samPileupDeque_->empty() == true) {
+void SAMRecord::addToPileupQueue(SAMPileupRing *samPileupRing) const {
+    if (samPileupRing->empty() == true) {
         throwErrorException("samPileupQueue is empty");
     }
-    if ((samPileupDeque_->posMin() > posMin) || (samPileupDeque_->posMax() < posMax)) {
+    if ((samPileupRing->posMin() > posMin) || (samPileupRing->posMax() < posMax)) {
         throwErrorException("samPileupQueue does not overlap record");
     }
 
-    size_t cigarIdx = 0;
-    size_t cigarLen = cigar.length();
-    size_t opLen = 0;  // length of current CIGAR operation
-    size_t idx = 0;
-    size_t pileupIdx = posMin - samPileupDeque_->posMin();
-
-    for (cigarIdx = 0; cigarIdx < cigarLen; cigarIdx++) {
-        if (isdigit(cigar[cigarIdx])) {
-            opLen = opLen*10 + (size_t)cigar[cigarIdx] - (size_t)'0';
-            continue;
-        }
-
-        switch (cigar[cigarIdx]) {
-        case 'M':
-        case '=':
-        case 'X':
-            for (size_t i = 0; i < opLen; i++) {
-                samPileupDeque_->pileups_[pileupIdx].pos = samPileupDeque_->posMin() + pileupIdx;
-                samPileupDeque_->pileups_[pileupIdx].seq += seq[idx];
-                samPileupDeque_->pileups_[pileupIdx].qual += qual[idx];
-                idx++; pileupIdx++;
-            }
-            break;
-        case 'I':
-        case 'S':
-            idx += opLen;
-            break;
-        case 'D':
-        case 'N':
-            pileupIdx += opLen;
-            break;
-        case 'H':
-        case 'P':
-            break;  // these have been clipped
-        default:
-            throwErrorException("Bad CIGAR string");
-        }
-
-        opLen = 0;
-    }
+    PileupVisitor pileup(*this, samPileupRing);
+    cigarOps.visit(&pileup);
 }
 
 bool SAMRecord::isMapped(void) const {
@@ -136,25 +158,25 @@ void SAMRecord::printLong(void) const {
 }
 
 void SAMRecord::printShort(void) const {
-    printf("%s\t", qname.c_str());
+    printf("%.*s\t", (int)qname.length(), qname.data());
     printf("%d\t", flag);
-    printf("%s\t", rname.c_str());
+    printf("%.*s\t", (int)rname.length(), rname.data());
     printf("%d\t", pos);
     printf("%d\t", mapq);
-    printf("%s\t", cigar.c_str());
-    printf("%s\t", rnext.c_str());
+    printf("%.*s\t", (int)cigar.length(), cigar.data());
+    printf("%.*s\t", (int)rnext.length(), rnext.data());
     printf("%d\t", pnext);
     printf("%" PRId64 "\t", tlen);
-    printf("%s\t", seq.c_str());
-    printf("%s\t", qual.c_str());
-    printf("%s\t", opt.c_str());
+    printf("%.*s\t", (int)seq.length(), seq.data());
+    printf("%.*s\t", (int)qual.length(), qual.data());
+    printf("%.*s\t", (int)opt.length(), opt.data());
     printf("\n");
 }
 
 void SAMRecord::printSeqWithPositionOffset(void) const {
-    printf("%s %6d-%6d|", rname.c_str(), posMin, posMax);
+    printf("%.*s %6d-%6d|", (int)rname.length(), rname.data(), posMin, posMax);
     for (unsigned int i = 0; i < posMin; i++) { printf(" "); }
-    printf("%s\n", seq.c_str());
+    printf("%.*s\n", (int)seq.length(), seq.data());
 }
 
 void SAMRecord::check(void) {
@@ -183,5 +205,14 @@ void SAMRecord::check(void) {
     }
 }
 
+// Computes the 0-based first position and 0-based last position this record
+// is mapped to on the reference used for alignment
+void SAMRecord::computeSpan(void) {
+    ReferenceSpanVisitor referenceSpan;
+    cigarOps.visit(&referenceSpan);
+    posMin = pos - 1;
+    posMax = pos - 1 + referenceSpan.length - 1;
+}
+
 }  // namespace calq
 
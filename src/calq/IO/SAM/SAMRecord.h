@@ -12,7 +12,9 @@
 #include <deque>
 #include <string>
 
-#include "IO/SAM/SAMPileupDeque.h"
+#include "Common/StringView.h"
+#include "IO/SAM/SAMCigar.h"
+#include "IO/SAM/SAMPileupRing.h"
 
 namespace calq {
 
@@ -20,34 +22,62 @@ class SAMRecord {
  public:
     static const int NUM_FIELDS = 12;
 
-    explicit SAMRecord(char *fields[NUM_FIELDS]);
+    // The fields are not copied; the records's string fields are views into
+    // the memory the fields point to, which must outlive the record
+    explicit SAMRecord(const StringView fields[NUM_FIELDS]);
+
+    // Record read from a BAM file, whose FLAG, POS, MAPQ and CIGAR are
+    // already binary; the CIGAR string, RNEXT, PNEXT, TLEN and the optional
+    // fields, which the codec does not need, are left empty
+    SAMRecord(const StringView &qname,
+              const uint16_t &flag,
+              const StringView &rname,
+              const uint32_t &pos,
+              const uint8_t &mapq,
+              const uint32_t *ops,
+              const size_t &nrOps,
+              const StringView &seq,
+              const StringView &qual);
+
+    SAMRecord(void);
     ~SAMRecord(void);
 
-    void addToPileupQueue(SAMPileupDeque *samPileupDeque) const;
+    void addToPileupQueue(SAMPileupRing *samPileupRing) const;
 
     bool isMapped(void) const;
     void printLong(void) const;
     void printShort(void) const;
     void printSeqWithPositionOffset(void) const;
 
-    std::string qname;  // Query template NAME
-    uint16_t    flag;   // bitwise FLAG (uint16_t)
-    std::string rname;  // Reference sequence NAME
-    uint32_t    pos;    // 1-based leftmost mapping POSition (uint32_t)
-    uint8_t     mapq;   // MAPping Quality (uint8_t)
-    std::string cigar;  // CIGAR string
-    std::string rnext;  // Ref. name of the mate/NEXT read
-    uint32_t    pnext;  // Position of the mate/NEXT read (uint32_t)
-    int64_t     tlen;   // observed Template LENgth (int64_t)
-    std::string seq;    // segment SEQuence
-    std::string qual;   // QUALity scores
-    std::string opt;    // OPTional information
+    StringView qname;  // Query template NAME
+    uint16_t   flag;   // bitwise FLAG (uint16_t)
+    StringView rname;  // Reference sequence NAME
+    uint32_t   pos;    // 1-based leftmost mapping POSition (uint32_t)
+    uint8_t    mapq;   // MAPping Quality (uint8_t)
+    StringView cigar;  // CIGAR string (empty for BAM records, see cigarOps)
+    StringView rnext;  // Ref. name of the mate/NEXT read
+    uint32_t   pnext;  // Position of the mate/NEXT read (uint32_t)
+    int64_t    tlen;   // observed Template LENgth (int64_t)
+    StringView seq;    // segment SEQuence
+    StringView qual;   // QUALity scores
+    StringView opt;    // OPTional information
 
     uint32_t posMin;  // 0-based leftmost mapping position
     uint32_t posMax;  // 0-based rightmost mapping position
 
+    // Parsed CIGAR string, or the CIGAR of a BAM record (only for mapped
+    // records)
+    SAMCigar cigarOps;
+
+    // Id of the RNAME of mapped records, or NO_RNAME_ID; SAMFile assigns the
+    // ids in the order in which the RNAMEs first occur, so records with the
+    // same id have the same RNAME
+    static const uint32_t NO_RNAME_ID = UINT32_MAX;
+    uint32_t rnameId;
+
  private:
     void check(void);
+    void computeSpan(void);
 
  private:
     bool mapped_;
@@ -0,0 +1,168 @@
+/** @file SAMTokenizer.cc
+ *  @brief This file contains the implementation of the SAM tokenizer.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include "IO/SAM/SAMTokenizer.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CALQ_SAMTOKENIZER_X86
+#include <immintrin.h>
+#endif
+
+namespace calq {
+
+typedef const char * (*ScanLineFunction)(const char *, const char *, const char **, const size_t &, size_t *);
+
+static const char * scanLineScalar(const char *begin,
+                                   const char *end,
+                                   const char **tabs,
+                                   const size_t &maxTabs,
+                                   size_t *nrTabs) {
+    for (const char *c = begin; c < end; c++) {
+        if (*c == '\n') {
+            return c;
+        }
+        if (*c == '\t' && *nrTabs < maxTabs) {
+            tabs[(*nrTabs)++] = c;
+        }
+    }
+    return end;
+}
+
+#ifdef CALQ_SAMTOKENIZER_X86
+
+// Consumes the tab/newline bit masks of a chunk starting at chunk; returns
+// the newline position if the chunk contains one, NULL otherwise
+static inline const char * processMasks(const char *chunk,
+                                        uint32_t tabMask,
+                                        const uint32_t &newlineMask,
+                                        const char **tabs,
+                                        const size_t &maxTabs,
+                                        size_t *nrTabs) {
+    const char *newline = NULL;
+    if (newlineMask != 0) {
+        int newlineIdx = __builtin_ctz(newlineMask);
+        newline = chunk + newlineIdx;
+        tabMask &= ((1u << newlineIdx) - 1);  // only tabs before the newline
+    }
+    while (tabMask != 0 && *nrTabs < maxTabs) {
+        tabs[(*nrTabs)++] = chunk + __builtin_ctz(tabMask);
+        tabMask &= (tabMask - 1);
+    }
+    return newline;
+}
+
+static const char * scanLineSse2(const char *begin,
+                                 const char *end,
+                                 const char **tabs,
+                                 const size_t &maxTabs,
+                                 size_t *nrTabs) {
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    const char *c = begin;
+    for (; (end - c) >= 16; c += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)c);
+        uint32_t tabMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, tab));
+        uint32_t newlineMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+        const char *nl = processMasks(c, tabMask, newlineMask, tabs, maxTabs, nrTabs);
+        if (nl != NULL) {
+            return nl;
+        }
+    }
+
+    return scanLineScalar(c, end, tabs, maxTabs, nrTabs);
+}
+
+__attribute__((target("avx2")))
+static const char * scanLineAvx2(const char *begin,
+                                 const char *end,
+                                 const char **tabs,
+                                 const size_t &maxTabs,
+                                 size_t *nrTabs) {
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    const char *c = begin;
+    for (; (end - c) >= 32; c += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)c);
+        uint32_t tabMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, tab));
+        uint32_t newlineMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline));
+        const char *nl = processMasks(c, tabMask, newlineMask, tabs, maxTabs, nrTabs);
+        if (nl != NULL) {
+            return nl;
+        }
+    }
+
+    return scanLineSse2(c, end, tabs, maxTabs, nrTabs);
+}
+
+#endif  // CALQ_SAMTOKENIZER_X86
+
+static ScanLineFunction selectScanLine(void) {
+#ifdef CALQ_SAMTOKENIZER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return scanLineAvx2;
+    }
+    return scanLineSse2;
+#else
+    return scanLineScalar;
+#endif
+}
+
+const char * scanLine(const char *begin,
+                      const char *end,
+                      const char **tabs,
+                      const size_t &maxTabs,
+                      size_t *nrTabs) {
+    static const ScanLineFunction scanLineImpl = selectScanLine();
+    *nrTabs = 0;
+    return scanLineImpl(begin, end, tabs, maxTabs, nrTabs);
+}
+
+int64_t parseInt(const char *begin, const char *end) {
+    const char *c = begin;
+    bool negative = false;
+    if (c < end && (*c == '-' || *c == '+')) {
+        negative = (*c == '-');
+        c++;
+    }
+
+    size_t length = (size_t)(end - c);
+    int64_t value = 0;
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    // Convert up to 8 digits at once (SWAR): the digits are moved to the
+    // upper bytes of a word, the lower bytes are filled with '0'
+    if (length > 0 && length <= 8) {
+        uint64_t word = 0;
+        memcpy(&word, c, length);
+        word <<= 8 * (8 - length);
+        if (length < 8) {
+            word |= (0x3030303030303030ULL >> (8 * length));
+        }
+        if ((word & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL
+            && ((word + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL) {
+            word -= 0x3030303030303030ULL;
+            word = (word * 10 + (word >> 8)) & 0x00FF00FF00FF00FFULL;
+            word = (word * 100 + (word >> 16)) & 0x0000FFFF0000FFFFULL;
+            word = (word * 10000 + (word >> 32)) & 0x00000000FFFFFFFFULL;
+            value = (int64_t)word;
+            return (negative == true) ? -value : value;
+        }
+    }
+#endif
+
+    for (; c < end && *c >= '0' && *c <= '9'; c++) {
+        value = value*10 + (*c - '0');
+    }
+
+    return (negative == true) ? -value : value;
+}
+
+}  // namespace calq
@@ -0,0 +1,35 @@
+/** @file SAMTokenizer.h
+ *  @brief This file contains functions for splitting SAM lines into fields
+ *         and for parsing the integer fields.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_IO_SAM_SAMTOKENIZER_H_
+#define CALQ_IO_SAM_SAMTOKENIZER_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+namespace calq {
+
+// Scans [begin,end) for the first newline and returns a pointer to it, or
+// end if there is none. Pointers to the first maxTabs tabs before the newline
+// are stored in tabs, and their number in nrTabs.
+//
+// On x86 the scan is done 32 (AVX2) or 16 (SSE2) bytes at a time; the
+// implementation is selected at runtime.
+const char * scanLine(const char *begin,
+                      const char *end,
+                      const char **tabs,
+                      const size_t &maxTabs,
+                      size_t *nrTabs);
+
+// Parses a decimal integer with an optional sign from [begin,end), stopping
+// at the first non-digit (like atoi(), but bounded and without requiring a
+// terminating NUL; leading whitespace is not skipped)
+int64_t parseInt(const char *begin, const char *end);
+
+}  // namespace calq
+
+#endif  // CALQ_IO_SAM_SAMTOKENIZER_H_
@@ -8,13 +8,166 @@
 
 #include <math.h>
 
-#include <utility>
+#include <string>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GENOTYPER_X86
+#include <immintrin.h>
+#endif
 
 #include "Common/Exceptions.h"
 #include "Common/log.h"
 
 namespace calq {
 
+static const size_t SIMD_LANES_MAX = 8;  // columns processed at once with AVX-512
+
+// Number of columns which computeQuantizerIndices() processes at once: 8
+// with AVX-512, 4 with AVX2 and 1 (i.e. the scalar code) otherwise
+static size_t nrSimdLanes(void) {
+#ifdef GENOTYPER_X86
+    if (__builtin_cpu_supports("avx512f")) {
+        return 8;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return 4;
+    }
+#endif
+    return 1;
+}
+
+#ifdef GENOTYPER_X86
+
+// The kernels compute the normalized genotype likelihoods of several columns
+// with exactly the operations of the scalar code. The log-likelihoods of
+// the bases of each column are summed up in order, several genotypes at a
+// time (i.e. with contiguous loads from the table rows). exp() is evaluated
+// by the C library as in the scalar code. The normalization and the
+// selection of the largest and second largest genotype likelihood are then
+// done for all columns at once, one column per lane, with the same
+// comparisons (which are false for NaNs) as the scalar code.
+//
+// likelihoods receives nrGenotypes x lanes values (interleaved by column);
+// starts and depths give the range of each column in rowOffsets.
+
+__attribute__((target("avx2")))
+static void genotypeLikelihoodsAvx2(const double *logLikelihoods,
+                                    const size_t &nrGenotypes,
+                                    const int64_t *rowOffsets,
+                                    const int64_t *starts,
+                                    const int64_t *depths,
+                                    double *likelihoods,
+                                    double *largest,
+                                    double *secondLargest) {
+    const __m256i genotypeOffsets = _mm256_setr_epi64x(0, 1, 2, 3);
+    for (size_t j = 0; j < 4; j++) {
+        const int64_t *rows = rowOffsets + starts[j];
+        for (size_t g = 0; g < nrGenotypes; g += 4) {
+            __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x((int64_t)(nrGenotypes - g)), genotypeOffsets);
+            __m256d acc = _mm256_setzero_pd();
+            const double *base = logLikelihoods + g;
+            int64_t d = 0;
+            for (; (d + 4) <= depths[j]; d += 4) {
+                __m256d l0 = _mm256_maskload_pd(base + rows[d], mask);
+                __m256d l1 = _mm256_maskload_pd(base + rows[d+1], mask);
+                __m256d l2 = _mm256_maskload_pd(base + rows[d+2], mask);
+                __m256d l3 = _mm256_maskload_pd(base + rows[d+3], mask);
+                acc = _mm256_add_pd(_mm256_add_pd(_mm256_add_pd(_mm256_add_pd(acc, l0), l1), l2), l3);
+            }
+            for (; d < depths[j]; d++) {
+                acc = _mm256_add_pd(acc, _mm256_maskload_pd(base + rows[d], mask));
+            }
+
+            double sums[4];
+            _mm256_storeu_pd(sums, acc);
+            for (size_t k = 0; k < 4 && (g + k) < nrGenotypes; k++) {
+                likelihoods[4*(g+k) + j] = sums[k];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < 4*nrGenotypes; i++) {
+        likelihoods[i] = exp(likelihoods[i]);
+    }
+
+    __m256d cum = _mm256_setzero_pd();
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        cum = _mm256_add_pd(cum, _mm256_loadu_pd(likelihoods + 4*g));
+    }
+
+    __m256d l1 = _mm256_setzero_pd();
+    __m256d l2 = _mm256_setzero_pd();
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        __m256d l = _mm256_div_pd(_mm256_loadu_pd(likelihoods + 4*g), cum);
+        l2 = _mm256_blendv_pd(l2, l, _mm256_cmp_pd(l, l2, _CMP_GT_OQ));
+        __m256d swap = _mm256_cmp_pd(l2, l1, _CMP_GT_OQ);
+        l2 = _mm256_blendv_pd(l2, l1, swap);
+        l1 = _mm256_blendv_pd(l1, l, swap);
+    }
+    _mm256_storeu_pd(largest, l1);
+    _mm256_storeu_pd(secondLargest, l2);
+}
+
+__attribute__((target("avx512f")))
+static void genotypeLikelihoodsAvx512(const double *logLikelihoods,
+                                      const size_t &nrGenotypes,
+                                      const int64_t *rowOffsets,
+                                      const int64_t *starts,
+                                      const int64_t *depths,
+                                      double *likelihoods,
+                                      double *largest,
+                                      double *secondLargest) {
+    for (size_t j = 0; j < 8; j++) {
+        const int64_t *rows = rowOffsets + starts[j];
+        for (size_t g = 0; g < nrGenotypes; g += 8) {
+            __mmask8 mask = (__mmask8)(((nrGenotypes - g) >= 8) ? 0xff : ((1u << (nrGenotypes - g)) - 1));
+            __m512d acc = _mm512_setzero_pd();
+            const double *base = logLikelihoods + g;
+            int64_t d = 0;
+            for (; (d + 4) <= depths[j]; d += 4) {
+                __m512d l0 = _mm512_maskz_loadu_pd(mask, base + rows[d]);
+                __m512d l1 = _mm512_maskz_loadu_pd(mask, base + rows[d+1]);
+                __m512d l2 = _mm512_maskz_loadu_pd(mask, base + rows[d+2]);
+                __m512d l3 = _mm512_maskz_loadu_pd(mask, base + rows[d+3]);
+                acc = _mm512_add_pd(_mm512_add_pd(_mm512_add_pd(_mm512_add_pd(acc, l0), l1), l2), l3);
+            }
+            for (; d < depths[j]; d++) {
+                acc = _mm512_add_pd(acc, _mm512_maskz_loadu_pd(mask, base + rows[d]));
+            }
+
+            double sums[8];
+            _mm512_storeu_pd(sums, acc);
+            for (size_t k = 0; k < 8 && (g + k) < nrGenotypes; k++) {
+                likelihoods[8*(g+k) + j] = sums[k];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < 8*nrGenotypes; i++) {
+        likelihoods[i] = exp(likelihoods[i]);
+    }
+
+    __m512d cum = _mm512_setzero_pd();
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        cum = _mm512_add_pd(cum, _mm512_loadu_pd(likelihoods + 8*g));
+    }
+
+    __m512d l1 = _mm512_setzero_pd();
+    __m512d l2 = _mm512_setzero_pd();
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        __m512d l = _mm512_div_pd(_mm512_loadu_pd(likelihoods + 8*g), cum);
+        l2 = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(l, l2, _CMP_GT_OQ), l2, l);
+        __mmask8 swap = _mm512_cmp_pd_mask(l2, l1, _CMP_GT_OQ);
+        l2 = _mm512_mask_blend_pd(swap, l2, l1);
+        l1 = _mm512_mask_blend_pd(swap, l1, l);
+    }
+    _mm512_storeu_pd(largest, l1);
+    _mm512_storeu_pd(secondLargest, l2);
+}
+
+#endif  // GENOTYPER_X86
+
 static int combinationsWithRepetitions(std::vector<std::string> *genotypeAlphabet,
                                        const std::vector<char> &alleleAlphabet,
                                        int *got,
@@ -43,11 +196,20 @@ static int combinationsWithRepetitions(std::vector<std::string> *genotypeAlphabe
 
 Genotyper::Genotyper(const int &polyploidy,
                      const int &qualOffset,
-                     const int &nrQuantizers)
+                     const int &nrQuantizers,
+                     const bool &fixedPoint)
     : alleleAlphabet_(ALLELE_ALPHABET),
-      alleleLikelihoods_(),
       genotypeAlphabet_(),
+      alleleIndices_(),
+      logLikelihoods_(),
       genotypeLikelihoods_(),
+      rowOffsets_(),
+      batchLikelihoods_(),
+      phredLikelihoods_(),
+      phredSums_(),
+      posteriorsHigh_(),
+      posteriorsLow_(),
+      fixedPoint_(fixedPoint),
       nrQuantizers_(nrQuantizers),
       polyploidy_(polyploidy),
       qualOffset_(qualOffset) {
@@ -62,6 +224,9 @@ Genotyper::Genotyper(const int &polyploidy,
     }
 
     initLikelihoods();
+    if (fixedPoint_ == true) {
+        initFixedPoint();
+    }
 }
 
 Genotyper::~Genotyper(void) {}
@@ -81,12 +246,12 @@ double Genotyper::computeEntropy(const std::string &seqPileup,
         return 0.0;  // no information content for one symbol
     }
 
-    computeGenotypeLikelihoods(seqPileup, qualPileup, depth);
+    computeGenotypeLikelihoods(seqPileup.data(), qualPileup.data(), depth);
 
     double entropy = 0.0;
-    for (auto &genotypeLikelihood : genotypeLikelihoods_) {
-        if (genotypeLikelihood.second != 0) {
-            entropy -= genotypeLikelihood.second * log(genotypeLikelihood.second);
+    for (auto const &genotypeLikelihood : genotypeLikelihoods_) {
+        if (genotypeLikelihood != 0) {
+            entropy -= genotypeLikelihood * log(genotypeLikelihood);
         }
     }
 
@@ -108,92 +273,354 @@ int Genotyper::computeQuantizerIndex(const std::string &seqPileup,
         return (nrQuantizers_ - 1);  // no inference can be made, stay safe
     }
 
-    computeGenotypeLikelihoods(seqPileup, qualPileup, depth);
+    if (fixedPoint_ == true) {
+        return computeQuantizerIndexFixedPoint(seqPileup.data(), qualPileup.data(), depth);
+    }
+
+    computeGenotypeLikelihoods(seqPileup.data(), qualPileup.data(), depth);
+
+    return selectQuantizerIndex();
+}
+
+int Genotyper::computeQuantizerIndex(const std::string &seqPileup,
+                                     const std::string &qualPileup,
+                                     const std::vector<uint32_t> &counts) {
+    const size_t nrPairs = seqPileup.length();
+
+    if (nrPairs != qualPileup.length() || nrPairs != counts.size()) {
+        throwErrorException("Lengths of seqPileup, qualPileup and counts differ");
+    }
+
+    uint64_t depth = 0;
+    for (auto const &count : counts) {
+        depth += count;
+    }
+    if (depth == 0) {
+        return nrQuantizers_;  // computation of quantizer index not possible
+    }
+    if (depth == 1) {
+        return (nrQuantizers_ - 1);  // no inference can be made, stay safe
+    }
+
+    if (fixedPoint_ == true) {
+        return computeQuantizerIndexFixedPoint(seqPileup.data(), qualPileup.data(), &counts[0], nrPairs);
+    }
+
+    computeGenotypeLikelihoods(seqPileup.data(), qualPileup.data(), &counts[0], nrPairs);
+
+    return selectQuantizerIndex();
+}
+
+void Genotyper::computeQuantizerIndices(const PileupWindow &window,
+                                        int *quantizerIndices) {
+    if (quantizerIndices == NULL) {
+        throwErrorException("quantizerIndices is NULL");
+    }
+
+    const size_t nrGenotypes = genotypeLikelihoods_.size();
+    const size_t nrLanes = (fixedPoint_ == true) ? 1 : nrSimdLanes();
+
+    // Columns with fewer than two bases are handled as in
+    // computeQuantizerIndex()
+    std::vector<size_t> columns;
+    for (size_t i = 0; i < window.size(); i++) {
+        size_t depth = window.offsets[i+1] - window.offsets[i];
+        if (depth == 0) {
+            quantizerIndices[i] = nrQuantizers_;
+        } else if (depth == 1) {
+            quantizerIndices[i] = nrQuantizers_ - 1;
+        } else if (fixedPoint_ == true) {
+            quantizerIndices[i] = computeQuantizerIndexFixedPoint(window.seq.data() + window.offsets[i], window.qual.data() + window.offsets[i], depth);
+        } else if (nrLanes == 1) {
+            computeGenotypeLikelihoods(window.seq.data() + window.offsets[i], window.qual.data() + window.offsets[i], depth);
+            quantizerIndices[i] = selectQuantizerIndex();
+        } else {
+            columns.push_back(i);
+        }
+    }
+    if (columns.empty() == true) {
+        return;
+    }
+
+    // Offsets into logLikelihoods_ of all bases
+    const size_t nrBases = window.seq.length();
+    const unsigned char *seq = (const unsigned char *)window.seq.data();
+    const unsigned char *qual = (const unsigned char *)window.qual.data();
+    const uint8_t *alleleIndices = &alleleIndices_[0];
+    const size_t nrAlleles = ALLELE_ALPHABET_SIZE + 1;
+    rowOffsets_.resize(nrBases);
+    int64_t *rowOffsets = &rowOffsets_[0];
+    for (size_t p = 0; p < nrBases; p++) {
+        rowOffsets[p] = (int64_t)((((size_t)qual[p] * nrAlleles) + alleleIndices[seq[p]]) * nrGenotypes);
+    }
+
+    // Process nrLanes columns at once; unused lanes get depth 0
+    batchLikelihoods_.resize(nrGenotypes * nrLanes);
+    int64_t starts[SIMD_LANES_MAX];
+    int64_t depths[SIMD_LANES_MAX];
+    double largest[SIMD_LANES_MAX];
+    double secondLargest[SIMD_LANES_MAX];
+    for (size_t c = 0; c < columns.size(); c += nrLanes) {
+        for (size_t j = 0; j < nrLanes; j++) {
+            starts[j] = 0;
+            depths[j] = 0;
+            if ((c + j) < columns.size()) {
+                starts[j] = (int64_t)window.offsets[columns[c+j]];
+                depths[j] = (int64_t)(window.offsets[columns[c+j]+1] - window.offsets[columns[c+j]]);
+            }
+        }
+
+#ifdef GENOTYPER_X86
+        if (nrLanes == 8) {
+            genotypeLikelihoodsAvx512(&logLikelihoods_[0], nrGenotypes, rowOffsets, starts, depths,
+                                      &batchLikelihoods_[0], largest, secondLargest);
+        } else {
+            genotypeLikelihoodsAvx2(&logLikelihoods_[0], nrGenotypes, rowOffsets, starts, depths,
+                                    &batchLikelihoods_[0], largest, secondLargest);
+        }
+#endif
+
+        for (size_t j = 0; j < nrLanes && (c + j) < columns.size(); j++) {
+            quantizerIndices[columns[c+j]] = quantizerIndex(largest[j], secondLargest[j]);
+        }
+    }
+}
+
+void Genotyper::initLikelihoods(void) {
+    // Initialize genotype alphabet; the genotypes are generated in
+    // lexicographical order
+    std::vector<int> chosen(polyploidy_);
+    combinationsWithRepetitions(&genotypeAlphabet_, alleleAlphabet_, &chosen[0], 0, polyploidy_, 0, ALLELE_ALPHABET_SIZE);
+    const size_t nrGenotypes = genotypeAlphabet_.size();
+    genotypeLikelihoods_.assign(nrGenotypes, 0.0);
+
+    alleleIndices_.assign(256, (uint8_t)ALLELE_ALPHABET_SIZE);
+    for (size_t i = 0; i < ALLELE_ALPHABET_SIZE; i++) {
+        alleleIndices_[(unsigned char)alleleAlphabet_[i]] = (uint8_t)i;
+    }
+
+    // Precompute the log-likelihood of every (quality, base) pair for every
+    // genotype; the arithmetic is the same as if it was done per base, so the
+    // results are identical
+    logLikelihoods_.assign(256 * (ALLELE_ALPHABET_SIZE+1) * nrGenotypes, 0.0);
+    for (int c = 0; c < 256; c++) {
+        double q = (double)((char)c - qualOffset_);
+
+        double pStrike = 1 - pow(10.0, -q/10.0);
+        double pError = (1-pStrike) / (ALLELE_ALPHABET_SIZE-1);
+
+        for (size_t a = 0; a <= ALLELE_ALPHABET_SIZE; a++) {
+            char y = (a < ALLELE_ALPHABET_SIZE) ? alleleAlphabet_[a] : '\0';
+            double *logLikelihoods = &logLikelihoods_[(((size_t)c * (ALLELE_ALPHABET_SIZE+1)) + a) * nrGenotypes];
+
+            for (size_t g = 0; g < nrGenotypes; g++) {
+                double p = 0.0;
+                for (int i = 0; i < polyploidy_; i++) {
+                    p += (y == genotypeAlphabet_[g][i]) ? pStrike : pError;
+                }
+                p /= polyploidy_;
+
+                // We are using the log likelihood to avoid numerical problems
+                logLikelihoods[g] = log(p);
+            }
+        }
+    }
+}
+
+void Genotyper::computeGenotypeLikelihoods(const char *seqPileup,
+                                           const char *qualPileup,
+                                           const size_t &depth) {
+    const size_t nrGenotypes = genotypeLikelihoods_.size();
+    double *genotypeLikelihoods = &genotypeLikelihoods_[0];
+
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        genotypeLikelihoods[g] = 0.0;
+    }
+
+    // Sum up the log-likelihoods of all bases
+    for (size_t d = 0; d < depth; d++) {
+        size_t alleleIndex = alleleIndices_[(unsigned char)seqPileup[d]];
+        const double *logLikelihoods = &logLikelihoods_[(((size_t)(unsigned char)qualPileup[d] * (ALLELE_ALPHABET_SIZE+1)) + alleleIndex) * nrGenotypes];
+        for (size_t g = 0; g < nrGenotypes; g++) {
+            genotypeLikelihoods[g] += logLikelihoods[g];
+        }
+    }
+
+    normalizeGenotypeLikelihoods();
+}
+
+void Genotyper::computeGenotypeLikelihoods(const char *seqPileup,
+                                           const char *qualPileup,
+                                           const uint32_t *counts,
+                                           const size_t &nrPairs) {
+    const size_t nrGenotypes = genotypeLikelihoods_.size();
+    double *genotypeLikelihoods = &genotypeLikelihoods_[0];
+
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        genotypeLikelihoods[g] = 0.0;
+    }
+
+    // Sum up the log-likelihoods of all (base, quality value) pairs, each
+    // weighted with the number of its occurrences
+    for (size_t i = 0; i < nrPairs; i++) {
+        size_t alleleIndex = alleleIndices_[(unsigned char)seqPileup[i]];
+        const double *logLikelihoods = &logLikelihoods_[(((size_t)(unsigned char)qualPileup[i] * (ALLELE_ALPHABET_SIZE+1)) + alleleIndex) * nrGenotypes];
+        const double count = (double)counts[i];
+        for (size_t g = 0; g < nrGenotypes; g++) {
+            genotypeLikelihoods[g] += count * logLikelihoods[g];
+        }
+    }
+
+    normalizeGenotypeLikelihoods();
+}
+
+void Genotyper::normalizeGenotypeLikelihoods(void) {
+    const size_t nrGenotypes = genotypeLikelihoods_.size();
+    double *genotypeLikelihoods = &genotypeLikelihoods_[0];
 
+    double cum = 0.0;
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        genotypeLikelihoods[g] = exp(genotypeLikelihoods[g]);
+        cum += genotypeLikelihoods[g];
+    }
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        genotypeLikelihoods[g] /= cum;
+    }
+}
+
+int Genotyper::selectQuantizerIndex(void) const {
     double largestGenotypeLikelihood = 0.0;
     double secondLargestGenotypeLikelihood = 0.0;
-    for (auto &genotypeLikelihood : genotypeLikelihoods_) {
-        if (genotypeLikelihood.second > secondLargestGenotypeLikelihood) {
-            secondLargestGenotypeLikelihood = genotypeLikelihood.second;
+    for (auto const &genotypeLikelihood : genotypeLikelihoods_) {
+        if (genotypeLikelihood > secondLargestGenotypeLikelihood) {
+            secondLargestGenotypeLikelihood = genotypeLikelihood;
         }
         if (secondLargestGenotypeLikelihood > largestGenotypeLikelihood) {
             secondLargestGenotypeLikelihood = largestGenotypeLikelihood;
-            largestGenotypeLikelihood = genotypeLikelihood.second;
+            largestGenotypeLikelihood = genotypeLikelihood;
         }
     }
 
+    return quantizerIndex(largestGenotypeLikelihood, secondLargestGenotypeLikelihood);
+}
+
+int Genotyper::quantizerIndex(const double &largestGenotypeLikelihood,
+                              const double &secondLargestGenotypeLikelihood) const {
     double confidence = largestGenotypeLikelihood - secondLargestGenotypeLikelihood;
 
     return (int)((1 - confidence) * (nrQuantizers_ - 1));
 }
 
-void Genotyper::initLikelihoods(void) {
-    // Initialize map containing the allele likelihoods
-    for (auto const &allele : alleleAlphabet_) {
-        alleleLikelihoods_.insert(std::pair<char, double>(allele, 0.0));
+void Genotyper::initFixedPoint(void) {
+    // Phred-scaled likelihoods; impossible (and invalid) events get the
+    // largest value
+    phredLikelihoods_.resize(logLikelihoods_.size());
+    for (size_t i = 0; i < logLikelihoods_.size(); i++) {
+        double phred = -10.0 / log(10.0) * logLikelihoods_[i] * PHRED_SCALE;
+        if ((phred < PHRED_LIKELIHOOD_MAX) == false) {
+            phred = PHRED_LIKELIHOOD_MAX;
+        }
+        phredLikelihoods_[i] = (int32_t)lround(phred);
     }
 
-    // Initialize map containing the genotype likelihoods
-    int chosen[ALLELE_ALPHABET_SIZE];
-    combinationsWithRepetitions(&genotypeAlphabet_, alleleAlphabet_, chosen, 0, polyploidy_, 0, ALLELE_ALPHABET_SIZE);
-
-    // Initialize genotype alphabet
-    for (auto &genotype : genotypeAlphabet_) {
-        genotypeLikelihoods_.insert(std::pair<std::string, double>(genotype, 0.0));
+    // Relative posteriors; the upper table ends with the first entry which
+    // rounds to 0
+    posteriorsLow_.clear();
+    for (int32_t x = 0; x < (1 << POSTERIOR_LOW_BITS); x++) {
+        posteriorsLow_.push_back((uint64_t)llround(ldexp(pow(10.0, -x / (10.0 * PHRED_SCALE)), POSTERIOR_SHIFT)));
     }
-}
-
-void Genotyper::resetLikelihoods(void) {
-    for (auto &genotypeLikelihood : genotypeLikelihoods_) {
-        genotypeLikelihood.second = 0.0;
+    posteriorsHigh_.clear();
+    for (int32_t x = 0; ; x += (1 << POSTERIOR_LOW_BITS)) {
+        uint64_t posterior = (uint64_t)llround(ldexp(pow(10.0, -x / (10.0 * PHRED_SCALE)), POSTERIOR_SHIFT));
+        if (posterior == 0) {
+            break;
+        }
+        posteriorsHigh_.push_back(posterior);
     }
 
-    for (auto &alleleLikelihood : alleleLikelihoods_) {
-        alleleLikelihood.second = 0.0;
-    }
+    phredSums_.assign(genotypeLikelihoods_.size(), 0);
 }
 
-void Genotyper::computeGenotypeLikelihoods(const std::string &seqPileup,
-                                           const std::string &qualPileup,
-                                           const size_t &depth) {
-    resetLikelihoods();
+int Genotyper::computeQuantizerIndexFixedPoint(const char *seqPileup,
+                                               const char *qualPileup,
+                                               const size_t &depth) {
+    const size_t nrGenotypes = phredSums_.size();
+    int64_t *phredSums = &phredSums_[0];
 
-    double *tempGenotypeLikelihoods = (double *)calloc(genotypeAlphabet_.size(), sizeof(double));
-    int itr = 0;
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        phredSums[g] = 0;
+    }
+
+    // Sum up the Phred-scaled likelihoods of all bases
     for (size_t d = 0; d < depth; d++) {
-        char y = (char)seqPileup[d];
-        double q = (double)(qualPileup[d] - qualOffset_);
+        size_t alleleIndex = alleleIndices_[(unsigned char)seqPileup[d]];
+        const int32_t *phredLikelihoods = &phredLikelihoods_[(((size_t)(unsigned char)qualPileup[d] * (ALLELE_ALPHABET_SIZE+1)) + alleleIndex) * nrGenotypes];
+        for (size_t g = 0; g < nrGenotypes; g++) {
+            phredSums[g] += phredLikelihoods[g];
+        }
+    }
 
-        double pStrike = 1 - pow(10.0, -q/10.0);
-        double pError = (1-pStrike) / (ALLELE_ALPHABET_SIZE-1);
+    return selectQuantizerIndexFixedPoint();
+}
 
-        itr = 0;
-        for (auto const &genotype : genotypeAlphabet_) {
-            double p = 0.0;
-            for (int i = 0; i < polyploidy_; i++) {
-                p += (y == genotype[i]) ? pStrike : pError;
-            }
-            p /= polyploidy_;
+int Genotyper::computeQuantizerIndexFixedPoint(const char *seqPileup,
+                                               const char *qualPileup,
+                                               const uint32_t *counts,
+                                               const size_t &nrPairs) {
+    const size_t nrGenotypes = phredSums_.size();
+    int64_t *phredSums = &phredSums_[0];
 
-            // We are using the log likelihood to avoid numerical problems
-            tempGenotypeLikelihoods[itr++] += log(p);
-        }
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        phredSums[g] = 0;
     }
-    itr = 0;
-    for (auto const &genotype : genotypeAlphabet_) {
-        genotypeLikelihoods_[genotype] = tempGenotypeLikelihoods[itr++];
+
+    // Sum up the Phred-scaled likelihoods of all (base, quality value)
+    // pairs, each weighted with the number of its occurrences
+    for (size_t i = 0; i < nrPairs; i++) {
+        size_t alleleIndex = alleleIndices_[(unsigned char)seqPileup[i]];
+        const int32_t *phredLikelihoods = &phredLikelihoods_[(((size_t)(unsigned char)qualPileup[i] * (ALLELE_ALPHABET_SIZE+1)) + alleleIndex) * nrGenotypes];
+        const int64_t count = (int64_t)counts[i];
+        for (size_t g = 0; g < nrGenotypes; g++) {
+            phredSums[g] += count * phredLikelihoods[g];
+        }
     }
-    free(tempGenotypeLikelihoods);
 
-    // Normalize the genotype likelihoods
-    double cum = 0.0;
-    for (auto &genotypeLikelihood : genotypeLikelihoods_) {
-        genotypeLikelihood.second = exp(genotypeLikelihood.second);
-        cum += genotypeLikelihood.second;
+    return selectQuantizerIndexFixedPoint();
+}
+
+int Genotyper::selectQuantizerIndexFixedPoint(void) const {
+    const size_t nrGenotypes = phredSums_.size();
+    const int64_t *phredSums = &phredSums_[0];
+
+    // The most likely genotype has the smallest sum; relative to it, the
+    // posterior of each genotype is 10^(-(sum-smallest)/10)
+    int64_t smallest = phredSums[0];
+    for (size_t g = 1; g < nrGenotypes; g++) {
+        smallest = (phredSums[g] < smallest) ? phredSums[g] : smallest;
     }
-    for (auto &genotypeLikelihood : genotypeLikelihoods_) {
-        genotypeLikelihood.second /= cum;
+    const int64_t posteriorsEnd = (int64_t)posteriorsHigh_.size() << POSTERIOR_LOW_BITS;
+    const int64_t lowMask = (1 << POSTERIOR_LOW_BITS) - 1;
+    uint64_t cum = 0;
+    uint64_t secondLargest = 0;
+    bool largestSeen = false;
+    for (size_t g = 0; g < nrGenotypes; g++) {
+        int64_t x = phredSums[g] - smallest;
+        uint64_t posterior = 0;
+        if (x < posteriorsEnd) {
+            posterior = (posteriorsHigh_[x >> POSTERIOR_LOW_BITS] * posteriorsLow_[x & lowMask] + (1 << (POSTERIOR_SHIFT-1))) >> POSTERIOR_SHIFT;
+        }
+        cum += posterior;
+        if (x == 0 && largestSeen == false) {
+            largestSeen = true;
+        } else if (posterior > secondLargest) {
+            secondLargest = posterior;
+        }
     }
+
+    // (1 - confidence) * (nrQuantizers_ - 1), where the confidence is the
+    // difference of the two largest (normalized) posteriors
+    uint64_t confidence = ((uint64_t)1 << POSTERIOR_SHIFT) - secondLargest;
+    return (int)(((cum - confidence) * (uint64_t)(nrQuantizers_ - 1)) / cum);
 }
 
 }  // namespace calq
@@ -7,17 +7,33 @@
 #ifndef CALQ_QUALCODEC_GENOTYPER_H_
 #define CALQ_QUALCODEC_GENOTYPER_H_
 
-#include <map>
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
+#include "QualCodec/PileupWindow.h"
+
 namespace calq {
 
+// With fixedPoint, the quantizer indices are computed with integer
+// arithmetic only: the genotype likelihoods are summed up as Phred-scaled
+// integers (in units of 1/PHRED_SCALE), and the gap between the two largest
+// posteriors is computed from tables of 10^(-x/10) in fixed point.
+// Compared to the double precision computation, the quantizer index differs
+// by at most one, and only if (1 - confidence) * (nrQuantizers - 1) is very
+// close to an integer (the rounding error is below 1e-4 per pileup base; in
+// practice this hits less than 1 in 1000 columns). The exception are
+// pileups in which the likelihoods of all genotypes underflow in double
+// precision (which then get the largest quantizer index): the fixed-point
+// computation normalizes the likelihoods first and thus still yields a
+// meaningful index.
 class Genotyper {
  public:
     Genotyper(const int &polyploidy,
               const int &qualOffset,
-              const int &nrQuantizers);
+              const int &nrQuantizers,
+              const bool &fixedPoint);
     ~Genotyper(void);
 
     double computeEntropy(const std::string &seqPileup,
@@ -25,20 +41,87 @@ class Genotyper {
     int computeQuantizerIndex(const std::string &seqPileup,
                               const std::string &qualPileup);
 
+    // Computes the quantizer index of a pileup column given as a histogram
+    // (see SAMPileup): the base seqPileup[i] occurs counts[i] times with the
+    // quality value qualPileup[i]. The cost depends on the number of
+    // distinct pairs rather than on the depth. With fixedPoint, the result is
+    // that of computeQuantizerIndex() on the expanded column; otherwise it
+    // may differ by rounding, as the log-likelihoods are multiplied by the
+    // counts instead of being summed up one by one (hence the QualEncoder
+    // only uses histograms with fixedPoint).
+    int computeQuantizerIndex(const std::string &seqPileup,
+                              const std::string &qualPileup,
+                              const std::vector<uint32_t> &counts);
+
+    // Computes the quantizer indices of all columns of window (with the same
+    // results as computeQuantizerIndex()); without fixedPoint, several
+    // columns are processed at once with AVX2 or AVX-512 where available.
+    // quantizerIndices must hold window.size() elements.
+    void computeQuantizerIndices(const PileupWindow &window,
+                                 int *quantizerIndices);
+
  private:
     void initLikelihoods(void);
-    void resetLikelihoods(void);
-    void computeGenotypeLikelihoods(const std::string &seqPileup,
-                                    const std::string &qualPileup,
+    void computeGenotypeLikelihoods(const char *seqPileup,
+                                    const char *qualPileup,
                                     const size_t &depth);
+    void computeGenotypeLikelihoods(const char *seqPileup,
+                                    const char *qualPileup,
+                                    const uint32_t *counts,
+                                    const size_t &nrPairs);
+    void normalizeGenotypeLikelihoods(void);
+    int selectQuantizerIndex(void) const;
+    void initFixedPoint(void);
+    int computeQuantizerIndexFixedPoint(const char *seqPileup,
+                                        const char *qualPileup,
+                                        const size_t &depth);
+    int computeQuantizerIndexFixedPoint(const char *seqPileup,
+                                        const char *qualPileup,
+                                        const uint32_t *counts,
+                                        const size_t &nrPairs);
+    int selectQuantizerIndexFixedPoint(void) const;
+    int quantizerIndex(const double &largestGenotypeLikelihood,
+                       const double &secondLargestGenotypeLikelihood) const;
 
     const std::vector<char> ALLELE_ALPHABET = {'A', 'C', 'G', 'T'};
     const size_t ALLELE_ALPHABET_SIZE = 4;
 
     const std::vector<char> alleleAlphabet_;
-    std::map<char, double> alleleLikelihoods_;
     std::vector<std::string> genotypeAlphabet_;
-    std::map<std::string, double> genotypeLikelihoods_;
+
+    // Index of each base character in alleleAlphabet_; other characters
+    // (e.g. 'N') get index ALLELE_ALPHABET_SIZE, as they match no allele
+    std::vector<uint8_t> alleleIndices_;
+
+    // Log-likelihoods log(p(base|genotype)), indexed by
+    // ((qualityCharacter * (ALLELE_ALPHABET_SIZE+1)) + alleleIndex) * nrGenotypes + genotypeIndex
+    std::vector<double> logLikelihoods_;
+
+    // Genotype likelihoods of the current pileup, in the order of
+    // genotypeAlphabet_
+    std::vector<double> genotypeLikelihoods_;
+
+    // Scratch buffers of computeQuantizerIndices(): the offsets into
+    // logLikelihoods_ of the bases of a window, and the genotype likelihoods
+    // of the columns processed at once (interleaved by column)
+    std::vector<int64_t> rowOffsets_;
+    std::vector<double> batchLikelihoods_;
+
+    // Fixed-point engine: the Phred-scaled likelihoods -10*log10(p) *
+    // PHRED_SCALE, indexed like logLikelihoods_, and the sums of the current
+    // pileup. The relative posterior 10^(-x/(10*PHRED_SCALE)) (times
+    // 2^POSTERIOR_SHIFT) is the product of the entries for the upper and the
+    // lower POSTERIOR_LOW_BITS bits of x; x beyond the upper table gives 0.
+    static const int32_t PHRED_SCALE = 1024;
+    static const int32_t PHRED_LIKELIHOOD_MAX = 255 * PHRED_SCALE;
+    static const int POSTERIOR_SHIFT = 20;
+    static const int POSTERIOR_LOW_BITS = 8;
+    std::vector<int32_t> phredLikelihoods_;
+    std::vector<int64_t> phredSums_;
+    std::vector<uint64_t> posteriorsHigh_;
+    std::vector<uint64_t> posteriorsLow_;
+
+    const bool fixedPoint_;
     const int nrQuantizers_;
     const int polyploidy_;
     const int qualOffset_;
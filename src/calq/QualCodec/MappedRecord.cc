@@ -0,0 +1,39 @@
+/** @file MappedRecord.cc
+ *  @brief This file contains the implementation of the MappedRecord class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include "QualCodec/MappedRecord.h"
+
+#include <string.h>
+
+#include <utility>
+
+#include "Common/Exceptions.h"
+
+namespace calq {
+
+MappedRecord::MappedRecord(SAMRecord *samRecord)
+    : posMin(samRecord->posMin),
+      posMax(samRecord->posMax),
+      qual(samRecord->qual),
+      cigarOps(std::move(samRecord->cigarOps)),
+      qualBuffer_() {
+    if (samRecord->isMapped() == false) {
+        throwErrorException("Record is not mapped");
+    }
+}
+
+MappedRecord::~MappedRecord(void) {}
+
+void MappedRecord::ownQual(void) {
+    if (qualBuffer_ != nullptr || qual.empty() == true) {
+        return;
+    }
+    qualBuffer_.reset(new char[qual.length()]);
+    memcpy(qualBuffer_.get(), qual.data(), qual.length());
+    qual = StringView(qualBuffer_.get(), qual.length());
+}
+
+}  // namespace calq
@@ -0,0 +1,51 @@
+/** @file MappedRecord.h
+ *  @brief This file contains the definition of the MappedRecord class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_QUALCODEC_MAPPEDRECORD_H_
+#define CALQ_QUALCODEC_MAPPEDRECORD_H_
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "Common/StringView.h"
+#include "IO/SAM/SAMCigar.h"
+#include "IO/SAM/SAMRecord.h"
+
+namespace calq {
+
+// The parts of a mapped SAM record which the QualEncoder needs once the
+// record has been added to the pileup; the SAMBlock the record was read with
+// still holds the complete SAMRecord. Like the SAMRecord, it refers to the
+// quality values of the record, which must outlive it unless the record
+// owns a copy of them (see ownQual()). Records are queued by moving, never
+// by copying.
+class MappedRecord {
+ public:
+    // Takes over the parsed CIGAR of samRecord, which is left empty
+    explicit MappedRecord(SAMRecord *samRecord);
+    MappedRecord(const MappedRecord &other) = delete;
+    MappedRecord(MappedRecord &&other) = default;
+    MappedRecord & operator=(const MappedRecord &other) = delete;
+    MappedRecord & operator=(MappedRecord &&other) = default;
+    ~MappedRecord(void);
+
+    // Copies the quality values into the record, so that it can outlive the
+    // block it was read with
+    void ownQual(void);
+
+    uint32_t posMin;  // 0-based leftmost mapping position
+    uint32_t posMax;  // 0-based rightmost mapping position
+    StringView qual;
+    SAMCigar cigarOps;
+
+ private:
+    std::unique_ptr<char[]> qualBuffer_;
+};
+
+}  // namespace calq
+
+#endif  // CALQ_QUALCODEC_MAPPEDRECORD_H_
@@ -0,0 +1,43 @@
+/** @file PileupWindow.cc
+ *  @brief This file contains the implementation of the PileupWindow class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include "QualCodec/PileupWindow.h"
+
+#include <string>
+
+#include "Common/Exceptions.h"
+
+namespace calq {
+
+PileupWindow::PileupWindow(void) : seq(""), qual(""), offsets(1, 0) {}
+
+PileupWindow::~PileupWindow(void) {}
+
+void PileupWindow::clear(void) {
+    seq.clear();
+    qual.clear();
+    offsets.assign(1, 0);
+}
+
+bool PileupWindow::empty(void) const {
+    return (size() == 0);
+}
+
+void PileupWindow::push_back(const std::string &seqPileup, const std::string &qualPileup) {
+    if (seqPileup.length() != qualPileup.length()) {
+        throwErrorException("Lengths of seqPileup and qualPileup differ");
+    }
+
+    seq += seqPileup;
+    qual += qualPileup;
+    offsets.push_back(seq.length());
+}
+
+size_t PileupWindow::size(void) const {
+    return offsets.size() - 1;
+}
+
+}  // namespace calq
@@ -0,0 +1,35 @@
+/** @file PileupWindow.h
+ *  @brief This file contains the definition of the PileupWindow class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_QUALCODEC_PILEUPWINDOW_H_
+#define CALQ_QUALCODEC_PILEUPWINDOW_H_
+
+#include <string>
+#include <vector>
+
+namespace calq {
+
+// Window of consecutive pileup columns in structure-of-arrays layout: the
+// bases and the quality values of all columns are stored back to back, and
+// column i occupies [offsets[i], offsets[i+1]) of both
+class PileupWindow {
+ public:
+    PileupWindow(void);
+    ~PileupWindow(void);
+
+    void clear(void);
+    bool empty(void) const;
+    void push_back(const std::string &seqPileup, const std::string &qualPileup);
+    size_t size(void) const;
+
+    std::string seq;
+    std::string qual;
+    std::vector<size_t> offsets;
+};
+
+}  // namespace calq
+
+#endif  // CALQ_QUALCODEC_PILEUPWINDOW_H_
@@ -6,136 +6,253 @@
 
 #include "QualCodec/QualDecoder.h"
 
+#include <algorithm>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "Common/Exceptions.h"
 #include "Common/log.h"
 
 namespace calq {
 
-static size_t readLength(const std::string &cigar) {
-    size_t readLen = 0;
-    size_t cigarIdx = 0;
-    size_t cigarLen = cigar.length();
-    size_t opLen = 0;  // length of current CIGAR operation
-
-    for (cigarIdx = 0; cigarIdx < cigarLen; cigarIdx++) {
-       if (isdigit(cigar[cigarIdx])) {
-           opLen = opLen*10 + (size_t)cigar[cigarIdx] - (size_t)'0';
-           continue;
-       }
-
-       switch (cigar[cigarIdx]) {
-       case 'M':
-       case '=':
-       case 'X':
-           readLen += opLen;
-           break;
-       case 'I':
-       case 'S':
-           readLen += opLen;
-           break;
-       case 'D':
-       case 'N':
-           break;  // do nothing as these bases are not present
-       case 'H':
-       case 'P':
-           break;  // these have been clipped
-       default:
-           throwErrorException("Bad CIGAR string");
-       }
-
-       opLen = 0;
-    }
-
-    return readLen;
-}
+// Number of bases (and thus quality values) of a read
+struct ReadLengthVisitor {
+    ReadLengthVisitor(void) : length(0) {}
+    void match(const uint32_t &opLength) { length += opLength; }
+    void insertion(const uint32_t &opLength) { length += opLength; }
+    void deletion(const uint32_t &) {}  // these bases are not present
+    size_t length;
+};
+
+// Reconstructs the quality values of a mapped record: aligned bases with the
+// quantizer indices of their positions, inserted and soft-clipped bases with
+// the largest quantizer index
+struct QualityValueDecodingVisitor {
+    QualityValueDecodingVisitor(char *qual,
+                                const int &qualityValueOffset,
+                                const char *quantizerIndices,
+                                const std::map<int, Quantizer> &quantizers,
+                                const std::vector<std::string> &qualityValueIndices,
+                                std::vector<size_t> *qualityValueIndicesIdx)
+        : qual(qual),
+          qualityValueOffset(qualityValueOffset),
+          quantizerIndices(quantizerIndices),
+          quantizers(quantizers),
+          qualityValueIndices(qualityValueIndices),
+          qualityValueIndicesIdx(qualityValueIndicesIdx) {}
+    void match(const uint32_t &opLength) {
+        // Decode opLength quality value indices with computed quantizer indices
+        for (size_t i = 0; i < opLength; i++) {
+            int quantizerIndex = *quantizerIndices++;
+            *qual++ = (char)(decode(quantizerIndex) + qualityValueOffset);
+        }
+    }
+    void insertion(const uint32_t &opLength) {
+        // Decode opLength quality values with max quantizer index
+        const int quantizerIndex = (int)quantizers.size() - 1;
+        for (size_t i = 0; i < opLength; i++) {
+            *qual++ = (char)(decode(quantizerIndex) + qualityValueOffset);
+        }
+    }
+    void deletion(const uint32_t &opLength) {
+        quantizerIndices += opLength;  // these bases are not present
+    }
+    // Reconstructs the next quality value of the given quantizer; the
+    // quality value indices run out if the side information does not
+    // match the CQ block
+    int decode(const int &quantizerIndex) {
+        const std::string &indices = qualityValueIndices.at(quantizerIndex);
+        size_t &indicesIdx = (*qualityValueIndicesIdx)[quantizerIndex];
+        if (indicesIdx >= indices.length()) {
+            throwErrorException("Decoding quality values failed");
+        }
+        return quantizers.at(quantizerIndex).indexToReconstructionValue(indices[indicesIdx++]);
+    }
+    char *qual;
+    const int qualityValueOffset;
+    const char *quantizerIndices;
+    const std::map<int, Quantizer> &quantizers;
+    const std::vector<std::string> &qualityValueIndices;
+    std::vector<size_t> *qualityValueIndicesIdx;
+};
 
-QualDecoder::QualDecoder(void)
+QualDecoder::QualDecoder(ThreadPool *threadPool)
     : posOffset_(0),
       qualityValueOffset_(0),
       uqv_(""),
       qvci_(""),
       qvi_(),
+      streamSizes_(),
+      streamBuffers_(),
+      blockQvci_(""),
+      nrFinishedRecords_(0),
+      tailQvci_(""),
+      tailPosOffset_(0),
+      nrTailRecords_(0),
+      posMinPrev_(0),
       uqvIdx_(0),
       qviIdx_(),
-      quantizers_() {}
+      quantizers_(),
+      threadPool_(threadPool) {}
 
 QualDecoder::~QualDecoder(void) {}
 
-void QualDecoder::decodeMappedRecordFromBlock(const SAMRecord &samRecord, File *qualFile) {
-    std::string qual("");
-
-    size_t cigarIdx = 0;
-    size_t cigarLen = samRecord.cigar.length();
-    size_t opLen = 0;
-    size_t qvciPos = samRecord.posMin - posOffset_;
-
-    for (cigarIdx = 0; cigarIdx < cigarLen; cigarIdx++) {
-       if (isdigit(samRecord.cigar[cigarIdx])) {
-           opLen = opLen*10 + (size_t)samRecord.cigar[cigarIdx] - (size_t)'0';
-           continue;
-       }
-
-       switch (samRecord.cigar[cigarIdx]) {
-       case 'M':
-       case '=':
-       case 'X':
-           // Decode opLen quality value indices with computed quantizer indices
-           for (size_t i = 0; i < opLen; i++) {
-               int quantizerIndex = qvci_[qvciPos++] - '0';
-               int qualityValueIndex = qvi_.at(quantizerIndex)[qviIdx_[quantizerIndex]++] - '0';
-               int q = quantizers_.at(quantizerIndex).indexToReconstructionValue(qualityValueIndex);
-               qual += q + qualityValueOffset_;
-           }
-           break;
-       case 'I':
-       case 'S':
-           // Decode opLen quality values with max quantizer index
-           for (size_t i = 0; i < opLen; i++) {
-               int qualityValueIndex = qvi_.at(quantizers_.size() - 1)[qviIdx_[quantizers_.size() - 1]++] - '0';
-               int q = quantizers_.at(quantizers_.size() - 1).indexToReconstructionValue(qualityValueIndex);
-               qual += q + qualityValueOffset_;
-           }
-           break;
-       case 'D':
-       case 'N':
-           qvciPos += opLen;
-           break;  // do nothing as these bases are not present
-       case 'H':
-       case 'P':
-           break;  // these have been clipped
-       default:
-           throwErrorException("Bad CIGAR string");
-       }
-       opLen = 0;
-    }
-
-    qualFile->write((unsigned char *)qual.c_str(), qual.length());
-    qualFile->writeByte('\n');
+void QualDecoder::decodeMappedRecordFromBlock(const SAMRecord &samRecord, std::string *buffer) {
+    // Reserve space for the quality values in buffer and write them there
+    // directly
+    size_t qualOffset = buffer->size();
+    ReadLengthVisitor readLength;
+    samRecord.cigarOps.visit(&readLength);
+    size_t qualLen = readLength.length;
+    buffer->resize(qualOffset + qualLen);
+    char *qual = &(*buffer)[0] + qualOffset;
+
+    // The first records of a streaming block may still belong to the
+    // previous RNAME
+    const bool tail = (nrTailRecords_ > 0);
+    const std::string &qvci = (tail == true) ? tailQvci_ : qvci_;
+    const uint32_t posOffset = (tail == true) ? tailPosOffset_ : posOffset_;
+    if (samRecord.posMin < posOffset || (samRecord.posMax - posOffset) >= qvci.length()) {
+        throwErrorException("Decoding quality values failed");
+    }
+
+    QualityValueDecodingVisitor decoding(qual,
+                                         qualityValueOffset_,
+                                         qvci.data() + (samRecord.posMin - posOffset),
+                                         quantizers_,
+                                         qvi_,
+                                         &qviIdx_);
+    samRecord.cigarOps.visit(&decoding);
+
+    if (tail == true) {
+        nrTailRecords_--;
+    } else {
+        posMinPrev_ = samRecord.posMin;
+    }
 }
 
-void QualDecoder::decodeUnmappedRecordFromBlock(const SAMRecord &samRecord, File *qualFile) {
+void QualDecoder::decodeUnmappedRecordFromBlock(const SAMRecord &samRecord, std::string *buffer) {
     // Get the read length from SEQ (CIGAR might be unavailable for an
     // unmapped record)
     size_t qualLen = samRecord.seq.length();
 
-    // Get the quality values
-    std::string qual = uqv_.substr(uqvIdx_, qualLen);
-    if (qual.empty() == true) {
+    // Append the quality values
+    if (uqvIdx_ >= uqv_.length()) {
         throwErrorException("Decoding quality values failed");
     }
+    buffer->append(uqv_, uqvIdx_, qualLen);
     uqvIdx_ += qualLen;
-
-    // Write the quality values
-    qualFile->write((unsigned char *)qual.c_str(), qual.length());
-    qualFile->writeByte('\n');
 }
 
 size_t QualDecoder::readBlock(CQFile *cqFile) {
+    if (cqFile->version() == CQFile::VERSION_1) {
+        return readBlockV1(cqFile);
+    }
+
+    size_t ret = 0;
+
+    // Read block parameters; the remaining parameters are in the file header
+    const bool streaming = cqFile->parameters().streaming;
+    uint32_t posOffset = 0;
+    uint32_t nrFinishedRecords = 0;
+    uint32_t nrTailRecords = 0;
+    uint32_t nrTailIndices = 0;
+    ret += cqFile->readUint32(&posOffset);
+    if (streaming == true) {
+        ret += cqFile->readUint32(&nrFinishedRecords);
+        ret += cqFile->readUint32(&nrTailRecords);
+        ret += cqFile->readUint32(&nrTailIndices);
+    }
+    qualityValueOffset_ = (int)cqFile->parameters().qualityValueOffset;
+    if (quantizers_.empty() == true) {
+        quantizers_ = cqFile->parameters().quantizers;
+    }
+
+    const std::vector<CQFile::StreamInfo> &streams = cqFile->parameters().streams;
+    if (streams.size() != (2 + quantizers_.size())) {
+        throwErrorException("Number of streams does not match number of quantizers");
+    }
+    for (auto const &stream : streams) {
+        if (CQFile::isCodecSupported(stream.codec) == false) {
+            throwErrorException("Unsupported stream codec");
+        }
+    }
+    if (streams[0].symbolFormat != CQFile::SYMBOLS_ASCII) {
+        throwErrorException("Unsupported symbol format for the unmapped quality values");
+    }
+
+    // Read the stream directory and then the streams, which are then
+    // decoded independently of each other: the unmapped quality values, the
+    // mapped quantizer indices, and the mapped quality value indices for each
+    // quantizer
+    streamSizes_.assign(streams.size(), 0);
+    for (auto &streamSize : streamSizes_) {
+        ret += cqFile->readUint64(&streamSize);
+    }
+    streamBuffers_.resize(streams.size());
+    for (size_t i = 0; i < streams.size(); ++i) {
+        streamBuffers_[i].resize(streamSizes_[i]);
+        if (streamSizes_[i] > 0) {
+            ret += cqFile->read(&streamBuffers_[i][0], streamSizes_[i]);
+        }
+    }
+
+    uqv_.clear();
+    uqvIdx_ = 0;
+    blockQvci_.clear();
+    qvi_.resize(quantizers_.size());
+    for (auto &qvi : qvi_) {
+        qvi.clear();
+    }
+    qviIdx_.assign(quantizers_.size(), 0);
+
+    auto readStream = [&](size_t streamIdx) {
+        if (streamBuffers_[streamIdx].empty() == true) {
+            return;
+        }
+        CQFile streamBuffer(&streamBuffers_[streamIdx], CQFile::MODE_READ);
+        streamBuffer.setThreadPool(threadPool_);
+        if (streamIdx == 0) {
+            streamBuffer.readQualBlock(&uqv_, streams[streamIdx].codec);
+        } else {
+            std::string *symbols = (streamIdx == 1) ? &blockQvci_ : &qvi_[streamIdx-2];
+            streamBuffer.readQualBlock(symbols, streams[streamIdx].codec);
+            CQFile::unpackSymbols(streams[streamIdx].symbolFormat, symbols);
+        }
+    };
+
+    if (threadPool_ != NULL) {
+        threadPool_->parallelFor(streams.size(), readStream);
+    } else {
+        for (size_t i = 0; i < streams.size(); ++i) {
+            readStream(i);
+        }
+    }
+
+    if (streaming == false) {
+        posOffset_ = posOffset;
+        qvci_.swap(blockQvci_);
+    } else {
+        nrFinishedRecords_ = nrFinishedRecords;
+        nrTailRecords_ = nrTailRecords;
+        appendQuantizerIndices(posOffset, nrTailIndices, &blockQvci_);
+    }
+
+    return ret;
+}
+
+size_t QualDecoder::readBlockV1(CQFile *cqFile) {
     size_t ret = 0;
 
+    // The parameters and streams are replaced by those of this block
+    quantizers_.clear();
+    uqv_.clear();
+    uqvIdx_ = 0;
+    qvci_.clear();
+    qvi_.clear();
+    qviIdx_.clear();
+
     // Read block parameters
     ret += cqFile->readUint32(&posOffset_);
     ret += cqFile->readUint32((uint32_t *)&qualityValueOffset_);
@@ -168,6 +285,115 @@ size_t QualDecoder::readBlock(CQFile *cqFile) {
         }
     }
 
+    // The indices are stored as ASCII digits
+    CQFile::unpackSymbols(CQFile::SYMBOLS_ASCII, &qvci_);
+    for (auto &qvi : qvi_) {
+        CQFile::unpackSymbols(CQFile::SYMBOLS_ASCII, &qvi);
+    }
+
+    return ret;
+}
+
+void QualDecoder::reset(void) {
+    posOffset_ = 0;
+    uqv_.clear();
+    qvci_.clear();
+    for (auto &qvi : qvi_) {
+        qvi.clear();
+    }
+    uqvIdx_ = 0;
+    qviIdx_.assign(qviIdx_.size(), 0);
+    blockQvci_.clear();
+    nrFinishedRecords_ = 0;
+    tailQvci_.clear();
+    tailPosOffset_ = 0;
+    nrTailRecords_ = 0;
+    posMinPrev_ = 0;
+}
+
+size_t QualDecoder::nrFinishedRecords(void) const {
+    return nrFinishedRecords_;
+}
+
+void QualDecoder::appendQuantizerIndices(const uint32_t &posOffset, const size_t &nrTailIndices, std::string *quantizerIndices) {
+    if (nrTailIndices > quantizerIndices->length()) {
+        throwErrorException("Decoding quantizer indices failed");
+    }
+
+    if (nrTailRecords_ > 0 || nrTailIndices > 0) {
+        // The previous RNAME ends in this block; its remaining records are
+        // decoded with the tail of its quantizer indices, the following ones
+        // with the indices starting at posOffset
+        tailQvci_.swap(qvci_);
+        tailQvci_.append(*quantizerIndices, 0, nrTailIndices);
+        tailPosOffset_ = posOffset_;
+        qvci_.assign(*quantizerIndices, nrTailIndices, std::string::npos);
+        posOffset_ = posOffset;
+        posMinPrev_ = posOffset;
+        return;
+    }
+
+    // Drop the indices which only already decoded records referred to
+    if (posMinPrev_ > posOffset_) {
+        size_t nrObsoleteIndices = std::min((size_t)(posMinPrev_ - posOffset_), qvci_.length());
+        qvci_.erase(0, nrObsoleteIndices);
+        posOffset_ += (uint32_t)nrObsoleteIndices;
+    }
+
+    if (qvci_.empty() == true) {
+        posOffset_ = posOffset;
+    } else if (posOffset != posOffset_ + qvci_.length()) {
+        throwErrorException("Decoding quantizer indices failed");
+    }
+    qvci_ += *quantizerIndices;
+}
+
+size_t QualDecoder::readRawBlock(CQFile *cqFile, std::string *block) {
+    if (block == NULL) {
+        throwErrorException("block is NULL");
+    }
+    if (block->empty() == false) {
+        throwErrorException("block is not empty");
+    }
+
+    size_t ret = 0;
+
+    if (cqFile->version() != CQFile::VERSION_1) {
+        // Block parameters and stream directory
+        const size_t nrBlockParameters = (cqFile->parameters().streaming == true) ? 4 : 1;
+        ret += cqFile->readRaw(block, nrBlockParameters * sizeof(uint32_t));
+        uint64_t streamsSize = 0;
+        for (size_t i = 0; i < cqFile->parameters().streams.size(); ++i) {
+            ret += cqFile->readRaw(block, sizeof(uint64_t));
+            uint64_t streamSize = 0;
+            for (size_t b = block->size() - sizeof(uint64_t); b < block->size(); ++b) {
+                streamSize = (streamSize << 8) | (uint64_t)(unsigned char)(*block)[b];
+            }
+            streamsSize += streamSize;
+        }
+
+        // Streams
+        ret += cqFile->readRaw(block, streamsSize);
+
+        return ret;
+    }
+
+    // Block parameters
+    ret += cqFile->readRaw(block, 2 * sizeof(uint32_t));
+
+    // Inverse quantization LUTs
+    size_t nrQuantizers = 0;
+    ret += cqFile->readRawQuantizers(block, &nrQuantizers);
+
+    // Unmapped quality values, mapped quantizer indices, and mapped quality
+    // value indices
+    for (size_t i = 0; i < (2 + nrQuantizers); ++i) {
+        ret += cqFile->readRaw(block, sizeof(uint8_t));
+        if ((*block)[block->size() - 1] & 0x01) {
+            ret += cqFile->readRawQualBlock(block);
+        }
+    }
+
     return ret;
 }
 
@@ -11,21 +11,49 @@
 #include <string>
 #include <vector>
 
+#include "Common/ThreadPool.h"
 #include "IO/CQ/CQFile.h"
 #include "IO/SAM/SAMRecord.h"
 
 namespace calq {
 
+// Decodes the quality values of a block. For CQ v3 (streaming) files, one
+// decoder is used for all blocks: the quantizer indices are carried over from
+// one block to the next, and a block holds the quality values of the next
+// nrFinishedRecords() mapped records, which may have been read with earlier
+// blocks; the mapped records must be decoded in their order in the file.
+// Otherwise, the decoder can be reused for the next block after reset().
 class QualDecoder {
  public:
-    QualDecoder(void);
+    explicit QualDecoder(ThreadPool *threadPool = NULL);
     ~QualDecoder(void);
 
-    void decodeMappedRecordFromBlock(const SAMRecord &samRecord, File *qualFile);
-    void decodeUnmappedRecordFromBlock(const SAMRecord &samRecord, File *qualFile);
+    // Decode the quality values of the next record of the current block
+    // and append them to buffer
+    void decodeMappedRecordFromBlock(const SAMRecord &samRecord, std::string *buffer);
+    void decodeUnmappedRecordFromBlock(const SAMRecord &samRecord, std::string *buffer);
+
+    // Reads a block; the streams of a CQ v2 block are decoded concurrently
+    // if a thread pool is available
     size_t readBlock(CQFile *cqFile);
 
+    // Copies the next block from cqFile to block without decoding it, so
+    // that it can later be passed to readBlock() via an in-memory CQFile
+    static size_t readRawBlock(CQFile *cqFile, std::string *block);
+
+    // Drops the decoded streams; the quantizers (which a QualDecoder
+    // takes from the header of the first CQ v2 or v3 file it reads) and the
+    // capacity of the buffers are kept
+    void reset(void);
+
+    // Number of mapped records whose quality values are in the current
+    // block (only for CQ v3 files)
+    size_t nrFinishedRecords(void) const;
+
  private:
+    size_t readBlockV1(CQFile *cqFile);
+    void appendQuantizerIndices(const uint32_t &posOffset, const size_t &nrTailIndices, std::string *quantizerIndices);
+
     uint32_t posOffset_;
     int qualityValueOffset_;
 
@@ -33,10 +61,27 @@ class QualDecoder {
     std::string qvci_;
     std::vector< std::string > qvi_;
 
+    // Entropy-coded streams and quantizer indices of the block being read
+    std::vector<uint64_t> streamSizes_;
+    std::vector<std::string> streamBuffers_;
+    std::string blockQvci_;
+
+    // Streaming: number of mapped records in the current block, the tail of
+    // the quantizer indices of the previous RNAME (starting at
+    // tailPosOffset_) and the number of records still to be decoded with it,
+    // and the position of the last decoded record
+    size_t nrFinishedRecords_;
+    std::string tailQvci_;
+    uint32_t tailPosOffset_;
+    size_t nrTailRecords_;
+    uint32_t posMinPrev_;
+
     size_t uqvIdx_;
     std::vector< size_t > qviIdx_;
 
     std::map<int, Quantizer> quantizers_;
+
+    ThreadPool *threadPool_;
 };
 
 }  // namespace calq
@@ -22,10 +22,55 @@
 
 namespace calq {
 
+// Quantizes the quality values of a mapped record: aligned bases with the
+// quantizer indices of their positions, inserted and soft-clipped bases with
+// the largest quantizer index
+struct QualityValueEncodingVisitor {
+    QualityValueEncodingVisitor(const char *qual,
+                                const int &qualityValueOffset,
+                                const char *quantizerIndices,
+                                const std::map<int, Quantizer> &quantizers,
+                                std::vector<std::string> *qualityValueIndices)
+        : qual(qual),
+          qualityValueOffset(qualityValueOffset),
+          quantizerIndices(quantizerIndices),
+          quantizers(quantizers),
+          qualityValueIndices(qualityValueIndices) {}
+    void match(const uint32_t &opLength) {
+        // Encode opLength quality values with computed quantizer indices
+        for (size_t i = 0; i < opLength; i++) {
+            int q = (int)*qual++ - qualityValueOffset;
+            int quantizerIndex = *quantizerIndices++;
+            int qualityValueIndex = quantizers.at(quantizerIndex).valueToIndex(q);
+            qualityValueIndices->at(quantizerIndex) += (char)qualityValueIndex;
+        }
+    }
+    void insertion(const uint32_t &opLength) {
+        // Encode opLength quality values with max quantizer index
+        for (size_t i = 0; i < opLength; i++) {
+            int q = (int)*qual++ - qualityValueOffset;
+            int qualityValueIndex = quantizers.at(QUANTIZER_IDX_MAX).valueToIndex(q);
+            qualityValueIndices->at(QUANTIZER_IDX_MAX) += (char)qualityValueIndex;
+        }
+    }
+    void deletion(const uint32_t &opLength) {
+        quantizerIndices += opLength;  // these bases are not present
+    }
+    const char *qual;
+    const int qualityValueOffset;
+    const char *quantizerIndices;
+    const std::map<int, Quantizer> &quantizers;
+    std::vector<std::string> *qualityValueIndices;
+};
+
 QualEncoder::QualEncoder(const int &polyploidy,
                          const int &qualityValueMax,
                          const int &qualityValueMin,
-                         const int &qualityValueOffset)
+                         const int &qualityValueOffset,
+                         const uint8_t codec,
+                         const bool fixedPointGenotyper,
+                         const bool streaming,
+                         ThreadPool *threadPool)
     : compressedMappedQualSize_(0),
       compressedUnmappedQualSize_(0),
       nrMappedRecords_(0),
@@ -34,19 +79,38 @@ QualEncoder::QualEncoder(const int &polyploidy,
       uncompressedUnmappedQualSize_(0),
 
       qualityValueOffset_(qualityValueOffset),
+      streaming_(streaming),
+      rnameId_(SAMRecord::NO_RNAME_ID),
       posOffset_(0),
 
       unmappedQualityValues_(""),
-      mappedQuantizerIndices_(),
-      mappedQualityValueIndices_(),
+      mappedQuantizerIndices_(""),
+      mappedQualityValueIndices_(NR_QUANTIZERS, ""),
+
+      streamBuffers_(2 + NR_QUANTIZERS, ""),
 
-      samPileupDeque_(),
+      nrWrittenQuantizerIndices_(0),
+      tailQuantizerIndices_(""),
+      nrTailRecords_(0),
+      nrFinishedRecords_(0),
 
-      genotyper_(polyploidy, qualityValueOffset, NR_QUANTIZERS),
+      // Histogram columns yield the exact quantizer indices only with the
+      // fixed-point genotyper
+      samPileupRing_(fixedPointGenotyper),
+      pileupSeq_(""),
+      pileupQual_(""),
+      pileupWindow_(),
+      windowQuantizerIndices_(),
+
+      genotyper_(polyploidy, qualityValueOffset, NR_QUANTIZERS, fixedPointGenotyper),
 
       quantizers_(),
 
-      samRecordDeque_() {
+      mappedRecordDeque_(),
+
+      codec_(codec),
+
+      threadPool_(threadPool) {
     if (polyploidy < 1) {
         throwErrorException("polyploidy must be greater than zero");
     }
@@ -59,6 +123,9 @@ QualEncoder::QualEncoder(const int &polyploidy,
     if (qualityValueOffset < 1) {
         throwErrorException("qualityValueOffset must be greater than zero");
     }
+    if (CQFile::isCodecSupported(codec) == false) {
+        throwErrorException("codec is not supported");
+    }
 
     // Construct quantizers
     int quantizerSteps = QUANTIZER_STEPS_MIN;
@@ -69,11 +136,6 @@ QualEncoder::QualEncoder(const int &polyploidy,
         quantizerSteps++;
         quantizerIdx++;
     }
-
-    // Initialize a buffer for mapped quality value indices per quantizer
-    for (int i = 0; i < NR_QUANTIZERS; ++i) {
-        mappedQualityValueIndices_.push_back(std::deque<int>());
-    }
 }
 
 QualEncoder::~QualEncoder(void) {}
@@ -84,105 +146,216 @@ void QualEncoder::addUnmappedRecordToBlock(const SAMRecord &samRecord) {
     nrUnmappedRecords_++;
 }
 
-void QualEncoder::addMappedRecordToBlock(const SAMRecord &samRecord) {
-    if (nrMappedRecords() == 0) {
-        posOffset_ = samRecord.posMin;
-        samPileupDeque_.setPosMin(samRecord.posMin);
-        samPileupDeque_.setPosMax(samRecord.posMax);
+void QualEncoder::addMappedRecordToBlock(SAMRecord *samRecord) {
+    if (samPileupRing_.empty() == false && samRecord->rnameId != rnameId_) {
+        // Only in streaming mode, where this is the first mapped record of
+        // a block: finish the previous RNAME, whose remaining quantizer
+        // indices and records go to this block ahead of the new ones
+        encodePending();
+        tailQuantizerIndices_.append(mappedQuantizerIndices_, nrWrittenQuantizerIndices_, std::string::npos);
+        nrTailRecords_ = nrFinishedRecords_;
+        mappedQuantizerIndices_.clear();
+        nrWrittenQuantizerIndices_ = 0;
     }
 
-    if (samRecord.posMax > samPileupDeque_.posMax()) {
-        samPileupDeque_.setPosMax(samRecord.posMax);
+    if (samPileupRing_.empty() == true) {
+        rnameId_ = samRecord->rnameId;
+        posOffset_ = samRecord->posMin;
+        samPileupRing_.clear();
+        samPileupRing_.setPosMin(samRecord->posMin);
+        samPileupRing_.setPosMax(samRecord->posMax);
     }
 
-    samRecord.addToPileupQueue(&samPileupDeque_);
-    samRecordDeque_.push_back(samRecord);
+    if (samRecord->posMin < samPileupRing_.posMin()) {
+        throwErrorException("SAM file is not sorted");
+    }
 
-    while (samPileupDeque_.posMin() < samRecord.posMin) {
-        int k = genotyper_.computeQuantizerIndex(samPileupDeque_.front().seq, samPileupDeque_.front().qual);
-        mappedQuantizerIndices_.push_back(k);
-        samPileupDeque_.pop_front();
+    if (samRecord->posMax > samPileupRing_.posMax()) {
+        samPileupRing_.setPosMax(samRecord->posMax);
     }
 
-    while (samRecordDeque_.front().posMax < samPileupDeque_.posMin()) {
-        encodeMappedQual(samRecordDeque_.front());
-        samRecordDeque_.pop_front();
+    samRecord->addToPileupQueue(&samPileupRing_);
+    mappedRecordDeque_.emplace_back(samRecord);
+
+    while (samPileupRing_.posMin() < samRecord->posMin) {
+        addFrontPileupToWindow();
+        samPileupRing_.pop_front();
+    }
+    if (pileupWindow_.size() >= PILEUP_WINDOW_SIZE) {
+        computeQuantizerIndices();
     }
 
-    uncompressedMappedQualSize_ += samRecord.qual.length();
+    // Records can be encoded once the quantizer indices of all their
+    // positions have been computed
+    while (mappedRecordDeque_.empty() == false && mappedRecordDeque_.front().posMax < (posOffset_ + mappedQuantizerIndices_.length())) {
+        encodeMappedQual(mappedRecordDeque_.front());
+        mappedRecordDeque_.pop_front();
+    }
+
+    uncompressedMappedQualSize_ += samRecord->qual.length();
     nrMappedRecords_++;
 }
 
 void QualEncoder::finishBlock(void) {
-    // Compute all remaining quantizers
-    while (samPileupDeque_.empty() == false) {
-        int k = genotyper_.computeQuantizerIndex(samPileupDeque_.front().seq, samPileupDeque_.front().qual);
-        mappedQuantizerIndices_.push_back(k);
-        samPileupDeque_.pop_front();
+    if (streaming_ == false) {
+        encodePending();
+        return;
     }
 
-    // Process all remaining records from queue
-    while (samRecordDeque_.empty() == false) {
-        encodeMappedQual(samRecordDeque_.front());
-        samRecordDeque_.pop_front();
+    // The pending records outlive the block they were read with
+    for (auto &mappedRecord : mappedRecordDeque_) {
+        mappedRecord.ownQual();
     }
 }
 
+void QualEncoder::finishStream(void) {
+    encodePending();
+}
+
 size_t QualEncoder::writeBlock(CQFile *cqFile) {
     compressedMappedQualSize_ = 0;
     compressedUnmappedQualSize_ = 0;
 
-    // Write block parameters
-    compressedMappedQualSize_ += cqFile->writeUint32(posOffset_);
-    compressedMappedQualSize_ += cqFile->writeUint32((uint32_t)qualityValueOffset_);
-
-    // Write inverse quantization LUTs
-    compressedMappedQualSize_ += cqFile->writeQuantizers(quantizers_);
+    // Write block parameters; the quality value offset and the inverse
+    // quantization LUTs are in the file header. The position is that of the
+    // first quantizer index following the tail of the previous RNAME.
+    compressedMappedQualSize_ += cqFile->writeUint32(posOffset_ + (uint32_t)nrWrittenQuantizerIndices_);
+    if (streaming_ == true) {
+        compressedMappedQualSize_ += cqFile->writeUint32((uint32_t)nrFinishedRecords_);
+        compressedMappedQualSize_ += cqFile->writeUint32((uint32_t)nrTailRecords_);
+        compressedMappedQualSize_ += cqFile->writeUint32((uint32_t)tailQuantizerIndices_.length());
+    }
 
-    // Write unmapped quality values
-    unsigned char *uqv = (unsigned char *)unmappedQualityValues_.c_str();
-    size_t uqvSize = unmappedQualityValues_.length();
-    if (uqvSize > 0) {
-        compressedUnmappedQualSize_ += cqFile->writeUint8(0x01);
-        compressedUnmappedQualSize_ += cqFile->writeQualBlock(uqv, uqvSize);
-    } else {
-        compressedUnmappedQualSize_ += cqFile->writeUint8(0x00);
+    // In streaming mode, the quantizer indices of this block are the tail of
+    // the previous RNAME followed by those not written with a previous block
+    const std::string *quantizerIndices = &mappedQuantizerIndices_;
+    std::string quantizerIndicesBuffer("");
+    if (streaming_ == true) {
+        quantizerIndicesBuffer = tailQuantizerIndices_;
+        quantizerIndicesBuffer.append(mappedQuantizerIndices_, nrWrittenQuantizerIndices_, std::string::npos);
+        quantizerIndices = &quantizerIndicesBuffer;
     }
 
-    // Write mapped quantizer indices
-    std::string mqiString("");
-    for (auto const &mappedQuantizerIndex : mappedQuantizerIndices_) {
-        mqiString += std::to_string(mappedQuantizerIndex);
+    // The streams are: the unmapped quality values, the mapped quantizer
+    // indices, and the mapped quality value indices for each quantizer. They
+    // are independent of each other, so each of them is entropy-coded into
+    // its own buffer (concurrently if a thread pool is available). The
+    // buffers are then written in this order, preceded by their sizes.
+    const size_t nrStreams = streamBuffers_.size();
+    for (auto &streamBuffer : streamBuffers_) {
+        streamBuffer.clear();
     }
-    unsigned char *mqi = (unsigned char *)mqiString.c_str();
-    size_t mqiSize = mqiString.length();
-    if (mqiSize > 0) {
-        compressedMappedQualSize_ += cqFile->writeUint8(0x01);
-        compressedMappedQualSize_ += cqFile->writeQualBlock(mqi, mqiSize);
+
+    auto writeStream = [&](size_t streamIdx) {
+        // The indices are written as they are, i.e., one uint8 symbol per
+        // byte
+        const std::string *stream = NULL;
+        if (streamIdx == 0) {
+            stream = &unmappedQualityValues_;
+        } else if (streamIdx == 1) {
+            stream = quantizerIndices;
+        } else {
+            stream = &mappedQualityValueIndices_[streamIdx-2];
+        }
+
+        if (stream->length() > 0) {
+            CQFile streamBuffer(&streamBuffers_[streamIdx], CQFile::MODE_WRITE);
+            streamBuffer.setThreadPool(threadPool_);
+            streamBuffer.writeQualBlock((unsigned char *)stream->data(), stream->length(), streamCodec(streamIdx));
+        }
+    };
+
+    if (threadPool_ != NULL) {
+        threadPool_->parallelFor(nrStreams, writeStream);
     } else {
-        compressedMappedQualSize_ += cqFile->writeUint8(0x00);
+        for (size_t i = 0; i < nrStreams; ++i) {
+            writeStream(i);
+        }
     }
 
-    // Write mapped quality value indices
-    for (int i = 0; i < NR_QUANTIZERS; ++i) {
-        std::deque<int> mqviStream = mappedQualityValueIndices_[i];
-        std::string mqviString("");
-        for (auto const &mqviInt : mqviStream) {
-            mqviString += std::to_string(mqviInt);
+    // Stream directory
+    for (size_t i = 0; i < nrStreams; ++i) {
+        if (i == 0) {
+            compressedUnmappedQualSize_ += cqFile->writeUint64(streamBuffers_[i].size());
+        } else {
+            compressedMappedQualSize_ += cqFile->writeUint64(streamBuffers_[i].size());
         }
-        unsigned char *mqvi = (unsigned char *)mqviString.c_str();
-        size_t mqviSize = mqviString.length();
-        if (mqviSize > 0) {
-            compressedMappedQualSize_ += cqFile->writeUint8(0x01);
-            compressedMappedQualSize_ += cqFile->writeQualBlock(mqvi, mqviSize);
+    }
+
+    for (size_t i = 0; i < nrStreams; ++i) {
+        if (i == 0) {
+            compressedUnmappedQualSize_ += cqFile->write((unsigned char *)streamBuffers_[i].data(), streamBuffers_[i].size());
         } else {
-            compressedMappedQualSize_ += cqFile->writeUint8(0x00);
+            compressedMappedQualSize_ += cqFile->write((unsigned char *)streamBuffers_[i].data(), streamBuffers_[i].size());
         }
     }
 
+    // Start the streams of the next block, keeping only the quantizer
+    // indices which pending records still refer to
+    unmappedQualityValues_.clear();
+    for (auto &mappedQualityValueIndices : mappedQualityValueIndices_) {
+        mappedQualityValueIndices.clear();
+    }
+    size_t nrObsoleteQuantizerIndices = mappedQuantizerIndices_.length();
+    if (mappedRecordDeque_.empty() == false) {
+        nrObsoleteQuantizerIndices = mappedRecordDeque_.front().posMin - posOffset_;
+    }
+    mappedQuantizerIndices_.erase(0, nrObsoleteQuantizerIndices);
+    posOffset_ += (uint32_t)nrObsoleteQuantizerIndices;
+    nrWrittenQuantizerIndices_ = mappedQuantizerIndices_.length();
+    tailQuantizerIndices_.clear();
+    nrTailRecords_ = 0;
+    nrFinishedRecords_ = 0;
+
     return compressedQualSize();
 }
 
+void QualEncoder::reset(void) {
+    compressedMappedQualSize_ = 0;
+    compressedUnmappedQualSize_ = 0;
+    nrMappedRecords_ = 0;
+    nrUnmappedRecords_ = 0;
+    uncompressedMappedQualSize_ = 0;
+    uncompressedUnmappedQualSize_ = 0;
+
+    rnameId_ = SAMRecord::NO_RNAME_ID;
+    posOffset_ = 0;
+
+    unmappedQualityValues_.clear();
+    mappedQuantizerIndices_.clear();
+    for (auto &mappedQualityValueIndices : mappedQualityValueIndices_) {
+        mappedQualityValueIndices.clear();
+    }
+
+    nrWrittenQuantizerIndices_ = 0;
+    tailQuantizerIndices_.clear();
+    nrTailRecords_ = 0;
+    nrFinishedRecords_ = 0;
+
+    samPileupRing_.clear();
+    pileupWindow_.clear();
+    mappedRecordDeque_.clear();
+}
+
+CQFile::Parameters QualEncoder::parameters(void) const {
+    CQFile::Parameters parameters;
+    parameters.qualityValueOffset = (uint32_t)qualityValueOffset_;
+    parameters.quantizers = quantizers_;
+    parameters.streaming = streaming_;
+
+    CQFile::StreamInfo stream;
+    stream.symbolFormat = CQFile::SYMBOLS_ASCII;
+    parameters.streams.assign(2 + NR_QUANTIZERS, stream);
+    for (size_t i = 0; i < parameters.streams.size(); ++i) {
+        parameters.streams[i].codec = streamCodec(i);
+        if (i > 0) {
+            parameters.streams[i].symbolFormat = CQFile::SYMBOLS_UINT8;
+        }
+    }
+
+    return parameters;
+}
+
 size_t QualEncoder::compressedMappedQualSize(void) const { return compressedMappedQualSize_; }
 size_t QualEncoder::compressedUnmappedQualSize(void) const { return compressedUnmappedQualSize_; }
 size_t QualEncoder::compressedQualSize(void) const { return (compressedMappedQualSize_ + compressedUnmappedQualSize_); }
@@ -193,56 +366,70 @@ size_t QualEncoder::uncompressedMappedQualSize(void) const { return uncompressed
 size_t QualEncoder::uncompressedUnmappedQualSize(void) const { return uncompressedUnmappedQualSize_; }
 size_t QualEncoder::uncompressedQualSize(void) const { return (uncompressedMappedQualSize_ + uncompressedUnmappedQualSize_); }
 
-void QualEncoder::encodeMappedQual(const SAMRecord &samRecord) {
-    size_t cigarIdx = 0;
-    size_t cigarLen = samRecord.cigar.length();
-    size_t opLen = 0;  // length of current CIGAR operation
-    size_t qualIdx = 0;
-    size_t quantizerIndicesIdx = samRecord.posMin - posOffset_;
-
-    for (cigarIdx = 0; cigarIdx < cigarLen; cigarIdx++) {
-       if (isdigit(samRecord.cigar[cigarIdx])) {
-           opLen = opLen*10 + (size_t)samRecord.cigar[cigarIdx] - (size_t)'0';
-           continue;
-       }
-
-       switch (samRecord.cigar[cigarIdx]) {
-       case 'M':
-       case '=':
-       case 'X':
-           // Encode opLen quality values with computed quantizer indices
-           for (size_t i = 0; i < opLen; i++) {
-               int q = (int)samRecord.qual[qualIdx++] - qualityValueOffset_;
-               int quantizerIndex = mappedQuantizerIndices_[quantizerIndicesIdx++];
-               int qualityValueIndex = quantizers_.at(quantizerIndex).valueToIndex(q);
-               mappedQualityValueIndices_.at(quantizerIndex).push_back(qualityValueIndex);
-           }
-           break;
-       case 'I':
-       case 'S':
-           // Encode opLen quality values with max quantizer index
-           for (size_t i = 0; i < opLen; i++) {
-               int q = (int)samRecord.qual[qualIdx++] - qualityValueOffset_;
-               int qualityValueIndex = quantizers_.at(QUANTIZER_IDX_MAX).valueToIndex(q);
-               mappedQualityValueIndices_.at(QUANTIZER_IDX_MAX).push_back(qualityValueIndex);
-           }
-           break;
-       case 'D':
-       case 'N':
-           quantizerIndicesIdx += opLen;
-           break;  // do nothing as these bases are not present
-       case 'H':
-       case 'P':
-           break;  // these have been clipped
-       default:
-           throwErrorException("Bad CIGAR string");
-       }
-       opLen = 0;
+void QualEncoder::encodeMappedQual(const MappedRecord &mappedRecord) {
+    QualityValueEncodingVisitor encoding(mappedRecord.qual.data(),
+                                         qualityValueOffset_,
+                                         mappedQuantizerIndices_.data() + (mappedRecord.posMin - posOffset_),
+                                         quantizers_,
+                                         &mappedQualityValueIndices_);
+    mappedRecord.cigarOps.visit(&encoding);
+    nrFinishedRecords_++;
+}
+
+void QualEncoder::encodeUnmappedQual(const StringView &qual) {
+    unmappedQualityValues_.append(qual.data(), qual.length());
+}
+
+void QualEncoder::encodePending(void) {
+    // Compute all remaining quantizers
+    while (samPileupRing_.empty() == false) {
+        addFrontPileupToWindow();
+        samPileupRing_.pop_front();
+    }
+    computeQuantizerIndices();
+
+    // Process all remaining records from queue
+    while (mappedRecordDeque_.empty() == false) {
+        encodeMappedQual(mappedRecordDeque_.front());
+        mappedRecordDeque_.pop_front();
     }
 }
 
-void QualEncoder::encodeUnmappedQual(const std::string &qual) {
-    unmappedQualityValues_ += qual;
+void QualEncoder::addFrontPileupToWindow(void) {
+    if (samPileupRing_.frontIsHistogram() == false) {
+        samPileupRing_.unpackFront(&pileupSeq_, &pileupQual_);
+        pileupWindow_.push_back(pileupSeq_, pileupQual_);
+        return;
+    }
+
+    // Histogram columns are not batched; the window is flushed first so
+    // that the quantizer indices stay in order
+    computeQuantizerIndices();
+    const SAMPileup &histogram = samPileupRing_.frontHistogram();
+    mappedQuantizerIndices_ += (char)genotyper_.computeQuantizerIndex(histogram.seq, histogram.qual, histogram.counts);
+}
+
+void QualEncoder::computeQuantizerIndices(void) {
+    if (pileupWindow_.empty() == true) {
+        return;
+    }
+
+    windowQuantizerIndices_.resize(pileupWindow_.size());
+    genotyper_.computeQuantizerIndices(pileupWindow_, &windowQuantizerIndices_[0]);
+    for (auto const &k : windowQuantizerIndices_) {
+        mappedQuantizerIndices_ += (char)k;
+    }
+    pileupWindow_.clear();
+}
+
+uint8_t QualEncoder::streamCodec(const size_t &streamIdx) const {
+    // The index streams use only a few distinct symbols, for which the range
+    // coder variant with alphabet-sized tables is cheaper to set up and to
+    // store
+    if (codec_ == CQFile::CODEC_RANGE_O1 && streamIdx > 0) {
+        return CQFile::CODEC_RANGE_O1_SMALL;
+    }
+    return codec_;
 }
 
 }  // namespace calq
@@ -19,28 +19,55 @@
 #include <string>
 #include <vector>
 
+#include "Common/ThreadPool.h"
 #include "config.h"
 #include "IO/CQ/CQFile.h"
-#include "IO/SAM/SAMPileupDeque.h"
+#include "IO/SAM/SAMPileupRing.h"
 #include "IO/SAM/SAMRecord.h"
 #include "QualCodec/Genotyper.h"
+#include "QualCodec/MappedRecord.h"
+#include "QualCodec/PileupWindow.h"
 #include "QualCodec/Quantizers/Quantizer.h"
 
 namespace calq {
 
+// Encodes the quality values of a block. In streaming mode, one encoder is
+// used for all blocks: finishBlock() leaves the pileup and the records which
+// cannot be encoded yet in place, so that they are carried over into the
+// next block, and writeBlock() writes only what has been finished. After the
+// last block, finishStream() encodes everything that is still pending, which
+// is then written with writeBlock() as a final block without records.
+// Otherwise, the encoder can be reused for the next block after reset().
 class QualEncoder {
  public:
     explicit QualEncoder(const int &polyploidy,
                          const int &qualityValueMax,
                          const int &qualityValueMin,
-                         const int &qualityValueOffset);
+                         const int &qualityValueOffset,
+                         const uint8_t codec,
+                         const bool fixedPointGenotyper,
+                         const bool streaming = false,
+                         ThreadPool *threadPool = NULL);
     ~QualEncoder(void);
 
     void addUnmappedRecordToBlock(const SAMRecord &samRecord);
-    void addMappedRecordToBlock(const SAMRecord &samRecord);
+    void addMappedRecordToBlock(SAMRecord *samRecord);
     void finishBlock(void);
+    void finishStream(void);
     size_t writeBlock(CQFile *cqFile);
 
+    // Drops all records and the statistics; the quantizers, the genotyper
+    // and the capacity of the stream buffers are kept, while the pileup
+    // gives back the memory it has grown by (e.g., for a spliced read), as
+    // several encoders may be kept around with -t
+    void reset(void);
+
+    // Parameters to be written to the CQ file header, which are shared by
+    // all blocks
+    CQFile::Parameters parameters(void) const;
+
+    // The compressed sizes refer to the last block written; the record
+    // counts and the uncompressed sizes accumulate over all blocks
     size_t compressedMappedQualSize(void) const;
     size_t compressedUnmappedQualSize(void) const;
     size_t compressedQualSize(void) const;
@@ -52,8 +79,12 @@ class QualEncoder {
     size_t uncompressedQualSize(void) const;
 
  private:
-    void encodeMappedQual(const SAMRecord &samRecord);
-    void encodeUnmappedQual(const std::string &qual);
+    void encodeMappedQual(const MappedRecord &mappedRecord);
+    void encodeUnmappedQual(const StringView &qual);
+    void encodePending(void);
+    void addFrontPileupToWindow(void);
+    void computeQuantizerIndices(void);
+    uint8_t streamCodec(const size_t &streamIdx) const;
 
  private:
     // Sizes & counters
@@ -67,16 +98,40 @@ class QualEncoder {
     // Quality value offset for this block
     int qualityValueOffset_;
 
-    // 0-based position offset of this block
+    // Carry the pileup and the pending records over into the next block
+    bool streaming_;
+
+    // Interned RNAME and 0-based position of mappedQuantizerIndices_[0]
+    uint32_t rnameId_;
     uint32_t posOffset_;
 
-    // Buffers
+    // Buffers; the indices are stored as one uint8 symbol per character
     std::string unmappedQualityValues_;
-    std::deque<int> mappedQuantizerIndices_;
-    std::vector< std::deque<int> > mappedQualityValueIndices_;
-
-    // Pileup
-    SAMPileupDeque samPileupDeque_;
+    std::string mappedQuantizerIndices_;
+    std::vector<std::string> mappedQualityValueIndices_;
+
+    // Entropy-coded streams of the block being written
+    std::vector<std::string> streamBuffers_;
+
+    // Streaming mode: number of leading mappedQuantizerIndices_ written with
+    // a previous block, quantizer indices (and number of records) of the
+    // previous RNAME finished in this block, and number of records whose
+    // quality values are in this block
+    size_t nrWrittenQuantizerIndices_;
+    std::string tailQuantizerIndices_;
+    size_t nrTailRecords_;
+    size_t nrFinishedRecords_;
+
+    // Pileup, and buffers for unpacking its columns
+    SAMPileupRing samPileupRing_;
+    std::string pileupSeq_;
+    std::string pileupQual_;
+
+    // Pileup columns whose quantizer indices have not been computed yet;
+    // they are handed to the genotyper in batches of PILEUP_WINDOW_SIZE
+    static const size_t PILEUP_WINDOW_SIZE = 256;
+    PileupWindow pileupWindow_;
+    std::vector<int> windowQuantizerIndices_;
 
     // Genotyper
     Genotyper genotyper_;
@@ -84,9 +139,15 @@ class QualEncoder {
     // Quantizers
     std::map<int, Quantizer> quantizers_;
 
-    // Double-ended queue holding the SAM records; records get popped when they
-    // are finally encoded
-    std::deque<SAMRecord> samRecordDeque_;
+    // Double-ended queue holding the mapped records; records get popped when
+    // they are finally encoded
+    std::deque<MappedRecord> mappedRecordDeque_;
+
+    // CQFile codec selected for the streams (see streamCodec())
+    uint8_t codec_;
+
+    // Optional thread pool used to entropy-code the streams concurrently
+    ThreadPool *threadPool_;
 };
 
 }  // namespace calq
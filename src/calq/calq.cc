@@ -42,16 +42,21 @@ int main(int argc, char *argv[]) {
         TCLAP::SwitchArg forceSwitch("f", "force", "Force overwriting of output files etc.", cmd, false);
         TCLAP::UnlabeledValueArg<std::string> inputFileNameArg("inputFileName", "Input file name", true, "", "string", cmd);
         TCLAP::ValueArg<std::string> outputFileNameArg("o", "outputFileName", "Output file name", false, "", "string", cmd);
+        TCLAP::ValueArg<int> threadsArg("t", "threads", "Number of threads", false, 1, "int", cmd);
 
         // TCLAP arguments (only compression)
         TCLAP::ValueArg<int> blockSizeArg("b", "blockSize", "Block size (in number of SAM records)", false, 10000, "int", cmd);
+        TCLAP::ValueArg<std::string> codecArg("c", "codec", "Entropy codec (range: order-1 range coder; rans0/rans1: order-0/order-1 rANS coder, faster to decode)", false, "range", "string", cmd);
+        TCLAP::ValueArg<std::string> genotyperArg("g", "genotyper", "Genotyper arithmetic (float: double precision; fixed: integer Phred-scaled fixed point, quantizer indices may rarely differ by one)", false, "float", "string", cmd);
         TCLAP::ValueArg<int> polyploidyArg("p", "polyploidy", "Polyploidy", false, 2, "int", cmd);
         TCLAP::ValueArg<std::string> qualityValueTypeArg("q", "qualityValueType", "Quality value type (Sanger: Phred+33 [0,40]; Illumina-1.3+: Phred+64 [0,40]; Illumina-1.5+: Phred+64 [0,40]; Illumina-1.8+: Phred+33 [0,41]; Max33: Phred+33 [0,93]; Max64: Phred+64 [0,62])", false, "Illumina-1.8+", "string", cmd);
         TCLAP::MultiArg<std::string> referenceFileNamesArg("r", "referenceFileNames", "Reference file name(s) (FASTA format)", false, "string", cmd);
+        TCLAP::SwitchArg streamingSwitch("S", "streaming", "Carry the pileup and the pending records over block boundaries (the blocks can then only be decoded in order)", cmd, false);
 
         // TCLAP arguments (only decompression)
         TCLAP::SwitchArg decompressSwitch("d", "decompress", "Decompress", cmd, false);
         TCLAP::ValueArg<std::string> sideInformationFileNameArg("s", "sideInformationFileName", "Side information file name", false, "", "string", cmd);
+        TCLAP::ValueArg<std::string> regionArg("R", "region", "Decode only the records overlapping the region rname[:start[-end]]", false, "", "string", cmd);
 
         // Let the TCLAP class parse the provided arguments
         cmd.parse(argc, argv);
@@ -64,6 +69,9 @@ int main(int argc, char *argv[]) {
             if (sideInformationFileNameArg.isSet() == true) {
                 throwErrorException("Argument 's' forbidden in compression mode");
             }
+            if (regionArg.isSet() == true) {
+                throwErrorException("Argument 'R' forbidden in compression mode");
+            }
         }
 
         // Check for sanity in decompression mode
@@ -71,6 +79,12 @@ int main(int argc, char *argv[]) {
             if (blockSizeArg.isSet() == true) {
                 throwErrorException("Argument 'b' forbidden in decompression mode");
             }
+            if (codecArg.isSet() == true) {
+                throwErrorException("Argument 'c' forbidden in decompression mode");
+            }
+            if (genotyperArg.isSet() == true) {
+                throwErrorException("Argument 'g' forbidden in decompression mode");
+            }
             if (polyploidyArg.isSet() == true) {
                 throwErrorException("Argument 'p' forbidden in decompression mode");
             }
@@ -80,6 +94,9 @@ int main(int argc, char *argv[]) {
             if (referenceFileNamesArg.isSet() == true) {
                 throwErrorException("Argument 'r' forbidden in decompression mode");
             }
+            if (streamingSwitch.isSet() == true) {
+                throwErrorException("Argument 'S' forbidden in decompression mode");
+            }
             if (sideInformationFileNameArg.isSet() == false) {
                 throwErrorException("Argument 's' required in decompression mode");
             }
@@ -89,12 +106,17 @@ int main(int argc, char *argv[]) {
         options.force = forceSwitch.getValue();
         options.inputFileName = inputFileNameArg.getValue();
         options.outputFileName = outputFileNameArg.getValue();
+        options.threads = threadsArg.getValue();
         options.blockSize = blockSizeArg.getValue();
+        options.codec = codecArg.getValue();
+        options.genotyper = genotyperArg.getValue();
         options.polyploidy = polyploidyArg.getValue();
         options.qualityValueType = qualityValueTypeArg.getValue();
         options.referenceFileNames = referenceFileNamesArg.getValue();
+        options.streaming = streamingSwitch.getValue();
         options.decompress = decompressSwitch.getValue();
         options.sideInformationFileName = sideInformationFileNameArg.getValue();
+        options.region = regionArg.getValue();
 
         // Check the options
         options.validate();
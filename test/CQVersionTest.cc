@@ -0,0 +1,92 @@
+/** @file CQVersionTest.cc
+ *  @brief This file contains the tests of encoding and decoding the CQ
+ *         format versions, including the streaming mode.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+
+#include <string>
+
+#include "Common/Exceptions.h"
+#include "roundtrip.h"
+#include "test.h"
+
+static const std::string TEST_SAM = TEST_FILES_DIR "/test.sam";
+
+// CQ v1, written by the encoder before the format changes
+static void testVersion1(void) {
+    const std::string cq = TEST_FILES_DIR "/test.sam.b37.v1.cq";
+    const std::string expected = calq::test::readFile(TEST_FILES_DIR "/test.sam.b37.qual");
+    CALQ_CHECK(calq::test::cqVersion(cq) == 1);
+
+    calq::Options options = calq::test::decoderOptions(cq, TEST_SAM, "v1.qual");
+    CALQ_CHECK(calq::test::decode(options) == expected);
+    options.threads = 3;
+    CALQ_CHECK(calq::test::decode(options) == expected);
+}
+
+// CQ v2 with all codecs; the quantization is the one of CQ v1
+static void testVersion2(void) {
+    const std::string expected = calq::test::readFile(TEST_FILES_DIR "/test.sam.b37.qual");
+    const char *codecs[] = {"range", "rans0", "rans1"};
+    for (auto const &codec : codecs) {
+        calq::Options options = calq::test::encoderOptions(TEST_SAM, "v2.cq");
+        options.blockSize = 37;
+        options.codec = codec;
+        calq::test::encode(options);
+        CALQ_CHECK(calq::test::cqVersion("v2.cq") == 2);
+
+        calq::Options decoderOptions = calq::test::decoderOptions("v2.cq", TEST_SAM, "v2.qual");
+        CALQ_CHECK(calq::test::decode(decoderOptions) == expected);
+        decoderOptions.threads = 3;
+        CALQ_CHECK(calq::test::decode(decoderOptions) == expected);
+    }
+}
+
+// CQ v3: streaming with small blocks gives the quality values of one
+// unbounded block per reference sequence
+static void testVersion3(const std::string &sam, const std::string &genotyper) {
+    calq::Options options = calq::test::encoderOptions(sam, "unbounded.cq");
+    options.blockSize = 1000000;
+    options.genotyper = genotyper;
+    calq::test::encode(options);
+    CALQ_CHECK(calq::test::cqVersion("unbounded.cq") == 2);
+    const std::string expected = calq::test::decode(calq::test::decoderOptions("unbounded.cq", sam, "unbounded.qual"));
+    CALQ_CHECK(expected.empty() == false);
+
+    const int blockSizes[] = {1, 7, 37, 333};
+    for (auto const &blockSize : blockSizes) {
+        options.outputFileName = "v3.cq";
+        options.blockSize = blockSize;
+        options.streaming = true;
+        options.threads = (blockSize == 37) ? 3 : 1;
+        calq::test::encode(options);
+        CALQ_CHECK(calq::test::cqVersion("v3.cq") == 3);
+
+        calq::Options decoderOptions = calq::test::decoderOptions("v3.cq", sam, "v3.qual");
+        CALQ_CHECK(calq::test::decode(decoderOptions) == expected);
+        decoderOptions.threads = 3;
+        CALQ_CHECK(calq::test::decode(decoderOptions) == expected);
+        if (calq::test::readFile("v3.qual") != expected) {
+            fprintf(stderr, "%s with block size %d\n", sam.c_str(), blockSize);
+        }
+    }
+}
+
+int main(void) {
+    try {
+        testVersion1();
+        testVersion2();
+        testVersion3(TEST_SAM, "float");
+        calq::test::writeSamFile("version.sam", 400, 24);
+        testVersion3("version.sam", "float");
+        testVersion3("version.sam", "fixed");
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
@@ -0,0 +1,209 @@
+/** @file GenotyperTest.cc
+ *  @brief This file contains the tests of the Genotyper class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Common/Exceptions.h"
+#include "IO/SAM/SAMPileup.h"
+#include "QualCodec/Genotyper.h"
+#include "QualCodec/PileupWindow.h"
+#include "test.h"
+
+static const int QUAL_OFFSET = 33;
+static const int NR_QUANTIZERS = 8;
+
+// Pseudo-random pileup column of depth [minDepth, maxDepth]: the bases of a
+// random genotype with sequencing errors (some of them not A, C, G, or T)
+// and quality values in [2, 41]
+static void randomColumn(uint32_t *state,
+                         const int &polyploidy,
+                         const size_t &minDepth,
+                         const size_t &maxDepth,
+                         std::string *seq,
+                         std::string *qual) {
+    std::string genotype;
+    for (int i = 0; i < polyploidy; i++) {
+        genotype += "ACGT"[calq::test::nextRandom(state, 4)];
+    }
+
+    const size_t depth = minDepth + calq::test::nextRandom(state, (uint32_t)(maxDepth - minDepth + 1));
+    seq->clear();
+    qual->clear();
+    for (size_t d = 0; d < depth; d++) {
+        char base = genotype[calq::test::nextRandom(state, (uint32_t)polyploidy)];
+        if (calq::test::nextRandom(state, 20) == 0) {
+            base = "ACGTN"[calq::test::nextRandom(state, 5)];
+        }
+        *seq += base;
+        *qual += (char)(QUAL_OFFSET + 2 + calq::test::nextRandom(state, 40));
+    }
+}
+
+// The fixed-point engine yields the quantizer index of the double precision
+// computation up to the rounding documented in Genotyper.h: at most one
+// apart, in less than 1 in 1000 columns
+static void testFixedPoint(const int &polyploidy) {
+    calq::Genotyper fixedPoint(polyploidy, QUAL_OFFSET, NR_QUANTIZERS, true);
+    calq::Genotyper floatingPoint(polyploidy, QUAL_OFFSET, NR_QUANTIZERS, false);
+
+    const size_t NR_COLUMNS = 20000;
+    size_t nrMismatches = 0;
+    uint32_t state = (uint32_t)polyploidy;
+    std::string seq;
+    std::string qual;
+    for (size_t i = 0; i < NR_COLUMNS; i++) {
+        randomColumn(&state, polyploidy, 0, 50, &seq, &qual);
+        int fixedPointIndex = fixedPoint.computeQuantizerIndex(seq, qual);
+        int floatingPointIndex = floatingPoint.computeQuantizerIndex(seq, qual);
+        CALQ_CHECK(abs(fixedPointIndex - floatingPointIndex) <= 1);
+        if (fixedPointIndex != floatingPointIndex) {
+            nrMismatches++;
+        }
+    }
+    CALQ_CHECK((nrMismatches * 1000) < NR_COLUMNS);
+}
+
+// computeQuantizerIndices() yields exactly the quantizer indices of
+// computeQuantizerIndex(). Without fixedPoint, the columns with at least two
+// bases are processed by the 8-lane AVX-512 kernel if the CPU supports
+// AVX-512, by the 4-lane AVX2 kernel if it supports only AVX2, and by the
+// scalar code otherwise; i.e., only one of the kernels runs on a given CPU.
+// The window sizes leave partial lane groups, columns of depth 0 and 1 are
+// interspersed, and polyploidy 3 has 20 genotypes, which is not a multiple
+// of the number of lanes.
+static void testBatch(const int &polyploidy, const bool &fixedPoint) {
+    calq::Genotyper batchGenotyper(polyploidy, QUAL_OFFSET, NR_QUANTIZERS, fixedPoint);
+    calq::Genotyper columnGenotyper(polyploidy, QUAL_OFFSET, NR_QUANTIZERS, fixedPoint);
+
+    const size_t windowSizes[] = {1, 2, 3, 5, 7, 8, 9, 11, 16, 17, 31, 100};
+    uint32_t state = (uint32_t)polyploidy;
+    calq::PileupWindow window;
+    std::vector<std::string> seqs;
+    std::vector<std::string> quals;
+    std::string seq;
+    std::string qual;
+    for (auto const &windowSize : windowSizes) {
+        window.clear();
+        seqs.clear();
+        quals.clear();
+        for (size_t i = 0; i < windowSize; i++) {
+            // Every fourth column has a depth of 0 or 1
+            const size_t maxDepth = (calq::test::nextRandom(&state, 4) == 0) ? 1 : 200;
+            randomColumn(&state, polyploidy, 0, maxDepth, &seq, &qual);
+            window.push_back(seq, qual);
+            seqs.push_back(seq);
+            quals.push_back(qual);
+        }
+
+        std::vector<int> quantizerIndices(windowSize, -1);
+        batchGenotyper.computeQuantizerIndices(window, &quantizerIndices[0]);
+        for (size_t i = 0; i < windowSize; i++) {
+            CALQ_CHECK(quantizerIndices[i] == columnGenotyper.computeQuantizerIndex(seqs[i], quals[i]));
+        }
+    }
+}
+
+// Pseudo-random pileup column deeper than SAMPileup::HISTOGRAM_DEPTH which
+// does not yield a trivial quantizer index: polyploidy + 1 alleles occur
+// with the same quality values, so that the genotypes formed from them tie,
+// and a few additional low-quality bases break the tie. Bases other than
+// A, C, G, and T (which do not favor any genotype) are interspersed, and
+// the column is shuffled.
+static void randomDeepColumn(uint32_t *state,
+                             const int &polyploidy,
+                             std::string *seq,
+                             std::string *qual) {
+    seq->clear();
+    qual->clear();
+    const size_t nrAlleles = (size_t)polyploidy + 1;
+    const size_t nrGroups = (calq::SAMPileup::HISTOGRAM_DEPTH / nrAlleles) + 1 + calq::test::nextRandom(state, 500);
+    for (size_t i = 0; i < nrGroups; i++) {
+        char q = (char)(QUAL_OFFSET + 2 + calq::test::nextRandom(state, 40));
+        for (size_t a = 0; a < nrAlleles; a++) {
+            *seq += "ACGT"[a];
+            *qual += q;
+        }
+    }
+    const size_t nrExtraBases = calq::test::nextRandom(state, 8);
+    for (size_t i = 0; i < nrExtraBases; i++) {
+        *seq += "ACGT"[calq::test::nextRandom(state, (uint32_t)nrAlleles)];
+        *qual += (char)(QUAL_OFFSET + 2 + calq::test::nextRandom(state, 3));
+    }
+    const size_t nrOtherBases = calq::test::nextRandom(state, 100);
+    for (size_t i = 0; i < nrOtherBases; i++) {
+        *seq += "NRY*"[calq::test::nextRandom(state, 4)];
+        *qual += (char)(QUAL_OFFSET + 2 + calq::test::nextRandom(state, 40));
+    }
+
+    for (size_t i = seq->length() - 1; i > 0; i--) {
+        size_t j = calq::test::nextRandom(state, (uint32_t)(i + 1));
+        std::swap((*seq)[i], (*seq)[j]);
+        std::swap((*qual)[i], (*qual)[j]);
+    }
+}
+
+// Beyond SAMPileup::HISTOGRAM_DEPTH, the histogram overload of
+// computeQuantizerIndex() yields the fixed-point quantizer index of the
+// column which the histogram was built from, also if the column contains
+// bases other than A, C, G, and T (which the histogram does not distinguish)
+static void testHistogram(const int &polyploidy) {
+    calq::Genotyper genotyper(polyploidy, QUAL_OFFSET, NR_QUANTIZERS, true);
+
+    uint32_t state = (uint32_t)polyploidy;
+    std::string seq;
+    std::string qual;
+    for (size_t i = 0; i < 50; i++) {
+        randomDeepColumn(&state, polyploidy, &seq, &qual);
+        calq::SAMPileup histogramPileup(true);
+        calq::SAMPileup pileup(false);
+        for (size_t d = 0; d < seq.length(); d++) {
+            histogramPileup.add(seq[d], qual[d]);
+            pileup.add(seq[d], qual[d]);
+        }
+        CALQ_CHECK(histogramPileup.isHistogram() == true);
+        CALQ_CHECK(pileup.isHistogram() == false);
+        CALQ_CHECK(histogramPileup.depth() == seq.length());
+
+        uint64_t depth = 0;
+        for (auto const &count : histogramPileup.counts) {
+            depth += count;
+        }
+        CALQ_CHECK(depth == seq.length());
+
+        int quantizerIndex = genotyper.computeQuantizerIndex(histogramPileup.seq, histogramPileup.qual, histogramPileup.counts);
+        CALQ_CHECK(quantizerIndex == genotyper.computeQuantizerIndex(pileup.seq, pileup.qual));
+    }
+}
+
+int main(void) {
+    try {
+        const int polyploidies[] = {1, 2, 4};
+        for (auto const &polyploidy : polyploidies) {
+            testFixedPoint(polyploidy);
+        }
+
+        const int batchPolyploidies[] = {1, 2, 3};
+        for (auto const &polyploidy : batchPolyploidies) {
+            testBatch(polyploidy, false);
+            testBatch(polyploidy, true);
+        }
+
+        for (auto const &polyploidy : batchPolyploidies) {
+            testHistogram(polyploidy);
+        }
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
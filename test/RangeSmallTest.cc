@@ -0,0 +1,135 @@
+/** @file RangeSmallTest.cc
+ *  @brief This file contains the tests of the order-1 range codec for small
+ *         alphabets.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Common/Exceptions.h"
+#include "Compressors/range/range.h"
+#include "IO/CQ/CQFile.h"
+#include "test.h"
+
+static unsigned int capacity(const size_t &inputSize) {
+    return (unsigned int)((1.05 * inputSize) + (257 * 257 * 3) + 37);
+}
+
+// Returns the compressed size, or 0 if the compression failed
+static unsigned int testRoundTrip(range_ctx *ctx, const std::string &input) {
+    std::vector<unsigned char> compressed(capacity(input.size()));
+    unsigned int compressedSize = 0;
+    unsigned char *ret = range_compress_o1_small_ctx(ctx, (const unsigned char *)input.data(), (unsigned int)input.size(),
+                                                     compressed.data(), (unsigned int)compressed.size(), &compressedSize);
+    CALQ_CHECK(ret == compressed.data());
+    if (ret == NULL) {
+        return 0;
+    }
+    CALQ_CHECK(range_decompressed_size(compressed.data()) == input.size());
+
+    // The decoder gets exactly the compressed bytes
+    std::vector<unsigned char> in(compressed.begin(), compressed.begin() + compressedSize);
+    std::vector<unsigned char> out(input.size());
+    unsigned int outSize = 0;
+    CALQ_CHECK(range_decompress_o1_small_ctx(ctx, in.data(), out.data(), &outSize) == out.data());
+    CALQ_CHECK(outSize == input.size());
+    CALQ_CHECK(memcmp(out.data(), input.data(), input.size()) == 0);
+
+    // The capacity is used up to the last byte
+    std::vector<unsigned char> exact(compressedSize);
+    CALQ_CHECK(range_compress_o1_small_ctx(ctx, (const unsigned char *)input.data(), (unsigned int)input.size(),
+                                           exact.data(), compressedSize, &outSize) == exact.data());
+    CALQ_CHECK(outSize == compressedSize);
+    CALQ_CHECK(exact == in);
+    CALQ_CHECK(range_compress_o1_small_ctx(ctx, (const unsigned char *)input.data(), (unsigned int)input.size(),
+                                           exact.data(), compressedSize - 1, &outSize) == NULL);
+
+    return compressedSize;
+}
+
+static unsigned int compressedSizeO1(range_ctx *ctx, const std::string &input) {
+    std::vector<unsigned char> compressed(capacity(input.size()));
+    unsigned int compressedSize = 0;
+    range_compress_o1_ctx(ctx, (const unsigned char *)input.data(), (unsigned int)input.size(),
+                          compressed.data(), (unsigned int)compressed.size(), &compressedSize);
+    return compressedSize;
+}
+
+// Maps the symbols [0, k) to the given symbol values
+static std::string mapSymbols(const std::string &input, const std::string &symbols) {
+    std::string output(input);
+    for (auto &c : output) {
+        c = symbols[(unsigned char)c];
+    }
+    return output;
+}
+
+int main(void) {
+    range_ctx *ctx = range_ctx_create();
+    CALQ_CHECK(ctx != NULL);
+    if (ctx == NULL) {
+        return calq::test::result();
+    }
+
+    // Empty input and too small output buffers
+    unsigned char out[16];
+    unsigned int outSize = 0;
+    CALQ_CHECK(range_compress_o1_small_ctx(ctx, out, 0, out, sizeof(out), &outSize) == NULL);
+    std::string digits("0123456789");
+    CALQ_CHECK(range_compress_o1_small_ctx(ctx, (const unsigned char *)digits.data(), (unsigned int)digits.size(),
+                                           out, 5 + 9, &outSize) == NULL);
+
+    // One symbol, also shorter than the 8 interleaved coders
+    testRoundTrip(ctx, std::string("7"));
+    testRoundTrip(ctx, std::string(5, '\0'));
+    testRoundTrip(ctx, std::string(100000, '\xff'));
+
+    // Alphabets of all sizes, with the o1 coder sharing the context in
+    // between
+    for (unsigned int k = 2; k <= 256; k = (k < 20) ? k + 1 : k * 2) {
+        for (size_t length = 1; length <= 9; length += 4) {
+            testRoundTrip(ctx, calq::test::randomBytes(length, k, k));
+        }
+        std::string input = calq::test::randomBytes(70000 + k, k, k);
+        testRoundTrip(ctx, input);
+        compressedSizeO1(ctx, input);
+        testRoundTrip(ctx, input);
+    }
+
+    // Sparse symbol values
+    std::string sparse = mapSymbols(calq::test::randomBytes(50000, 3, 5), std::string("\x00\xc8\xff", 3));
+    testRoundTrip(ctx, sparse);
+
+    // Quantizer indices as ASCII digits, where the small model pays off
+    std::string indices = mapSymbols(calq::test::randomBytes(2000, 3, 6), std::string("012"));
+    unsigned int smallSize = testRoundTrip(ctx, indices);
+    CALQ_CHECK(smallSize > 0 && smallSize < compressedSizeO1(ctx, indices));
+
+    range_ctx_destroy(ctx);
+
+    // Through CQFile, with an incompressible (i.e. raw) sub-block
+    std::string block = mapSymbols(calq::test::randomBytes(1200000, 8, 7), std::string("01234567"))
+                        + calq::test::randomBytes(1048576, 256, 8);
+    try {
+        std::string buffer;
+        {
+            calq::CQFile cqFile(&buffer, calq::CQFile::MODE_WRITE);
+            cqFile.writeQualBlock((unsigned char *)block.data(), block.size(), calq::CQFile::CODEC_RANGE_O1_SMALL);
+        }
+        CALQ_CHECK(buffer.size() < block.size());
+        calq::CQFile cqFile(&buffer, calq::CQFile::MODE_READ);
+        std::string decoded;
+        cqFile.readQualBlock(&decoded, calq::CQFile::CODEC_RANGE_O1_SMALL);
+        CALQ_CHECK(decoded == block);
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
@@ -0,0 +1,139 @@
+/** @file RangeTest.cc
+ *  @brief This file contains the tests of the order-1 range codec with
+ *         reusable contexts.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Common/Exceptions.h"
+#include "Common/ThreadPool.h"
+#include "Compressors/range/range.h"
+#include "IO/CQ/CQFile.h"
+#include "test.h"
+
+// Output capacity which always suffices for the order-1 range coder
+static unsigned int capacity(const size_t &inputSize) {
+    return (unsigned int)((1.05 * inputSize) + (257 * 257 * 3) + 37);
+}
+
+static void testRoundTrip(range_ctx *ctx, const std::string &input) {
+    std::vector<unsigned char> compressed(capacity(input.size()));
+    unsigned int compressedSize = 0;
+    unsigned char *ret = range_compress_o1_ctx(ctx, (const unsigned char *)input.data(), (unsigned int)input.size(),
+                                               compressed.data(), (unsigned int)compressed.size(), &compressedSize);
+    CALQ_CHECK(ret == compressed.data());
+    if (ret == NULL) {
+        return;
+    }
+    CALQ_CHECK(range_decompressed_size(compressed.data()) == input.size());
+
+    std::vector<unsigned char> out(input.size());
+    unsigned int outSize = 0;
+    CALQ_CHECK(range_decompress_o1_ctx(ctx, compressed.data(), out.data(), &outSize) == out.data());
+    CALQ_CHECK(outSize == input.size());
+    CALQ_CHECK(memcmp(out.data(), input.data(), input.size()) == 0);
+
+    // The output of the context coder is the format of range_compress_o1()
+    unsigned int legacyOutSize = 0;
+    unsigned char *legacyOut = range_decompress_o1(compressed.data(), &legacyOutSize);
+    CALQ_CHECK(legacyOut != NULL);
+    if (legacyOut != NULL) {
+        CALQ_CHECK(legacyOutSize == input.size());
+        CALQ_CHECK(memcmp(legacyOut, input.data(), input.size()) == 0);
+        free(legacyOut);
+    }
+
+    unsigned int legacySize = 0;
+    unsigned char *legacy = range_compress_o1((unsigned char *)input.data(), (unsigned int)input.size(), &legacySize);
+    CALQ_CHECK(legacy != NULL);
+    if (legacy != NULL) {
+        CALQ_CHECK(range_decompress_o1_ctx(ctx, legacy, out.data(), &outSize) == out.data());
+        CALQ_CHECK(outSize == input.size());
+        CALQ_CHECK(memcmp(out.data(), input.data(), input.size()) == 0);
+        free(legacy);
+    }
+}
+
+static void testSmallOutputBuffer(range_ctx *ctx) {
+    unsigned char out[16];
+    unsigned int outSize = 0;
+
+    // Nothing to compress
+    CALQ_CHECK(range_compress_o1_ctx(ctx, out, 0, out, sizeof(out), &outSize) == NULL);
+
+    // Incompressible data does not fit into a buffer smaller than the input,
+    // which is how CQFile decides to store a sub-block raw
+    std::string input = calq::test::randomBytes(100000, 256, 3);
+    std::vector<unsigned char> compressed(input.size() - 1);
+    CALQ_CHECK(range_compress_o1_ctx(ctx, (const unsigned char *)input.data(), (unsigned int)input.size(),
+                                     compressed.data(), (unsigned int)compressed.size(), &outSize) == NULL);
+    CALQ_CHECK(range_compress_o1_ctx(ctx, (const unsigned char *)input.data(), (unsigned int)input.size(),
+                                     out, sizeof(out), &outSize) == NULL);
+
+    // The context is still usable afterwards
+    testRoundTrip(ctx, input);
+}
+
+static void testQualBlock(const std::string &input, const uint8_t codec, calq::ThreadPool *threadPool) {
+    std::string buffer;
+    {
+        calq::CQFile cqFile(&buffer, calq::CQFile::MODE_WRITE);
+        cqFile.setThreadPool(threadPool);
+        cqFile.writeQualBlock((unsigned char *)input.data(), input.size(), codec);
+    }
+
+    calq::CQFile cqFile(&buffer, calq::CQFile::MODE_READ);
+    cqFile.setThreadPool(threadPool);
+    std::string block;
+    cqFile.readQualBlock(&block, codec);
+    CALQ_CHECK(block == input);
+}
+
+int main(void) {
+    std::vector<std::string> inputs;
+    inputs.push_back(std::string("A"));
+    inputs.push_back(std::string(100000, 'F'));
+    for (size_t length = 1; length <= 17; length++) {
+        inputs.push_back(calq::test::randomBytes(length, 4, (uint32_t)length));
+    }
+    inputs.push_back(calq::test::randomBytes(300000, 256, 1));
+    inputs.push_back(calq::test::randomBytes(200003, 3, 2));
+    std::string qualityValues(150000, '\0');
+    for (size_t i = 0; i < qualityValues.size(); i++) {
+        qualityValues[i] = (char)('#' + ((i / 7) % 40));
+    }
+    inputs.push_back(qualityValues);
+
+    // One context is reused for all inputs, whose alphabets differ
+    range_ctx *ctx = range_ctx_create();
+    CALQ_CHECK(ctx != NULL);
+    if (ctx == NULL) {
+        return calq::test::result();
+    }
+    for (auto const &input : inputs) {
+        testRoundTrip(ctx, input);
+    }
+    testSmallOutputBuffer(ctx);
+    range_ctx_destroy(ctx);
+
+    // Blocks of several sub-blocks, some of which are stored raw
+    std::string block = qualityValues + calq::test::randomBytes(1500000, 256, 4) + qualityValues;
+    try {
+        calq::ThreadPool threadPool(3);
+        testQualBlock(std::string("A"), calq::CQFile::CODEC_RANGE_O1, NULL);
+        testQualBlock(block, calq::CQFile::CODEC_RANGE_O1, NULL);
+        testQualBlock(block, calq::CQFile::CODEC_RANGE_O1, &threadPool);
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
@@ -0,0 +1,118 @@
+/** @file RansTest.cc
+ *  @brief This file contains the tests of the rANS codec.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "Compressors/rans/rans.h"
+#include "test.h"
+
+typedef unsigned char * (*Compressor)(const unsigned char *, unsigned int, unsigned int *);
+
+// Decodes in with a fresh context and with ctx, which is shared by all
+// tests, so that its tables are reused for inputs of either order and after
+// malformed inputs
+static unsigned char * decompress(rans_ctx *ctx, const std::vector<unsigned char> &in, std::vector<unsigned char> *out, unsigned int *outSize) {
+    unsigned char *decompressed = rans_decompress_to(in.data(), (unsigned int)in.size(), out->data(), outSize);
+    std::vector<unsigned char> outCtx(out->size());
+    unsigned int outSizeCtx = 0;
+    unsigned char *decompressedCtx = rans_decompress_to_ctx(ctx, in.data(), (unsigned int)in.size(), outCtx.data(), &outSizeCtx);
+    CALQ_CHECK((decompressed == NULL) == (decompressedCtx == NULL));
+    if (decompressed != NULL && decompressedCtx != NULL) {
+        CALQ_CHECK(outSizeCtx == *outSize);
+        CALQ_CHECK(outCtx == *out);
+    }
+    return decompressed;
+}
+
+static void testRoundTrip(rans_ctx *ctx, const Compressor &compress, const std::string &input) {
+    unsigned int compressedSize = 0;
+    unsigned char *compressed = compress((const unsigned char *)input.data(), (unsigned int)input.size(), &compressedSize);
+    CALQ_CHECK(compressed != NULL);
+    if (compressed == NULL) {
+        return;
+    }
+
+    // The decoder gets exactly the compressed bytes, so reading beyond them
+    // is caught by the address sanitizer
+    std::vector<unsigned char> in(compressed, compressed + compressedSize);
+    free(compressed);
+    CALQ_CHECK(rans_decompressed_size(in.data(), (unsigned int)in.size()) == input.size());
+
+    std::vector<unsigned char> out(input.size() + 1);
+    unsigned int outSize = 0;
+    unsigned char *decompressed = decompress(ctx, in, &out, &outSize);
+    CALQ_CHECK(decompressed == out.data());
+    CALQ_CHECK(outSize == input.size());
+    CALQ_CHECK(memcmp(out.data(), input.data(), input.size()) == 0);
+}
+
+static void testTruncatedInput(rans_ctx *ctx, const Compressor &compress, const std::string &input) {
+    unsigned int compressedSize = 0;
+    unsigned char *compressed = compress((const unsigned char *)input.data(), (unsigned int)input.size(), &compressedSize);
+    CALQ_CHECK(compressed != NULL);
+    if (compressed == NULL) {
+        return;
+    }
+
+    std::vector<unsigned char> out(input.size());
+    for (unsigned int size = 0; size < compressedSize; size += 1 + (compressedSize / 64)) {
+        std::vector<unsigned char> in(compressed, compressed + size);
+        unsigned int outSize = 0;
+        CALQ_CHECK(decompress(ctx, in, &out, &outSize) == NULL);
+    }
+    free(compressed);
+}
+
+int main(void) {
+    std::vector<std::string> inputs;
+    inputs.push_back(std::string());
+    inputs.push_back(std::string("A"));
+    inputs.push_back(std::string(100000, 'F'));
+
+    // Lengths around the number of interleaved states
+    for (size_t length = 31; length <= 65; length++) {
+        inputs.push_back(calq::test::randomBytes(length, 4, (uint32_t)length));
+    }
+
+    // Incompressible, i.e. all byte values with equal frequencies
+    inputs.push_back(calq::test::randomBytes(300000, 256, 1));
+
+    // Small alphabet, as in the quantizer index streams
+    inputs.push_back(calq::test::randomBytes(200003, 3, 2));
+
+    // Quality values with a strong order-1 dependency
+    std::string qualityValues(150000, '\0');
+    for (size_t i = 0; i < qualityValues.size(); i++) {
+        qualityValues[i] = (char)('#' + ((i / 7) % 40));
+    }
+    inputs.push_back(qualityValues);
+
+    rans_ctx *ctx = rans_ctx_create();
+    CALQ_CHECK(ctx != NULL);
+    if (ctx == NULL) {
+        return calq::test::result();
+    }
+
+    for (auto const &input : inputs) {
+        testRoundTrip(ctx, rans_compress_o0, input);
+        testRoundTrip(ctx, rans_compress_o1, input);
+    }
+
+    testTruncatedInput(ctx, rans_compress_o0, qualityValues);
+    testTruncatedInput(ctx, rans_compress_o1, qualityValues);
+
+    // The context still decodes correctly after the malformed inputs
+    testRoundTrip(ctx, rans_compress_o1, qualityValues);
+    testRoundTrip(ctx, rans_compress_o0, qualityValues);
+
+    rans_ctx_destroy(ctx);
+
+    return calq::test::result();
+}
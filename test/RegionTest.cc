@@ -0,0 +1,137 @@
+/** @file RegionTest.cc
+ *  @brief This file contains the tests of decoding regions with the block
+ *         index.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sstream>
+#include <string>
+
+#include "Common/Exceptions.h"
+#include "Common/helpers.h"
+#include "IO/SAM/SAMCigar.h"
+#include "roundtrip.h"
+#include "test.h"
+
+struct ReferenceSpanVisitor {
+    ReferenceSpanVisitor(void) : length(0) {}
+
+    void match(const uint32_t &l) { length += l; }
+    void insertion(const uint32_t &) {}
+    void deletion(const uint32_t &l) { length += l; }
+
+    uint32_t length;
+};
+
+// Returns the header and the mapped records of sam which overlap the region
+static std::string filterRegion(const std::string &sam, const std::string &region) {
+    std::string rname;
+    uint32_t start = 0;
+    uint32_t end = 0;
+    calq::parseRegion(region, &rname, &start, &end);
+
+    std::string filtered;
+    std::istringstream lines(sam);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line[0] == '@') {
+            filtered += line + "\n";
+            continue;
+        }
+
+        std::string fields[6];
+        std::istringstream tokens(line);
+        for (auto &field : fields) {
+            std::getline(tokens, field, '\t');
+        }
+        if ((atoi(fields[1].c_str()) & 4) != 0 || fields[2] != rname) {
+            continue;
+        }
+
+        calq::SAMCigar samCigar;
+        samCigar.parse(calq::StringView(fields[5].data(), fields[5].size()));
+        ReferenceSpanVisitor referenceSpan;
+        samCigar.visit(&referenceSpan);
+        uint32_t posMin = (uint32_t)atoi(fields[3].c_str());
+        uint32_t posMax = posMin + referenceSpan.length - 1;
+        if (posMin <= end && posMax >= start) {
+            filtered += line + "\n";
+        }
+    }
+    return filtered;
+}
+
+static std::string decodeRegion(const std::string &cq, const std::string &sam, const std::string &region) {
+    calq::Options options = calq::test::decoderOptions(cq, sam, "region.out.sam");
+    options.region = region;
+    return calq::test::decode(options);
+}
+
+// Returns whether decoding the region fails with an error
+static bool decodeRegionFails(const std::string &cq, const std::string &sam, const std::string &region) {
+    try {
+        decodeRegion(cq, sam, region);
+    } catch (const calq::ErrorException &) {
+        return true;
+    }
+    return false;
+}
+
+static void testRegions(const std::string &cq) {
+    std::string full = calq::test::decode(calq::test::decoderOptions(cq, "region.sam", "region.full.sam"));
+    CALQ_CHECK(filterRegion(full, "chr1").empty() == false);
+
+    // Regions within a block, across blocks, of an entire reference
+    // sequence, without records, and of an unknown reference sequence
+    const char *regions[] = {"chr2:1200-1210", "chr2:1200-2800", "chr1", "chr3:2000-2000",
+                             "chr3:49000-50000", "chr1:5000", "chrX:1-100"};
+    for (auto const &region : regions) {
+        std::string decoded = decodeRegion(cq, "region.sam", region);
+        CALQ_CHECK(decoded == filterRegion(full, region));
+        if (decoded != filterRegion(full, region)) {
+            fprintf(stderr, "region %s\n", region);
+        }
+    }
+}
+
+int main(void) {
+    try {
+        calq::test::writeSamFile("region.sam", 1500, 11);
+
+        // CQ v2 with a block index
+        calq::Options options = calq::test::encoderOptions("region.sam", "region.cq");
+        options.blockSize = 250;
+        calq::test::encode(options);
+        testRegions("region.cq");
+
+        // CQ v3, which is decoded entirely
+        options.outputFileName = "region.streaming.cq";
+        options.streaming = true;
+        calq::test::encode(options);
+        testRegions("region.streaming.cq");
+
+        // Side information which does not match the CQ file in a block of
+        // the region
+        std::string sam = calq::test::readFile("region.sam");
+        size_t cigar = sam.find("50M3D50M", sam.find("\tchr2\t1"));
+        CALQ_CHECK(cigar != std::string::npos);
+        sam.replace(cigar, 8, "50M4D50M");
+        calq::test::writeFile("region.modified.sam", sam);
+        const std::string line = sam.substr(sam.rfind('\n', cigar) + 1, 60);
+        const std::string pos = line.substr(line.find("chr2") + 5, line.find("\t60\t") - line.find("chr2") - 5);
+        CALQ_CHECK(decodeRegionFails("region.cq", "region.modified.sam", "chr2:" + pos + "-" + pos) == true);
+        CALQ_CHECK(decodeRegionFails("region.cq", "region.modified.sam", "chr1") == false);
+
+        // CQ v1 files have no block index
+        CALQ_CHECK(decodeRegionFails(TEST_FILES_DIR "/test.sam.b37.v1.cq", TEST_FILES_DIR "/test.sam", "EcoliDH10B.fa") == true);
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
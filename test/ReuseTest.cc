@@ -0,0 +1,165 @@
+/** @file ReuseTest.cc
+ *  @brief This file contains the tests of reusing the QualEncoder and
+ *         QualDecoder instances across blocks.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Common/Exceptions.h"
+#include "roundtrip.h"
+#include "test.h"
+
+// Adds a column deeper than SAMPileup::HISTOGRAM_DEPTH on chr2 and a read
+// spanning a long splice junction on chr1
+static std::string addDeepColumnAndLongRead(const std::string &sam) {
+    std::string result(sam);
+    uint32_t state = 25;
+
+    size_t line = result.find("\nr1.200\t") + 1;
+    size_t end = result.find('\n', line) + 1;
+    std::istringstream tokens(result.substr(line, end - line));
+    std::string fields[4];
+    for (auto &field : fields) {
+        std::getline(tokens, field, '\t');
+    }
+    std::string deepColumn;
+    for (size_t i = 0; i < 1100; i++) {
+        std::string seq;
+        std::string qual;
+        for (size_t l = 0; l < 100; l++) {
+            seq += "ACGT"[calq::test::nextRandom(&state, 4)];
+            qual += (char)(33 + calq::test::nextRandom(&state, 42));
+        }
+        deepColumn += "d." + std::to_string(i) + "\t0\tchr2\t" + fields[3] + "\t60\t100M\t*\t0\t0\t" + seq + "\t" + qual + "\tNM:i:0\n";
+    }
+    result.insert(end, deepColumn);
+
+    line = result.find("\nr0.200\t") + 1;
+    end = result.find('\n', line) + 1;
+    tokens.clear();
+    tokens.str(result.substr(line, end - line));
+    for (auto &field : fields) {
+        std::getline(tokens, field, '\t');
+    }
+    result.insert(end, "l.0\t0\tchr1\t" + fields[3] + "\t60\t50M400000N50M\t*\t0\t0\t" + std::string(100, 'C') + "\t" + std::string(100, '5') + "\tNM:i:0\n");
+
+    return result;
+}
+
+// Splits the records into the blocks SAMFile::readBlock() reads, i.e., of
+// blockSize records, but ending where the RNAME of the mapped records changes
+static std::vector<std::string> splitBlocks(const std::string &sam, const size_t &blockSize, std::string *header) {
+    std::vector<std::string> blocks;
+    std::string rname;
+    size_t nrRecords = 0;
+
+    std::istringstream lines(sam);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line[0] == '@') {
+            *header += line + "\n";
+            continue;
+        }
+        std::istringstream tokens(line);
+        std::string fields[3];
+        for (auto &field : fields) {
+            std::getline(tokens, field, '\t');
+        }
+        bool mapped = (fields[2] != "*");
+
+        if (blocks.empty() == true || nrRecords == blockSize || (mapped == true && rname.empty() == false && fields[2] != rname)) {
+            blocks.push_back(std::string());
+            rname.clear();
+            nrRecords = 0;
+        }
+        if (mapped == true) {
+            rname = fields[2];
+        }
+        blocks.back() += line + "\n";
+        nrRecords++;
+    }
+    return blocks;
+}
+
+// Encodes and decodes every block as a file of its own, i.e., with new
+// QualEncoder and QualDecoder instances
+static std::string roundTripBlocks(const std::string &sam, const calq::Options &encoderOptions) {
+    std::string header;
+    std::vector<std::string> blocks = splitBlocks(sam, encoderOptions.blockSize, &header);
+    CALQ_CHECK(blocks.size() >= 3);
+
+    std::string decoded;
+    for (auto const &block : blocks) {
+        calq::test::writeFile("block.sam", header + block);
+        calq::Options options(encoderOptions);
+        options.inputFileName = "block.sam";
+        options.outputFileName = "block.cq";
+        options.threads = 1;
+        calq::test::encode(options);
+        decoded += calq::test::decode(calq::test::decoderOptions("block.cq", "block.sam", "block.qual"));
+    }
+    return decoded;
+}
+
+static void testReuse(const std::string &genotyper, const std::string &codec, const int &blockSize) {
+    calq::Options options = calq::test::encoderOptions("reuse.sam", "reuse.cq");
+    options.blockSize = blockSize;
+    options.genotyper = genotyper;
+    options.codec = codec;
+    const std::string expected = roundTripBlocks(calq::test::readFile("reuse.sam"), options);
+
+    calq::test::encode(options);
+    const std::string cq = calq::test::readFile("reuse.cq");
+    calq::Options decoderOptions = calq::test::decoderOptions("reuse.cq", "reuse.sam", "reuse.qual");
+    CALQ_CHECK(calq::test::decode(decoderOptions) == expected);
+    decoderOptions.threads = 3;
+    CALQ_CHECK(calq::test::decode(decoderOptions) == expected);
+
+    // With several threads, each instance encodes another sequence of blocks
+    options.threads = 3;
+    calq::test::encode(options);
+    CALQ_CHECK(calq::test::readFile("reuse.cq") == cq);
+}
+
+// In streaming mode, the instances are reused for all blocks anyway, but
+// are reset at the end of every reference sequence
+static void testStreamingReuse(void) {
+    calq::Options options = calq::test::encoderOptions("reuse.sam", "reuse.unbounded.cq");
+    options.blockSize = 1000000;
+    calq::test::encode(options);
+    const std::string expected = calq::test::decode(calq::test::decoderOptions("reuse.unbounded.cq", "reuse.sam", "reuse.qual"));
+
+    options.outputFileName = "reuse.streaming.cq";
+    options.blockSize = 50;
+    options.streaming = true;
+    calq::test::encode(options);
+    const std::string cq = calq::test::readFile("reuse.streaming.cq");
+    CALQ_CHECK(calq::test::decode(calq::test::decoderOptions("reuse.streaming.cq", "reuse.sam", "reuse.qual")) == expected);
+
+    options.threads = 3;
+    calq::test::encode(options);
+    CALQ_CHECK(calq::test::readFile("reuse.streaming.cq") == cq);
+}
+
+int main(void) {
+    try {
+        calq::test::writeSamFile("reuse.sam", 400, 25);
+        calq::test::writeFile("reuse.sam", addDeepColumnAndLongRead(calq::test::readFile("reuse.sam")));
+
+        testReuse("float", "range", 50);
+        testReuse("fixed", "rans0", 50);
+        testReuse("fixed", "range", 1500);
+        testStreamingReuse();
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
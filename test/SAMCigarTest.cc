@@ -0,0 +1,149 @@
+/** @file SAMCigarTest.cc
+ *  @brief This file contains the tests of the SAMCigar class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <utility>
+
+#include "Common/Exceptions.h"
+#include "IO/SAM/SAMCigar.h"
+#include "IO/SAM/SAMRecord.h"
+#include "test.h"
+
+struct CountingVisitor {
+    CountingVisitor(void) : matches(0), insertions(0), deletions(0), nrCalls(0) {}
+
+    void match(const uint32_t &length) { matches += length; nrCalls++; }
+    void insertion(const uint32_t &length) { insertions += length; nrCalls++; }
+    void deletion(const uint32_t &length) { deletions += length; nrCalls++; }
+
+    uint32_t matches;
+    uint32_t insertions;
+    uint32_t deletions;
+    size_t nrCalls;
+};
+
+static calq::StringView view(const char *s) {
+    return calq::StringView(s, strlen(s));
+}
+
+static bool parses(const char *cigar) {
+    calq::SAMCigar samCigar;
+    try {
+        samCigar.parse(view(cigar));
+    } catch (const calq::ErrorException &) {
+        return false;
+    }
+    return true;
+}
+
+// Returns the operations of samCigar in the notation of the CIGAR string
+static std::string format(const calq::SAMCigar &samCigar) {
+    std::string cigar;
+    for (size_t i = 0; i < samCigar.size(); i++) {
+        cigar += std::to_string(samCigar.ops()[i] >> calq::SAMCigar::LENGTH_SHIFT);
+        cigar += "MIDNSHP=X"[samCigar.ops()[i] & calq::SAMCigar::OP_MASK];
+    }
+    return cigar;
+}
+
+static void testParse(void) {
+    calq::SAMCigar samCigar;
+    CALQ_CHECK(samCigar.size() == 0);
+
+    samCigar.parse(view("100M"));
+    CALQ_CHECK(samCigar.size() == 1);
+    CALQ_CHECK(samCigar.ops()[0] == ((100u << calq::SAMCigar::LENGTH_SHIFT) | calq::SAMCigar::M));
+
+    // All operations, which no longer fit into the object itself
+    samCigar.parse(view("1M2I3D4N5S6H7P8=9X"));
+    CALQ_CHECK(samCigar.size() == 9);
+    for (uint32_t i = 0; i < 9; i++) {
+        CALQ_CHECK((samCigar.ops()[i] & calq::SAMCigar::OP_MASK) == i);
+        CALQ_CHECK((samCigar.ops()[i] >> calq::SAMCigar::LENGTH_SHIFT) == i + 1);
+    }
+
+    // Around the number of operations stored in the object itself, also
+    // when reusing the object
+    const char *cigars[] = {"5M", "1S2M3I4M5D6M", "1S2M3I4M5D6M7N", "3M", "2H3S40M1I20M2D30M5S1H", "10M"};
+    for (size_t i = 0; i < 6; i++) {
+        samCigar.parse(view(cigars[i]));
+        CALQ_CHECK(format(samCigar) == cigars[i]);
+    }
+
+    samCigar.parse(view(""));
+    CALQ_CHECK(samCigar.size() == 0);
+
+    // The operation lengths are limited to 28 bits
+    CALQ_CHECK(parses("268435455M") == true);
+    CALQ_CHECK(parses("268435456M") == false);
+    CALQ_CHECK(parses("99999999999999999999M") == false);
+    CALQ_CHECK(parses("10Q") == false);
+    CALQ_CHECK(parses("10m") == false);
+    CALQ_CHECK(parses("10M*") == false);
+}
+
+static void testCopy(void) {
+    const char *cigars[] = {"1S2M3I4M", "1S2M3I4M5D6M7N8M"};
+    for (size_t i = 0; i < 2; i++) {
+        calq::SAMCigar samCigar;
+        samCigar.parse(view(cigars[i]));
+
+        calq::SAMCigar copy(samCigar);
+        CALQ_CHECK(format(copy) == cigars[i]);
+        calq::SAMCigar assigned;
+        assigned.parse(view("1M"));
+        assigned = copy;
+        CALQ_CHECK(format(assigned) == cigars[i]);
+        calq::SAMCigar moved(std::move(copy));
+        CALQ_CHECK(format(moved) == cigars[i]);
+        CALQ_CHECK(format(samCigar) == cigars[i]);
+    }
+}
+
+static void testVisit(void) {
+    calq::SAMCigar samCigar;
+    samCigar.parse(view("8H5S10M2I3D4N6=7X1P8H"));
+
+    CountingVisitor visitor;
+    samCigar.visit(&visitor);
+    CALQ_CHECK(visitor.matches == 23);
+    CALQ_CHECK(visitor.insertions == 7);
+    CALQ_CHECK(visitor.deletions == 7);
+    CALQ_CHECK(visitor.nrCalls == 7);
+}
+
+static void testRecord(void) {
+    const std::string seq(22, 'A');
+    const std::string qual(22, 'I');
+    const calq::StringView fields[calq::SAMRecord::NUM_FIELDS] = {
+        view("r1"), view("0"), view("chr1"), view("100"), view("60"), view("5S10M2I3D400N5M"),
+        view("*"), view("0"), view("0"), calq::StringView(seq.data(), seq.size()),
+        calq::StringView(qual.data(), qual.size()), view("NM:i:0")
+    };
+
+    calq::SAMRecord samRecord(fields);
+    CALQ_CHECK(samRecord.isMapped() == true);
+    CALQ_CHECK(samRecord.cigarOps.size() == 6);
+    CALQ_CHECK(samRecord.posMin == 99);
+    CALQ_CHECK(samRecord.posMax == 99 + 10 + 3 + 400 + 5 - 1);
+}
+
+int main(void) {
+    try {
+        testParse();
+        testCopy();
+        testVisit();
+        testRecord();
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
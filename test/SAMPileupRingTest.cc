@@ -0,0 +1,228 @@
+/** @file SAMPileupRingTest.cc
+ *  @brief This file contains the tests of the SAMPileupRing class.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+
+#include <deque>
+#include <string>
+#include <utility>
+
+#include "Common/Exceptions.h"
+#include "IO/SAM/SAMPileupRing.h"
+#include "test.h"
+
+// Reference pileup: the bases (other than A, C, G, and T as 'N') and quality
+// values of the columns [posMin, posMin+columns.size())
+struct Model {
+    uint32_t posMin;
+    std::deque< std::pair<std::string, std::string> > columns;
+};
+
+static void add(calq::SAMPileupRing *ring, Model *model, const uint32_t &pos, const std::string &seq, const std::string &qual) {
+    uint32_t posMax = pos + (uint32_t)seq.size() - 1;
+    if (posMax > ring->posMax()) {
+        ring->setPosMax(posMax);
+    }
+    if (model->columns.size() < (posMax - model->posMin + 1)) {
+        model->columns.resize(posMax - model->posMin + 1);
+    }
+    ring->add(pos, seq.data(), qual.data(), seq.size());
+
+    for (size_t i = 0; i < seq.size(); i++) {
+        char base = seq[i];
+        if (base != 'A' && base != 'C' && base != 'G' && base != 'T') {
+            base = 'N';
+        }
+        model->columns[pos - model->posMin + i].first += base;
+        model->columns[pos - model->posMin + i].second += qual[i];
+    }
+}
+
+// Checks and removes the columns before pos
+static void popUntil(calq::SAMPileupRing *ring, Model *model, const uint32_t &pos) {
+    while (ring->empty() == false && ring->posMin() < pos) {
+        const std::pair<std::string, std::string> &column = model->columns.front();
+        CALQ_CHECK(ring->frontDepth() == column.first.size());
+        CALQ_CHECK(ring->frontIsHistogram() == false);
+        std::string seq("x");
+        std::string qual("x");
+        ring->unpackFront(&seq, &qual);
+        CALQ_CHECK(seq == column.first);
+        CALQ_CHECK(qual == column.second);
+
+        ring->pop_front();
+        model->columns.pop_front();
+        model->posMin++;
+    }
+}
+
+static std::string read(const size_t &length, const uint32_t &seed) {
+    std::string seq = calq::test::randomBytes(length, 6, seed);
+    for (auto &c : seq) {
+        c = "ACGTNa"[(size_t)c];
+    }
+    return seq;
+}
+
+static std::string qualityValues(const size_t &length, const uint32_t &seed) {
+    std::string qual = calq::test::randomBytes(length, 42, seed);
+    for (auto &c : qual) {
+        c = (char)(c + 33);
+    }
+    return qual;
+}
+
+static void testWraparound(void) {
+    calq::SAMPileupRing ring;
+    Model model = {1000, {}};
+    ring.setPosMin(1000);
+    ring.setPosMax(1000);
+
+    // The window of about 300 columns slides over 512 slots several times
+    uint32_t pos = 1000;
+    for (uint32_t r = 0; r < 2000; r++) {
+        add(&ring, &model, pos, read(100 + (r % 200), r), qualityValues(100 + (r % 200), r));
+        if ((r % 3) == 0) {
+            pos += 1 + (r % 4);
+            popUntil(&ring, &model, pos);
+        }
+        CALQ_CHECK(ring.nrSlots() == 512);
+    }
+
+    // Growth with the window starting in the middle of the slots
+    CALQ_CHECK(ring.posMin() % 512 != 0);
+    add(&ring, &model, pos, read(5000, 1), qualityValues(5000, 1));
+    CALQ_CHECK(ring.nrSlots() == 8192);
+    add(&ring, &model, pos + 10, read(20000, 2), qualityValues(20000, 2));
+    CALQ_CHECK(ring.nrSlots() == 32768);
+    popUntil(&ring, &model, pos + 19000);
+
+    // Shrinking when extended after having contracted
+    add(&ring, &model, pos + 20005, read(100, 3), qualityValues(100, 3));
+    CALQ_CHECK(ring.nrSlots() == 4096);
+    popUntil(&ring, &model, ring.posMax() + 1);
+    CALQ_CHECK(ring.empty() == true);
+    CALQ_CHECK(model.columns.empty() == true);
+}
+
+static void testDeepColumns(const bool &histograms) {
+    calq::SAMPileupRing ring(histograms);
+    Model model = {0, {}};
+    ring.setPosMin(0);
+    ring.setPosMax(0);
+
+    // Depths around the slab depth and beyond the histogram depth
+    const uint32_t depths[] = {31, 32, 33, 64, 1024, 1025, 1500};
+    for (uint32_t i = 0; i < 7; i++) {
+        for (uint32_t d = 0; d < depths[i]; d++) {
+            add(&ring, &model, i, read(1, (i * 2000) + d), qualityValues(1, (i * 2000) + d));
+        }
+    }
+
+    for (uint32_t i = 0; i < 7; i++) {
+        const std::pair<std::string, std::string> &column = model.columns.front();
+        CALQ_CHECK(ring.frontDepth() == depths[i]);
+        if (histograms == true && depths[i] > calq::SAMPileup::HISTOGRAM_DEPTH) {
+            CALQ_CHECK(ring.frontIsHistogram() == true);
+            const calq::SAMPileup &histogram = ring.frontHistogram();
+            std::string counts(256 * 256, '\0');
+            uint32_t depth = 0;
+            for (size_t j = 0; j < histogram.counts.size(); j++) {
+                depth += histogram.counts[j];
+                counts[((unsigned char)histogram.seq[j] << 8) | (unsigned char)histogram.qual[j]] += (char)histogram.counts[j];
+            }
+            for (size_t j = 0; j < column.first.size(); j++) {
+                counts[((unsigned char)column.first[j] << 8) | (unsigned char)column.second[j]] -= 1;
+            }
+            CALQ_CHECK(depth == depths[i]);
+            CALQ_CHECK(counts == std::string(256 * 256, '\0'));
+            ring.pop_front();
+            model.columns.pop_front();
+            model.posMin++;
+        } else {
+            popUntil(&ring, &model, i + 1);
+        }
+    }
+}
+
+static void testSkippedRegion(void) {
+    calq::SAMPileupRing ring;
+    Model model = {0, {}};
+    ring.setPosMin(0);
+
+    // A spliced read only has bases at both ends; the columns in between
+    // must not get slabs
+    add(&ring, &model, 0, read(50, 1), qualityValues(50, 1));
+    add(&ring, &model, 400050, read(50, 2), qualityValues(50, 2));
+    CALQ_CHECK(ring.nrSlots() == 524288);
+    CALQ_CHECK(ring.nrSlabs() == 100);
+    popUntil(&ring, &model, 400000);
+
+    ring.clear();
+    CALQ_CHECK(ring.empty() == true);
+    CALQ_CHECK(ring.nrSlots() == 512);
+    CALQ_CHECK(ring.nrSlabs() == 0);
+
+    // The ring is usable after having been cleared
+    model.posMin = 7;
+    model.columns.clear();
+    ring.setPosMin(7);
+    add(&ring, &model, 7, read(80, 3), qualityValues(80, 3));
+    popUntil(&ring, &model, 87);
+    CALQ_CHECK(ring.empty() == true);
+}
+
+static void testErrors(void) {
+    calq::SAMPileupRing ring;
+    ring.setPosMin(10);
+    ring.setPosMax(19);
+
+    size_t nrExceptions = 0;
+    try {
+        ring.add(5, "ACGT", "IIII", 4);
+    } catch (const calq::ErrorException &) {
+        nrExceptions++;
+    }
+    try {
+        ring.add(18, "ACGT", "IIII", 4);
+    } catch (const calq::ErrorException &) {
+        nrExceptions++;
+    }
+    try {
+        ring.add(10, "A", "\xc8", 1);
+    } catch (const calq::ErrorException &) {
+        nrExceptions++;
+    }
+    try {
+        ring.setPosMax(15);
+    } catch (const calq::ErrorException &) {
+        nrExceptions++;
+    }
+    CALQ_CHECK(nrExceptions == 4);
+
+    ring.clear();
+    try {
+        ring.pop_front();
+    } catch (const calq::ErrorException &) {
+        nrExceptions++;
+    }
+    CALQ_CHECK(nrExceptions == 5);
+}
+
+int main(void) {
+    try {
+        testWraparound();
+        testDeepColumns(true);
+        testDeepColumns(false);
+        testSkippedRegion();
+        testErrors();
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
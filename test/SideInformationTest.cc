@@ -0,0 +1,75 @@
+/** @file SideInformationTest.cc
+ *  @brief This file contains the tests of checking the side information
+ *         against the block index when decoding entire files.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#include <stdio.h>
+
+#include <string>
+
+#include "Common/Exceptions.h"
+#include "roundtrip.h"
+#include "test.h"
+
+// Returns whether decoding the CQ file with the given side information fails
+// with an error
+static bool decodeFails(const std::string &cq, const std::string &sam, const size_t &threads) {
+    calq::Options options = calq::test::decoderOptions(cq, sam, "sideinfo.out.qual");
+    options.threads = threads;
+    try {
+        calq::test::decode(options);
+    } catch (const calq::ErrorException &) {
+        return true;
+    }
+    return false;
+}
+
+static void testSideInformation(const std::string &cq) {
+    // Sequentially and in parallel
+    const size_t threads[] = {1, 3};
+    for (auto const &t : threads) {
+        CALQ_CHECK(decodeFails(cq, "sideinfo.sam", t) == false);
+
+        // A different file, a modified CIGAR string, and side information
+        // which ends after the last complete block
+        CALQ_CHECK(decodeFails(cq, "sideinfo.other.sam", t) == true);
+        CALQ_CHECK(decodeFails(cq, "sideinfo.modified.sam", t) == true);
+        CALQ_CHECK(decodeFails(cq, "sideinfo.truncated.sam", t) == true);
+    }
+}
+
+int main(void) {
+    try {
+        // 500 records per reference sequence, i.e., two blocks each, and a
+        // block with the unmapped records
+        calq::test::writeSamFile("sideinfo.sam", 500, 13);
+        calq::test::writeSamFile("sideinfo.other.sam", 500, 17);
+
+        std::string sam = calq::test::readFile("sideinfo.sam");
+        std::string modified = sam;
+        size_t cigar = modified.find("50M3D50M", modified.find("\tchr3\t"));
+        CALQ_CHECK(cigar != std::string::npos);
+        modified.replace(cigar, 8, "50M4D50M");
+        calq::test::writeFile("sideinfo.modified.sam", modified);
+        calq::test::writeFile("sideinfo.truncated.sam", sam.substr(0, sam.find("u.0\t")));
+
+        // CQ v2
+        calq::Options options = calq::test::encoderOptions("sideinfo.sam", "sideinfo.cq");
+        options.blockSize = 250;
+        calq::test::encode(options);
+        testSideInformation("sideinfo.cq");
+
+        // CQ v3
+        options.outputFileName = "sideinfo.streaming.cq";
+        options.streaming = true;
+        calq::test::encode(options);
+        testSideInformation("sideinfo.streaming.cq");
+    } catch (const calq::ErrorException &errorException) {
+        fprintf(stderr, "%s\n", errorException.what());
+        calq::test::nrFailures()++;
+    }
+
+    return calq::test::result();
+}
@@ -0,0 +1,176 @@
+/** @file roundtrip.h
+ *  @brief This file contains the helpers of the tests which encode and
+ *         decode files.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_TEST_ROUNDTRIP_H_
+#define CALQ_TEST_ROUNDTRIP_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CalqDecoder.h"
+#include "CalqEncoder.h"
+#include "Common/Options.h"
+#include "Common/StringView.h"
+#include "IO/SAM/SAMCigar.h"
+#include "test.h"
+
+namespace calq {
+namespace test {
+
+inline std::string readFile(const std::string &path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+inline void writeFile(const std::string &path, const std::string &contents) {
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file << contents;
+}
+
+// Writes a coordinate-sorted SAM file with nrRecords mapped records on each
+// of the reference sequences chr1, chr2, and chr3, followed by unmapped
+// records. The reads carry sequencing errors, insertions, deletions, soft
+// clips, and splice junctions.
+inline void writeSamFile(const std::string &path, const size_t &nrRecords, const uint32_t &seed) {
+    const char *rnames[] = {"chr1", "chr2", "chr3"};
+    const uint32_t REFERENCE_LENGTH = 50000;
+
+    std::string sam("@HD\tVN:1.4\tSO:coordinate\n");
+    for (size_t r = 0; r < 3; r++) {
+        sam += std::string("@SQ\tSN:") + rnames[r] + "\tLN:" + std::to_string(REFERENCE_LENGTH) + "\n";
+    }
+
+    uint32_t state = seed;
+    for (size_t r = 0; r < 3; r++) {
+        std::string reference(REFERENCE_LENGTH, 'A');
+        for (auto &base : reference) {
+            base = "ACGT"[nextRandom(&state, 4)];
+        }
+
+        uint32_t pos = 1 + nextRandom(&state, 100);
+        for (size_t i = 0; i < nrRecords; i++) {
+            pos += nextRandom(&state, 4);
+
+            std::string cigar;
+            switch (i % 20) {
+            case 3: cigar = "5S45M2I48M"; break;
+            case 11: cigar = "50M3D50M"; break;
+            case 17: cigar = (i % 40 == 17) ? "40M3000N60M" : "30M1I20M400N49M"; break;
+            default: cigar = std::to_string(60 + nextRandom(&state, 41)) + "M"; break;
+            }
+
+            // Walk the CIGAR string to generate the read
+            std::string seq;
+            uint32_t refPos = pos - 1;
+            SAMCigar samCigar;
+            samCigar.parse(StringView(cigar.data(), cigar.size()));
+            for (size_t o = 0; o < samCigar.size(); o++) {
+                uint32_t length = samCigar.ops()[o] >> SAMCigar::LENGTH_SHIFT;
+                uint32_t op = samCigar.ops()[o] & SAMCigar::OP_MASK;
+                for (uint32_t l = 0; l < length; l++) {
+                    if (op == SAMCigar::M) {
+                        uint32_t error = nextRandom(&state, 100);
+                        seq += (error == 0) ? 'N' : ((error < 3) ? "ACGT"[nextRandom(&state, 4)] : reference[refPos]);
+                        refPos++;
+                    } else if (op == SAMCigar::I || op == SAMCigar::S) {
+                        seq += "ACGT"[nextRandom(&state, 4)];
+                    } else {
+                        refPos++;
+                    }
+                }
+            }
+
+            std::string qual;
+            uint32_t q = 30;
+            for (size_t l = 0; l < seq.size(); l++) {
+                q = (nextRandom(&state, 8) == 0) ? (2 + nextRandom(&state, 40)) : q;
+                qual += (char)(33 + q);
+            }
+
+            sam += "r" + std::to_string(r) + "." + std::to_string(i)
+                   + "\t" + ((i % 2 == 0) ? "0" : "16")
+                   + "\t" + rnames[r] + "\t" + std::to_string(pos) + "\t60\t" + cigar
+                   + "\t*\t0\t0\t" + seq + "\t" + qual + "\tNM:i:0\n";
+        }
+    }
+
+    for (size_t i = 0; i < 25; i++) {
+        std::string seq;
+        std::string qual;
+        for (size_t l = 0; l < 75; l++) {
+            seq += "ACGT"[nextRandom(&state, 4)];
+            qual += (char)(33 + nextRandom(&state, 42));
+        }
+        sam += "u." + std::to_string(i) + "\t4\t*\t0\t0\t*\t*\t0\t0\t" + seq + "\t" + qual + "\tNM:i:0\n";
+    }
+
+    writeFile(path, sam);
+}
+
+inline Options encoderOptions(const std::string &inputFileName, const std::string &outputFileName) {
+    Options options;
+    options.force = true;
+    options.inputFileName = inputFileName;
+    options.outputFileName = outputFileName;
+    options.threads = 1;
+    options.blockSize = 10000;
+    options.codec = "range";
+    options.genotyper = "float";
+    options.polyploidy = 2;
+    options.qualityValueType = "Illumina-1.8+";
+    return options;
+}
+
+inline Options decoderOptions(const std::string &inputFileName,
+                              const std::string &sideInformationFileName,
+                              const std::string &outputFileName) {
+    Options options;
+    options.force = true;
+    options.inputFileName = inputFileName;
+    options.outputFileName = outputFileName;
+    options.threads = 1;
+    options.decompress = true;
+    options.sideInformationFileName = sideInformationFileName;
+    return options;
+}
+
+inline void encode(Options options) {
+    options.validate();
+    CalqEncoder calqEncoder(options);
+    calqEncoder.encode();
+}
+
+// Returns the decoded file
+inline std::string decode(Options options) {
+    options.validate();
+    {
+        CalqDecoder calqDecoder(options);
+        calqDecoder.decode();
+    }
+    return readFile(options.outputFileName);
+}
+
+// Returns the format version in the header of a CQ file
+inline int cqVersion(const std::string &path) {
+    std::string cq = readFile(path);
+    if (cq.size() < 3) {
+        return -1;
+    }
+    return (cq[2] == 0) ? 1 : (int)cq[2];
+}
+
+}  // namespace test
+}  // namespace calq
+
+#endif  // CALQ_TEST_ROUNDTRIP_H_
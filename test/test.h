@@ -0,0 +1,61 @@
+/** @file test.h
+ *  @brief This file contains the helpers shared by the tests.
+ */
+
+// Copyright 2015-2017 Leibniz Universitaet Hannover
+
+#ifndef CALQ_TEST_TEST_H_
+#define CALQ_TEST_TEST_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <string>
+
+namespace calq {
+namespace test {
+
+inline size_t & nrFailures(void) {
+    static size_t nrFailures = 0;
+    return nrFailures;
+}
+
+inline void check(const bool &condition, const char *expression, const char *file, const int &line) {
+    if (condition == false) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        nrFailures()++;
+    }
+}
+
+// Returns the exit code of a test program
+inline int result(void) {
+    if (nrFailures() != 0) {
+        fprintf(stderr, "%zu check(s) failed\n", nrFailures());
+        return 1;
+    }
+    return 0;
+}
+
+// Returns length pseudo-random bytes in [0, alphabetSize)
+inline std::string randomBytes(const size_t &length, const unsigned int &alphabetSize, const uint32_t &seed) {
+    std::string bytes(length, '\0');
+    uint32_t state = seed;
+    for (size_t i = 0; i < length; i++) {
+        state = (state * 1103515245) + 12345;
+        bytes[i] = (char)((state >> 16) % alphabetSize);
+    }
+    return bytes;
+}
+
+// Returns a pseudo-random number in [0, n)
+inline uint32_t nextRandom(uint32_t *state, const uint32_t &n) {
+    *state = (*state * 1103515245) + 12345;
+    return (*state >> 8) % n;
+}
+
+}  // namespace test
+}  // namespace calq
+
+#define CALQ_CHECK(condition) calq::test::check((condition), #condition, __FILE__, __LINE__)
+
+#endif  // CALQ_TEST_TEST_H_